@@ -1,4 +1,5 @@
 #include "linked_list.h"
+#include "mem_epoch.h"
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -7,17 +8,26 @@ void list_init(Node **head, size_t size) {
     *head = NULL; // Start with an empty list
 }
 
-// Function to insert a node at the end of the list
-void list_insert(Node **head, uint16_t data) {
+// Allocates and initializes a node that is not linked anywhere yet
+static Node *node_create(uint16_t data) {
     Node *new_node = (Node *)mem_alloc(sizeof(Node)); // Use custom memory manager
     if (!new_node) {
         fprintf(stderr, "Memory allocation failed\n");
-        return;
+        return NULL;
     }
 
     new_node->data = data;
     new_node->next = NULL;
     pthread_mutex_init(&new_node->lock, NULL); // Initialize mutex for the new node
+    return new_node;
+}
+
+// Function to insert a node at the end of the list
+void list_insert(Node **head, uint16_t data) {
+    Node *new_node = node_create(data);
+    if (!new_node) {
+        return;
+    }
 
     if (*head == NULL) {
         *head = new_node; // List was empty, new node becomes the head
@@ -36,16 +46,13 @@ void list_insert_after(Node *prev_node, uint16_t data) {
         return; // Previous node cannot be NULL
     }
 
-    Node *new_node = (Node *)mem_alloc(sizeof(Node)); // Use custom memory manager
+    Node *new_node = node_create(data);
     if (!new_node) {
-        fprintf(stderr, "Memory allocation failed\n");
         return;
     }
 
-    new_node->data = data;
     new_node->next = prev_node->next;
     prev_node->next = new_node; // Insert new node after the previous node
-    pthread_mutex_init(&new_node->lock, NULL); // Initialize mutex for the new node
 }
 
 // Function to insert a node before a given node
@@ -54,19 +61,15 @@ void list_insert_before(Node **head, Node *next_node, uint16_t data) {
         return; // Next node cannot be NULL
     }
 
-    Node *new_node = (Node *)mem_alloc(sizeof(Node)); // Use custom memory manager
+    Node *new_node = node_create(data);
     if (!new_node) {
-        fprintf(stderr, "Memory allocation failed\n");
         return;
     }
 
-    new_node->data = data;
-
     // If inserting before the head
     if (*head == next_node) {
         new_node->next = *head;
         *head = new_node; // New node becomes the new head
-        pthread_mutex_init(&new_node->lock, NULL); // Initialize mutex for the new node
         return;
     }
 
@@ -76,13 +79,13 @@ void list_insert_before(Node **head, Node *next_node, uint16_t data) {
     }
 
     if (current == NULL) {
+        pthread_mutex_destroy(&new_node->lock);
         mem_free(new_node); // Clean up allocated memory if next_node not found
         return; // next_node not found in the list
     }
 
     new_node->next = next_node;
     current->next = new_node; // Insert new node before next_node
-    pthread_mutex_init(&new_node->lock, NULL); // Initialize mutex for the new node
 }
 
 // Function to delete a node by value
@@ -112,6 +115,32 @@ void list_delete(Node **head, uint16_t data) {
     mem_free(current); // Free memory using custom memory manager
 }
 
+// Function to delete a node by value while readers may still be traversing the list.
+// The unlink is published atomically and the node is handed to mem_retire, so readers
+// inside mem_epoch_enter/mem_epoch_exit never see freed memory. Writers must still be
+// serialized with each other.
+void list_delete_deferred(Node **head, uint16_t data) {
+    Node *current = *head;
+    Node *previous = NULL;
+
+    while (current != NULL && current->data != data) {
+        previous = current;
+        current = current->next;
+    }
+
+    if (current == NULL) {
+        return; // Data not found in the list
+    }
+
+    if (previous == NULL) {
+        __atomic_store_n(head, current->next, __ATOMIC_RELEASE); // Deleting the head node
+    } else {
+        __atomic_store_n(&previous->next, current->next, __ATOMIC_RELEASE); // Bypass the current node
+    }
+
+    mem_retire(current); // Freed once no reader can hold it
+}
+
 // Function to search for a node by value
 Node *list_search(Node **head, uint16_t data) {
     Node *current = *head;
@@ -178,3 +207,269 @@ void list_cleanup(Node **head) {
 
     *head = NULL; // Set head to NULL after cleanup
 }
+
+// ********* List descriptor *********
+
+// Finds the first node holding data and the node before it, NULL for the head
+static Node *node_find(Node *head, uint16_t data, Node **previous) {
+    Node *current = head;
+    *previous = NULL;
+
+    while (current != NULL && current->data != data) {
+        *previous = current;
+        current = current->next;
+    }
+    return current;
+}
+
+void list_desc_init(List *list) {
+    list->head = NULL;
+    list->tail = NULL;
+    list->size = 0;
+    pthread_mutex_init(&list->lock, NULL);
+}
+
+// Appends at the tail without walking the list
+void list_desc_insert(List *list, uint16_t data) {
+    Node *new_node = node_create(data);
+    if (!new_node) {
+        return;
+    }
+
+    if (list->tail == NULL) {
+        list->head = new_node; // List was empty, new node becomes the head
+    } else {
+        list->tail->next = new_node;
+    }
+    list->tail = new_node;
+    list->size++;
+}
+
+void list_desc_insert_after(List *list, Node *prev_node, uint16_t data) {
+    if (prev_node == NULL) {
+        return; // Previous node cannot be NULL
+    }
+
+    Node *new_node = node_create(data);
+    if (!new_node) {
+        return;
+    }
+
+    new_node->next = prev_node->next;
+    prev_node->next = new_node;
+    if (list->tail == prev_node) {
+        list->tail = new_node;
+    }
+    list->size++;
+}
+
+void list_desc_insert_before(List *list, Node *next_node, uint16_t data) {
+    if (next_node == NULL) {
+        return; // Next node cannot be NULL
+    }
+
+    // Only the head can be reached without a walk
+    Node *previous = NULL;
+    if (list->head != next_node) {
+        previous = list->head;
+        while (previous != NULL && previous->next != next_node) {
+            previous = previous->next;
+        }
+        if (previous == NULL) {
+            return; // next_node not found in the list
+        }
+    }
+
+    Node *new_node = node_create(data);
+    if (!new_node) {
+        return;
+    }
+
+    new_node->next = next_node;
+    if (previous == NULL) {
+        list->head = new_node; // New node becomes the new head
+    } else {
+        previous->next = new_node;
+    }
+    list->size++;
+}
+
+void list_desc_delete(List *list, uint16_t data) {
+    Node *previous;
+    Node *current = node_find(list->head, data, &previous);
+
+    if (current == NULL) {
+        return; // Data not found in the list
+    }
+
+    if (previous == NULL) {
+        list->head = current->next; // Deleting the head node
+    } else {
+        previous->next = current->next; // Bypass the current node
+    }
+    if (list->tail == current) {
+        list->tail = previous;
+    }
+    list->size--;
+
+    mem_free(current); // Free memory using custom memory manager
+}
+
+// As list_delete_deferred: readers may traverse from the head meanwhile, writers must
+// be serialized with each other. Readers never look at the tail or the size.
+void list_desc_delete_deferred(List *list, uint16_t data) {
+    Node *previous;
+    Node *current = node_find(list->head, data, &previous);
+
+    if (current == NULL) {
+        return; // Data not found in the list
+    }
+
+    if (previous == NULL) {
+        __atomic_store_n(&list->head, current->next, __ATOMIC_RELEASE); // Deleting the head node
+    } else {
+        __atomic_store_n(&previous->next, current->next, __ATOMIC_RELEASE); // Bypass the current node
+    }
+    if (list->tail == current) {
+        list->tail = previous;
+    }
+    list->size--;
+
+    mem_retire(current); // Freed once no reader can hold it
+}
+
+Node *list_desc_search(List *list, uint16_t data) {
+    return list_search(&list->head, data);
+}
+
+void list_desc_display(List *list) {
+    list_display(&list->head);
+}
+
+void list_desc_display_range(List *list, Node *start_node, Node *end_node) {
+    list_display_range(&list->head, start_node, end_node);
+}
+
+// Kept up to date by every change, so no traversal is needed
+size_t list_desc_count_nodes(const List *list) {
+    return list->size;
+}
+
+void list_desc_cleanup(List *list) {
+    list_cleanup(&list->head);
+    list->tail = NULL;
+    list->size = 0;
+    pthread_mutex_destroy(&list->lock);
+}
+
+// ********* Lock coupling *********
+// A traversal takes list->lock, which guards head, then the lock of each node in turn,
+// and lets go of the lock before only once it holds the next one. Nodes are linked
+// after or unlinked only while both they and their predecessor are held, so no thread
+// can overtake another or step onto a freed node. Locks are always taken in list
+// order, which rules out deadlock. The tail changes only while the lock of the last
+// node, or list->lock for an empty list, is held.
+
+// Releases the predecessor of a node: the node before it, or list->lock for the head
+static void sync_unlock_previous(List *list, Node *previous) {
+    pthread_mutex_unlock(previous != NULL ? &previous->lock : &list->lock);
+}
+
+void list_sync_insert(List *list, uint16_t data) {
+    Node *new_node = node_create(data);
+    if (!new_node) {
+        return;
+    }
+
+    pthread_mutex_lock(&list->lock);
+    Node *current = list->head;
+    if (current == NULL) {
+        list->head = new_node; // List was empty, new node becomes the head
+        list->tail = new_node;
+        __atomic_add_fetch(&list->size, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&list->lock);
+        return;
+    }
+    pthread_mutex_lock(&current->lock);
+    pthread_mutex_unlock(&list->lock);
+
+    while (current->next != NULL) {
+        Node *next = current->next;
+        pthread_mutex_lock(&next->lock);
+        pthread_mutex_unlock(&current->lock);
+        current = next;
+    }
+    current->next = new_node; // Add new node at the end
+    list->tail = new_node;
+    __atomic_add_fetch(&list->size, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&current->lock);
+}
+
+int list_sync_delete(List *list, uint16_t data) {
+    pthread_mutex_lock(&list->lock);
+    Node *previous = NULL;
+    Node *current = list->head;
+    if (current == NULL) {
+        pthread_mutex_unlock(&list->lock);
+        return 0; // List is empty
+    }
+    pthread_mutex_lock(&current->lock);
+
+    while (current->data != data) {
+        Node *next = current->next;
+        if (next == NULL) {
+            pthread_mutex_unlock(&current->lock);
+            sync_unlock_previous(list, previous);
+            return 0; // Data not found in the list
+        }
+        pthread_mutex_lock(&next->lock);
+        sync_unlock_previous(list, previous);
+        previous = current;
+        current = next;
+    }
+
+    if (previous == NULL) {
+        list->head = current->next; // Deleting the head node
+    } else {
+        previous->next = current->next; // Bypass the current node
+    }
+    if (list->tail == current) {
+        list->tail = previous;
+    }
+    __atomic_sub_fetch(&list->size, 1, __ATOMIC_RELAXED);
+
+    // Anyone else heading for the node would have to hold its predecessor first
+    pthread_mutex_unlock(&current->lock);
+    sync_unlock_previous(list, previous);
+    pthread_mutex_destroy(&current->lock);
+    mem_free(current); // Free memory using custom memory manager
+    return 1;
+}
+
+int list_sync_search(List *list, uint16_t data) {
+    pthread_mutex_lock(&list->lock);
+    Node *current = list->head;
+    if (current == NULL) {
+        pthread_mutex_unlock(&list->lock);
+        return 0;
+    }
+    pthread_mutex_lock(&current->lock);
+    pthread_mutex_unlock(&list->lock);
+
+    while (current->data != data) {
+        Node *next = current->next;
+        if (next == NULL) {
+            pthread_mutex_unlock(&current->lock);
+            return 0; // Data not found
+        }
+        pthread_mutex_lock(&next->lock);
+        pthread_mutex_unlock(&current->lock);
+        current = next;
+    }
+    pthread_mutex_unlock(&current->lock);
+    return 1;
+}
+
+size_t list_sync_count_nodes(const List *list) {
+    return __atomic_load_n(&list->size, __ATOMIC_RELAXED);
+}
@@ -19,6 +19,7 @@ void list_insert(Node **head, uint16_t data);
 void list_insert_after(Node *prev_node, uint16_t data);
 void list_insert_before(Node **head, Node *next_node, uint16_t data);
 void list_delete(Node **head, uint16_t data);
+void list_delete_deferred(Node **head, uint16_t data);
 Node *list_search(Node **head, uint16_t data);
 
 void list_display(Node **head);
@@ -27,4 +28,41 @@ void list_display_range(Node **head, Node *start_node, Node *end_node);
 int list_count_nodes(Node **head);
 void list_cleanup(Node **head);
 
+// List descriptor: the head plus the tail and length, so appending and counting take
+// constant time. The list_desc_* functions mirror the Node ** functions above, which
+// stay for code that only keeps a head pointer. A list built through one API must not
+// be changed through the other, since the descriptor would go stale.
+typedef struct List
+{
+    Node *head;
+    Node *tail;  // Last node, NULL while empty
+    size_t size; // Number of nodes
+    pthread_mutex_t lock; // Guards head for the list_sync_* functions
+} List;
+
+void list_desc_init(List *list);
+void list_desc_insert(List *list, uint16_t data);
+void list_desc_insert_after(List *list, Node *prev_node, uint16_t data);
+void list_desc_insert_before(List *list, Node *next_node, uint16_t data);
+void list_desc_delete(List *list, uint16_t data);
+void list_desc_delete_deferred(List *list, uint16_t data);
+Node *list_desc_search(List *list, uint16_t data);
+
+void list_desc_display(List *list);
+void list_desc_display_range(List *list, Node *start_node, Node *end_node);
+
+size_t list_desc_count_nodes(const List *list);
+void list_desc_cleanup(List *list);
+
+// Thread-safe variants using lock coupling on the per-node locks: any number of threads
+// may call these on the same List at once, and operations on different parts of the
+// list proceed in parallel. Appending walks the list, as list_insert does. A List is
+// changed either through these or from a single thread through list_desc_*, not both
+// at once. list_sync_search and list_sync_delete report whether data was found, since
+// a node returned could be deleted right away.
+void list_sync_insert(List *list, uint16_t data);
+int list_sync_delete(List *list, uint16_t data);
+int list_sync_search(List *list, uint16_t data);
+size_t list_sync_count_nodes(const List *list);
+
 #endif // LINKED_LIST_H
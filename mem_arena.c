@@ -0,0 +1,182 @@
+#define _GNU_SOURCE  // For sched_getcpu
+#include <stdint.h>
+#include <sched.h>
+#include <sys/sysinfo.h>
+#include "memory_manager.h"
+#include "mem_locks.h"
+#include "memory_manager_internal.h"
+#include "mem_arena.h"
+
+// Arenas for small blocks.
+// Every block carries a header word with the index of its arena and its size class,
+// so it can be freed from any thread. Blocks are cut from chunks taken from the pool
+// and kept on per-class free lists once freed; chunks go back to the pool only in
+// mem_arena_deinit, and are forgotten when mem_deinit or mem_reset discards the pool.
+// The arena lock nests outside the pool lock, never inside it.
+
+#define ARENA_MAX 64
+#define ARENA_CHUNK (64 * 1024)
+#define ARENA_LARGE (UINT64_MAX << 8)  // Header of a block taken from the pool directly, ORed
+                                       // with the distance back to the start of the pool block
+#define ARENA_ALIGN(p) ((char *)(((uintptr_t)(p) + 7) & ~(uintptr_t)7))  // Pool blocks may be unaligned
+
+typedef struct
+{
+    mem_futex_lock_t lock;
+    void *free_lists[MEM_SIZE_CLASS_SMALL];
+    char *bump;       // Next unused byte of the current chunk
+    char *bump_end;
+    void *chunks;     // Chunks of this arena, linked through their first word
+    size_t chunk_count;
+} __attribute__((aligned(64))) arena_t;
+
+static arena_t arenas[ARENA_MAX];
+static int arena_mode = MEM_ARENA_PER_THREAD;
+static size_t arena_count = ARENA_MAX;
+static unsigned int arena_next;        // Next arena handed to a thread
+static unsigned int arena_generation;  // Bumped by mem_arena_deinit, so threads pick again
+static __thread unsigned int thread_arena;
+static __thread unsigned int thread_generation;
+
+static arena_t *arena_current(unsigned int *index)
+{
+    if (arena_mode == MEM_ARENA_PER_CPU) {
+        int cpu = sched_getcpu();
+        *index = cpu < 0 ? 0 : (unsigned int)cpu % arena_count;
+    } else {
+        unsigned int generation = __atomic_load_n(&arena_generation, __ATOMIC_RELAXED);
+        if (thread_generation != generation + 1) {
+            thread_arena = __atomic_fetch_add(&arena_next, 1, __ATOMIC_RELAXED) % arena_count;
+            thread_generation = generation + 1;  // Zero is never a valid generation here
+        }
+        *index = thread_arena;
+    }
+    return &arenas[*index];
+}
+
+// Empties every arena and makes threads pick theirs again. With release set the chunks
+// go back to the pool first; otherwise they are dropped along with a pool that is gone.
+static void arena_clear(int release)
+{
+    for (size_t i = 0; i < ARENA_MAX; i++) {
+        arena_t *arena = &arenas[i];
+        mem_futex_lock(&arena->lock);
+        while (release && arena->chunks != NULL) {
+            void *next = *(void **)ARENA_ALIGN(arena->chunks);
+            mem_free(arena->chunks);
+            arena->chunks = next;
+        }
+        arena->chunks = NULL;
+        for (size_t c = 0; c < MEM_SIZE_CLASS_SMALL; c++) {
+            arena->free_lists[c] = NULL;
+        }
+        arena->bump = arena->bump_end = NULL;
+        arena->chunk_count = 0;
+        mem_futex_unlock(&arena->lock);
+    }
+    __atomic_fetch_add(&arena_generation, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&arena_next, 0, __ATOMIC_RELAXED);
+}
+
+void mem_arena_deinit(void)
+{
+    arena_clear(1);
+}
+
+void mem_arena_reset(void)
+{
+    arena_clear(0);
+}
+
+int mem_arena_init(int mode)
+{
+    if (mode != MEM_ARENA_PER_THREAD && mode != MEM_ARENA_PER_CPU) {
+        return -1;
+    }
+    mem_arena_deinit();
+    int cpus = get_nprocs_conf();
+    arena_mode = mode;
+    arena_count = mode == MEM_ARENA_PER_THREAD ? ARENA_MAX : cpus < 1 ? 1 : cpus > ARENA_MAX ? ARENA_MAX : (size_t)cpus;
+    return 0;
+}
+
+void *mem_arena_alloc(size_t size)
+{
+    if (size == 0) {
+        return NULL;
+    }
+    if (size > MEM_SIZE_CLASS_SMALL_MAX) {
+        char *start = size <= SIZE_MAX - 2 * sizeof(uint64_t) ? mem_alloc(size + 2 * sizeof(uint64_t) - 1) : NULL;
+        if (start == NULL) {
+            return NULL;
+        }
+        uint64_t *block = (uint64_t *)ARENA_ALIGN(start);
+        block[0] = ARENA_LARGE | (uint64_t)((char *)block - start);
+        return block + 1;
+    }
+
+    size_t size_class = mem_size_class_inline(size);
+    size_t need = sizeof(uint64_t) + mem_size_class_size_inline(size_class);
+    unsigned int index;
+    arena_t *arena = arena_current(&index);
+    uint64_t *block;
+
+    mem_futex_lock(&arena->lock);
+    block = arena->free_lists[size_class];
+    if (block != NULL) {
+        arena->free_lists[size_class] = *(void **)(block + 1);
+    } else {
+        if ((size_t)(arena->bump_end - arena->bump) < need) {
+            // The rest of the chunk is dropped; at most one block's worth is lost
+            char *chunk = mem_alloc(ARENA_CHUNK);
+            if (chunk == NULL) {
+                mem_futex_unlock(&arena->lock);
+                return NULL;
+            }
+            *(void **)ARENA_ALIGN(chunk) = arena->chunks;
+            arena->chunks = chunk;
+            arena->chunk_count++;
+            arena->bump = ARENA_ALIGN(chunk) + sizeof(void *);
+            arena->bump_end = chunk + ARENA_CHUNK;
+        }
+        block = (uint64_t *)arena->bump;
+        arena->bump += need;
+    }
+    mem_futex_unlock(&arena->lock);
+
+    block[0] = (uint64_t)index << 8 | size_class;
+    return block + 1;
+}
+
+void mem_arena_free(void *block)
+{
+    if (block == NULL) {
+        return;
+    }
+    uint64_t *header = (uint64_t *)block - 1;
+    if ((*header & ARENA_LARGE) == ARENA_LARGE) {
+        mem_free((char *)header - (*header & 0xff));
+        return;
+    }
+
+    arena_t *arena = &arenas[*header >> 8];
+    size_t size_class = *header & 0xff;
+    mem_futex_lock(&arena->lock);
+    *(void **)block = arena->free_lists[size_class];
+    arena->free_lists[size_class] = header;
+    mem_futex_unlock(&arena->lock);
+}
+
+size_t mem_arena_count(void)
+{
+    return arena_count;
+}
+
+size_t mem_arena_footprint(void)
+{
+    size_t chunks = 0;
+    for (size_t i = 0; i < ARENA_MAX; i++) {
+        chunks += __atomic_load_n(&arenas[i].chunk_count, __ATOMIC_RELAXED);
+    }
+    return chunks * ARENA_CHUNK;
+}
@@ -0,0 +1,72 @@
+// mem_arena.h
+#ifndef MEM_ARENA_H
+#define MEM_ARENA_H
+
+#include <stddef.h> // For size_t
+
+// Helps C++ compilers to handle C header files
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    // How threads are mapped to arenas, see mem_arena_init
+#define MEM_ARENA_PER_THREAD 0 // Each thread keeps the arena it was given first
+#define MEM_ARENA_PER_CPU 1    // The arena of the CPU the thread runs on, from sched_getcpu
+
+    /**
+     * Sets up arenas in front of the current memory pool. Each arena has its own lock
+     * and free lists per size class, and takes memory from the pool in 64 KB chunks,
+     * so small allocations from different arenas do not contend on the pool lock.
+     *
+     * With MEM_ARENA_PER_THREAD, threads are given arenas in turn, up to 64 of them;
+     * with MEM_ARENA_PER_CPU there is one arena per CPU and a thread uses the arena of
+     * the CPU it is running on, so the number of arenas, the memory they hold and the
+     * contention on each stay bounded by the core count however many threads there
+     * are. sched_getcpu reads the CPU number from restartable sequences on kernels and
+     * C libraries that have them, so looking it up costs no system call.
+     *
+     * Calling it again switches the mode after releasing the arenas, as mem_arena_deinit does.
+     *
+     * @param mode MEM_ARENA_PER_THREAD or MEM_ARENA_PER_CPU.
+     * @return 0 on success, or -1 if mode is unknown.
+     */
+    int mem_arena_init(int mode);
+
+    /**
+     * Returns the chunks of every arena to the pool. Blocks still allocated from the
+     * arenas become invalid. mem_deinit and mem_reset empty the arenas as well, so
+     * calling this first is not required; the mode set by mem_arena_init is kept.
+     */
+    void mem_arena_deinit(void);
+
+    /**
+     * Allocates a block from the arena of the calling thread or CPU. Blocks larger
+     * than MEM_SIZE_CLASS_SMALL_MAX come from the pool directly.
+     *
+     * @param size The size of the block.
+     * @return The block, 8-byte aligned, or NULL if the pool is out of memory.
+     */
+    void *mem_arena_alloc(size_t size);
+
+    /**
+     * Frees a block from mem_arena_alloc. It goes back to the arena it came from,
+     * whichever thread frees it.
+     */
+    void mem_arena_free(void *block);
+
+    /**
+     * Returns the number of arenas in use.
+     */
+    size_t mem_arena_count(void);
+
+    /**
+     * Returns the number of pool bytes held by the arenas.
+     */
+    size_t mem_arena_footprint(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MEM_ARENA_H
@@ -0,0 +1,133 @@
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "memory_manager.h"
+#include "memory_manager_internal.h"
+
+// Dirty page decay.
+// Pages of freed blocks stay resident so that reusing them is cheap, but after a
+// spike they would stay resident forever. A background thread wakes DECAY_STEPS
+// times per decay period and records how many dirty pages appeared since its last
+// tick. Pages that appeared i ticks ago may stay dirty with weight
+// smoothstep(1 - (i + 1) / DECAY_STEPS), so recent frees are kept and everything is
+// purged one decay period after it was freed, as in jemalloc's dirty decay.
+
+#define DECAY_STEPS 20
+
+static pthread_mutex_t decay_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t decay_wakeup = PTHREAD_COND_INITIALIZER;
+static pthread_t decay_thread;
+static int decay_running;
+static int decay_stopping;
+static unsigned int decay_ms;
+static int decay_advice;
+static size_t decay_purged;  // Pages purged since mem_decay_start
+
+static double decay_smoothstep(double x)
+{
+    return x * x * (3.0 - 2.0 * x);
+}
+
+// Number of dirty pages that may remain given the pages dirtied in recent ticks
+static size_t decay_limit(const size_t *backlog)
+{
+    double limit = 0.0;
+    for (int i = 0; i < DECAY_STEPS; i++) {
+        limit += backlog[i] * decay_smoothstep(1.0 - (double)(i + 1) / DECAY_STEPS);
+    }
+    return (size_t)limit;
+}
+
+static void *decay_main(void *arg)
+{
+    size_t backlog[DECAY_STEPS] = {0};
+    size_t last_dirty = mem_dirty_pages();
+    size_t cursor = 0;
+    (void)arg;
+
+    pthread_mutex_lock(&decay_lock);
+    while (!decay_stopping) {
+        unsigned int tick_ms = decay_ms / DECAY_STEPS > 0 ? decay_ms / DECAY_STEPS : 1;
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += tick_ms / 1000;
+        deadline.tv_nsec += (long)(tick_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&decay_wakeup, &decay_lock, &deadline);
+        if (decay_stopping) {
+            break;
+        }
+        int advice = decay_advice;
+        pthread_mutex_unlock(&decay_lock);
+
+        size_t dirty = mem_dirty_pages();
+        memmove(backlog + 1, backlog, (DECAY_STEPS - 1) * sizeof(size_t));
+        backlog[0] = dirty > last_dirty ? dirty - last_dirty : 0;
+        size_t limit = decay_limit(backlog);
+
+        // Purge block by block, each one under a short hold of the pool lock; two
+        // wraps make a full pass over the pool from wherever the cursor was
+        int wraps = 0;
+        while (dirty > limit && wraps < 2) {
+            int wrapped = 0;
+            size_t pages = mem_pool_purge(&cursor, advice, &wrapped);
+            __atomic_fetch_add(&decay_purged, pages, __ATOMIC_RELAXED);
+            dirty = dirty > pages ? dirty - pages : 0;
+            wraps += wrapped;
+        }
+        last_dirty = mem_dirty_pages();
+
+        pthread_mutex_lock(&decay_lock);
+    }
+    pthread_mutex_unlock(&decay_lock);
+    return NULL;
+}
+
+int mem_decay_start(unsigned int decay_time_ms, int advice)
+{
+    if (decay_time_ms == 0 || (advice != MEM_PURGE_DONTNEED && advice != MEM_PURGE_FREE)) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&decay_lock);
+    decay_ms = decay_time_ms;
+    decay_advice = advice;
+    if (!decay_running) {
+        decay_stopping = 0;
+        decay_purged = 0;
+        if (pthread_create(&decay_thread, NULL, decay_main, NULL) != 0) {
+            pthread_mutex_unlock(&decay_lock);
+            return -1;
+        }
+        decay_running = 1;
+    }
+    pthread_mutex_unlock(&decay_lock);
+    return 0;
+}
+
+void mem_decay_stop(void)
+{
+    pthread_mutex_lock(&decay_lock);
+    if (!decay_running) {
+        pthread_mutex_unlock(&decay_lock);
+        return;
+    }
+    decay_stopping = 1;
+    pthread_cond_signal(&decay_wakeup);
+    pthread_mutex_unlock(&decay_lock);
+
+    pthread_join(decay_thread, NULL);
+
+    pthread_mutex_lock(&decay_lock);
+    decay_running = 0;
+    pthread_mutex_unlock(&decay_lock);
+}
+
+size_t mem_decay_purged_pages(void)
+{
+    return __atomic_load_n(&decay_purged, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <pthread.h>
+#include "memory_manager.h"
+#include "mem_epoch.h"
+
+// Epoch-based reclamation.
+// A global epoch advances only when every thread inside a critical section has
+// observed the current value. A block retired while the global epoch is e can
+// therefore be freed once the global epoch reaches e + 2. Each thread keeps one
+// retire list per epoch modulo 3.
+
+#define EPOCH_BATCH 64  // Retired blocks between two attempts to advance the epoch
+#define EPOCH_LISTS 3
+
+typedef struct
+{
+    void **blocks;
+    size_t count;
+    size_t capacity;
+    uint64_t epoch;  // Epoch in which the blocks were retired
+} epoch_list_t;
+
+typedef struct epoch_record
+{
+    struct epoch_record *next;  // Next record in the global registry
+    uint64_t state;             // (local epoch << 1) | 1 while inside a critical section, 0 outside
+    int in_use;                 // Owned by a live thread
+    int nesting;
+    size_t since_advance;       // Blocks retired since the last advance attempt
+    epoch_list_t lists[EPOCH_LISTS];
+} epoch_record_t;
+
+static uint64_t global_epoch = EPOCH_LISTS;  // Start high enough that epoch - 2 never wraps
+static epoch_record_t *epoch_records;        // Registry of all records, never shrinks
+static size_t epoch_pending;                 // Retired and not yet freed, across all threads
+static pthread_mutex_t epoch_orphan_lock = PTHREAD_MUTEX_INITIALIZER;
+static epoch_list_t epoch_orphans[EPOCH_LISTS];  // Left behind by exited threads
+static pthread_key_t epoch_key;
+static pthread_once_t epoch_key_once = PTHREAD_ONCE_INIT;
+static __thread epoch_record_t *epoch_self;
+
+static int epoch_list_push(epoch_list_t *list, void *block)
+{
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : EPOCH_BATCH;
+        void **grown = realloc(list->blocks, capacity * sizeof(void *));
+        if (grown == NULL) {
+            return -1;
+        }
+        list->blocks = grown;
+        list->capacity = capacity;
+    }
+    list->blocks[list->count++] = block;
+    return 0;
+}
+
+static void epoch_list_free(epoch_list_t *list)
+{
+    for (size_t i = 0; i < list->count; i++) {
+        mem_free(list->blocks[i]);
+    }
+    __atomic_fetch_sub(&epoch_pending, list->count, __ATOMIC_RELAXED);
+    list->count = 0;
+}
+
+// Frees every list whose blocks were retired at least two epochs before `epoch`
+static void epoch_collect(epoch_list_t *lists, uint64_t epoch)
+{
+    for (int i = 0; i < EPOCH_LISTS; i++) {
+        if (lists[i].count > 0 && lists[i].epoch + 2 <= epoch) {
+            epoch_list_free(&lists[i]);
+        }
+    }
+}
+
+static void epoch_collect_orphans(uint64_t epoch)
+{
+    if (pthread_mutex_trylock(&epoch_orphan_lock) == 0) {
+        epoch_collect(epoch_orphans, epoch);
+        pthread_mutex_unlock(&epoch_orphan_lock);
+    }
+}
+
+// Moves the blocks of an exiting thread to the orphan lists
+static void epoch_thread_exit(void *arg)
+{
+    epoch_record_t *record = (epoch_record_t *)arg;
+
+    pthread_mutex_lock(&epoch_orphan_lock);
+    for (int i = 0; i < EPOCH_LISTS; i++) {
+        epoch_list_t *list = &record->lists[i];
+        epoch_list_t *orphans = &epoch_orphans[list->epoch % EPOCH_LISTS];
+        if (list->count == 0) {
+            continue;
+        }
+        // Lists that share a slot but not an epoch are three or more epochs apart,
+        // so the older one is already safe to free
+        if (orphans->count > 0 && orphans->epoch > list->epoch) {
+            epoch_list_free(list);
+            continue;
+        }
+        if (orphans->count > 0 && orphans->epoch < list->epoch) {
+            epoch_list_free(orphans);
+        }
+        orphans->epoch = list->epoch;
+        for (size_t j = 0; j < list->count; j++) {
+            if (epoch_list_push(orphans, list->blocks[j]) != 0) {
+                break;  // Out of memory: the block leaks rather than being freed early
+            }
+        }
+        list->count = 0;
+    }
+    pthread_mutex_unlock(&epoch_orphan_lock);
+
+    __atomic_store_n(&record->state, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&record->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void epoch_make_key(void)
+{
+    pthread_key_create(&epoch_key, epoch_thread_exit);
+}
+
+static epoch_record_t *epoch_record(void)
+{
+    if (epoch_self != NULL) {
+        return epoch_self;
+    }
+
+    pthread_once(&epoch_key_once, epoch_make_key);
+
+    // Reuse the record of an exited thread if there is one
+    epoch_record_t *record;
+    for (record = __atomic_load_n(&epoch_records, __ATOMIC_ACQUIRE); record != NULL; record = record->next) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&record->in_use, &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    if (record == NULL) {
+        record = calloc(1, sizeof(epoch_record_t));
+        if (record == NULL) {
+            perror("Epoch record allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        record->in_use = 1;
+        record->next = __atomic_load_n(&epoch_records, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&epoch_records, &record->next, record, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+    }
+
+    record->nesting = 0;
+    record->since_advance = 0;
+    pthread_setspecific(epoch_key, record);
+    epoch_self = record;
+    return record;
+}
+
+// Advances the global epoch if every active reader has observed it; returns the current epoch
+static uint64_t epoch_try_advance(void)
+{
+    uint64_t epoch = __atomic_load_n(&global_epoch, __ATOMIC_ACQUIRE);
+
+    for (epoch_record_t *record = __atomic_load_n(&epoch_records, __ATOMIC_ACQUIRE); record != NULL; record = record->next) {
+        uint64_t state = __atomic_load_n(&record->state, __ATOMIC_ACQUIRE);
+        if ((state & 1) && (state >> 1) != epoch) {
+            return epoch;  // A reader is still in an older epoch
+        }
+    }
+
+    if (__atomic_compare_exchange_n(&global_epoch, &epoch, epoch + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        epoch++;
+    }
+    return epoch;
+}
+
+void mem_epoch_enter(void)
+{
+    epoch_record_t *record = epoch_record();
+
+    if (record->nesting++ == 0) {
+        uint64_t epoch = __atomic_load_n(&global_epoch, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&record->state, (epoch << 1) | 1, __ATOMIC_RELAXED);
+        // The announcement must be visible before any shared pointer is read
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+}
+
+void mem_epoch_exit(void)
+{
+    epoch_record_t *record = epoch_self;
+
+    if (record != NULL && --record->nesting == 0) {
+        __atomic_store_n(&record->state, 0, __ATOMIC_RELEASE);
+    }
+}
+
+void mem_retire(void *block)
+{
+    if (block == NULL) {
+        return;
+    }
+
+    epoch_record_t *record = epoch_record();
+    uint64_t epoch = __atomic_load_n(&global_epoch, __ATOMIC_ACQUIRE);
+    epoch_list_t *list = &record->lists[epoch % EPOCH_LISTS];
+
+    if (list->count > 0 && list->epoch != epoch) {
+        epoch_list_free(list);  // Retired three or more epochs ago
+    }
+    list->epoch = epoch;
+
+    if (epoch_list_push(list, block) != 0) {
+        // Out of memory for the retire list: wait for readers instead
+        mem_epoch_synchronize();
+        mem_free(block);
+        return;
+    }
+    __atomic_fetch_add(&epoch_pending, 1, __ATOMIC_RELAXED);
+
+    if (++record->since_advance >= EPOCH_BATCH) {
+        record->since_advance = 0;
+        epoch = epoch_try_advance();
+        epoch_collect(record->lists, epoch);
+        epoch_collect_orphans(epoch);
+    }
+}
+
+void mem_epoch_synchronize(void)
+{
+    epoch_record_t *record = epoch_record();
+    uint64_t target = __atomic_load_n(&global_epoch, __ATOMIC_ACQUIRE) + 2;
+    uint64_t epoch;
+
+    while ((epoch = epoch_try_advance()) < target) {
+        sched_yield();  // A reader is still inside an older epoch
+    }
+
+    epoch_collect(record->lists, epoch);
+    pthread_mutex_lock(&epoch_orphan_lock);
+    epoch_collect(epoch_orphans, epoch);
+    pthread_mutex_unlock(&epoch_orphan_lock);
+}
+
+size_t mem_epoch_pending(void)
+{
+    return __atomic_load_n(&epoch_pending, __ATOMIC_RELAXED);
+}
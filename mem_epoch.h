@@ -0,0 +1,60 @@
+// mem_epoch.h
+#ifndef MEM_EPOCH_H
+#define MEM_EPOCH_H
+
+#include <stddef.h> // For size_t
+
+// Helps C++ compilers to handle C header files
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * Epoch-based reclamation for data structures whose readers run without locks.
+     *
+     * Readers wrap every access to shared nodes in mem_epoch_enter/mem_epoch_exit.
+     * Writers unlink a node and hand it to mem_retire instead of mem_free; the node
+     * is freed once every thread that was inside a critical section at the time has
+     * left it. Retired blocks are collected per thread and freed in batches.
+     */
+
+    /**
+     * Starts a read-side critical section. Blocks reachable inside it stay valid
+     * until the matching mem_epoch_exit. Critical sections may be nested.
+     */
+    void mem_epoch_enter(void);
+
+    /**
+     * Ends the read-side critical section started by mem_epoch_enter.
+     */
+    void mem_epoch_exit(void);
+
+    /**
+     * Defers freeing a block that has been unlinked from a shared structure until
+     * no reader can still hold a reference to it. The block is eventually released
+     * with mem_free.
+     *
+     * @param block A pointer returned by mem_alloc, no longer reachable by new readers.
+     */
+    void mem_retire(void *block);
+
+    /**
+     * Waits until every reader active at the time of the call has left its critical
+     * section, then frees the blocks retired by the calling thread and by threads
+     * that have exited. Live threads free their own blocks on later calls to
+     * mem_retire. Must not be called from inside a critical section; call it after
+     * joining the worker threads and before mem_deinit.
+     */
+    void mem_epoch_synchronize(void);
+
+    /**
+     * Returns the number of retired blocks that have not been freed yet.
+     */
+    size_t mem_epoch_pending(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MEM_EPOCH_H
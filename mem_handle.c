@@ -0,0 +1,161 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "memory_manager.h"
+#include "memory_manager_internal.h"
+
+// Relocatable blocks.
+// A handle is one plus an index into a table of block offsets. The block keeps the
+// index in its first word, so mem_compact can find the entry of any handle block it
+// walks past. An entry that does not point back at the block is stale, for instance
+// while the handle is being allocated or freed, and the block then stays put.
+
+#define HANDLE_UNPLACED SIZE_MAX  // Offset of an entry without a block
+#define HANDLE_TABLE_MIN 256
+
+typedef struct
+{
+    size_t offset;     // Offset of the block header, or HANDLE_UNPLACED
+    size_t size;       // Requested size; a reused free block may be larger
+    size_t next_free;  // Next entry on the free list while unused
+    unsigned int pins;
+    int in_use;
+} handle_entry_t;
+
+static pthread_mutex_t handle_lock = PTHREAD_MUTEX_INITIALIZER;
+static handle_entry_t *handle_table;
+static size_t handle_count;  // Entries handed out so far, in use or on the free list
+static size_t handle_capacity;
+static size_t handle_free_list = SIZE_MAX;
+
+void mem_handle_table_lock(void)
+{
+    pthread_mutex_lock(&handle_lock);
+}
+
+void mem_handle_table_unlock(void)
+{
+    pthread_mutex_unlock(&handle_lock);
+}
+
+// Returns the entry of a placed handle, with the table locked
+static handle_entry_t *handle_entry(mem_handle_t handle)
+{
+    if (handle == 0 || handle > handle_count) {
+        return NULL;
+    }
+    handle_entry_t *entry = &handle_table[handle - 1];
+    return entry->in_use && entry->offset != HANDLE_UNPLACED ? entry : NULL;
+}
+
+static void handle_release(size_t index)
+{
+    handle_table[index].in_use = 0;
+    handle_table[index].offset = HANDLE_UNPLACED;
+    handle_table[index].next_free = handle_free_list;
+    handle_free_list = index;
+}
+
+mem_handle_t mem_handle_alloc(size_t size)
+{
+    pthread_mutex_lock(&handle_lock);
+
+    size_t index = handle_free_list;
+    if (index != SIZE_MAX) {
+        handle_free_list = handle_table[index].next_free;
+    } else {
+        if (handle_count == handle_capacity) {
+            size_t capacity = handle_capacity ? handle_capacity * 2 : HANDLE_TABLE_MIN;
+            handle_entry_t *grown = realloc(handle_table, capacity * sizeof(handle_entry_t));
+            if (grown == NULL) {
+                pthread_mutex_unlock(&handle_lock);
+                return 0;
+            }
+            handle_table = grown;
+            handle_capacity = capacity;
+        }
+        index = handle_count++;
+    }
+    handle_table[index].offset = HANDLE_UNPLACED;  // Reserved, the block is not movable yet
+    handle_table[index].pins = 0;
+    handle_table[index].in_use = 1;
+    pthread_mutex_unlock(&handle_lock);
+
+    // The pool lock is never taken with the table lock held
+    size_t offset = mem_pool_alloc_handle(size, index);
+
+    pthread_mutex_lock(&handle_lock);
+    if (offset == SIZE_MAX) {
+        handle_release(index);
+        pthread_mutex_unlock(&handle_lock);
+        return 0;
+    }
+    handle_table[index].offset = offset;
+    handle_table[index].size = size;
+    pthread_mutex_unlock(&handle_lock);
+    return index + 1;
+}
+
+void *mem_handle_lock(mem_handle_t handle)
+{
+    void *block = NULL;
+    pthread_mutex_lock(&handle_lock);
+    handle_entry_t *entry = handle_entry(handle);
+    if (entry != NULL) {
+        entry->pins++;
+        block = (char *)mem_at_offset(entry->offset) + 2 * sizeof(size_t);  // Past the header and the index
+    }
+    pthread_mutex_unlock(&handle_lock);
+    return block;
+}
+
+void mem_handle_unlock(mem_handle_t handle)
+{
+    pthread_mutex_lock(&handle_lock);
+    handle_entry_t *entry = handle_entry(handle);
+    if (entry != NULL && entry->pins > 0) {
+        entry->pins--;
+    }
+    pthread_mutex_unlock(&handle_lock);
+}
+
+int mem_handle_free(mem_handle_t handle)
+{
+    pthread_mutex_lock(&handle_lock);
+    handle_entry_t *entry = handle_entry(handle);
+    if (entry == NULL || entry->pins > 0) {
+        pthread_mutex_unlock(&handle_lock);
+        return -1;
+    }
+    size_t offset = entry->offset;
+    handle_release(handle - 1);  // The block no longer matches its entry, so it stays put
+    pthread_mutex_unlock(&handle_lock);
+
+    mem_free((char *)mem_at_offset(offset) + sizeof(size_t));
+    return 0;
+}
+
+size_t mem_handle_movable(size_t index, size_t offset)
+{
+    if (index < handle_count && handle_table[index].in_use && handle_table[index].offset == offset &&
+        handle_table[index].pins == 0) {
+        return handle_table[index].size + sizeof(size_t);  // The index word comes first
+    }
+    return 0;
+}
+
+void mem_handle_moved(size_t index, size_t offset)
+{
+    handle_table[index].offset = offset;
+}
+
+void mem_handle_reset(void)
+{
+    pthread_mutex_lock(&handle_lock);
+    free(handle_table);
+    handle_table = NULL;
+    handle_count = 0;
+    handle_capacity = 0;
+    handle_free_list = SIZE_MAX;
+    pthread_mutex_unlock(&handle_lock);
+}
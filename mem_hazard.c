@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "memory_manager.h"
+#include "mem_hazard.h"
+
+// Hazard-pointer reclamation.
+// A thread scans once its retire list reaches HP_BATCH plus the total number of
+// hazard slots. At most that many slots can be non-empty, so a scan frees at
+// least HP_BATCH blocks and no thread ever holds more than the threshold.
+
+#define HP_BATCH 64
+
+typedef struct hp_record
+{
+    struct hp_record *next;  // Next record in the global registry
+    int in_use;              // Owned by a live thread
+    void *hazards[MEM_HP_SLOTS];
+    void **retired;
+    size_t count;
+    size_t capacity;
+    void **scratch;  // Snapshot of the hazards, reused across scans
+    size_t scratch_capacity;
+} hp_record_t;
+
+static hp_record_t *hp_records;  // Registry of all records, never shrinks
+static size_t hp_record_count;
+static size_t hp_unreclaimed;
+static pthread_mutex_t hp_orphan_lock = PTHREAD_MUTEX_INITIALIZER;
+static void **hp_orphans;  // Blocks left behind by exited threads
+static size_t hp_orphan_count;
+static size_t hp_orphan_capacity;
+static pthread_key_t hp_key;
+static pthread_once_t hp_key_once = PTHREAD_ONCE_INIT;
+static __thread hp_record_t *hp_self;
+
+static size_t hp_threshold(void)
+{
+    return HP_BATCH + __atomic_load_n(&hp_record_count, __ATOMIC_RELAXED) * MEM_HP_SLOTS;
+}
+
+static int hp_compare(const void *a, const void *b)
+{
+    uintptr_t x = (uintptr_t) * (void *const *)a;
+    uintptr_t y = (uintptr_t) * (void *const *)b;
+    return (x > y) - (x < y);
+}
+
+// Grows the record's scratch array to hold at least capacity hazards
+static int hp_reserve_scratch(hp_record_t *self, size_t capacity)
+{
+    if (capacity <= self->scratch_capacity) {
+        return 0;
+    }
+    void **grown = realloc(self->scratch, capacity * sizeof(void *));
+    if (grown == NULL) {
+        return -1;
+    }
+    self->scratch = grown;
+    self->scratch_capacity = capacity;
+    return 0;
+}
+
+// Copies every published hazard into the record's scratch array, sorted. Records
+// pushed after hp_record_count was read are walked too, so the array grows during the
+// walk instead of dropping their hazards: a hazard left out could get its block freed.
+static void **hp_collect_hazards(hp_record_t *self, size_t *count)
+{
+    size_t used = 0;
+    if (hp_reserve_scratch(self, __atomic_load_n(&hp_record_count, __ATOMIC_ACQUIRE) * MEM_HP_SLOTS) != 0) {
+        return NULL;
+    }
+
+    for (hp_record_t *record = __atomic_load_n(&hp_records, __ATOMIC_ACQUIRE); record != NULL; record = record->next) {
+        if (used + MEM_HP_SLOTS > self->scratch_capacity &&
+            hp_reserve_scratch(self, 2 * self->scratch_capacity + MEM_HP_SLOTS) != 0) {
+            return NULL;
+        }
+        for (int slot = 0; slot < MEM_HP_SLOTS; slot++) {
+            void *hazard = __atomic_load_n(&record->hazards[slot], __ATOMIC_SEQ_CST);
+            if (hazard != NULL) {
+                self->scratch[used++] = hazard;
+            }
+        }
+    }
+    void **hazards = self->scratch;
+
+    if (used > 1) {
+        qsort(hazards, used, sizeof(void *), hp_compare);
+    }
+    *count = used;
+    return hazards;
+}
+
+// Frees the unprotected blocks of a retire list and compacts the protected ones to its front
+static size_t hp_reclaim(void **blocks, size_t count, void **hazards, size_t hazard_count)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (hazard_count > 0 && bsearch(&blocks[i], hazards, hazard_count, sizeof(void *), hp_compare) != NULL) {
+            blocks[kept++] = blocks[i];
+        } else {
+            mem_free(blocks[i]);
+        }
+    }
+    __atomic_fetch_sub(&hp_unreclaimed, count - kept, __ATOMIC_RELAXED);
+    return kept;
+}
+
+static void hp_scan_record(hp_record_t *record)
+{
+    size_t hazard_count;
+    void **hazards = hp_collect_hazards(record, &hazard_count);
+    if (hazards == NULL) {
+        return;  // Try again on the next retirement
+    }
+
+    record->count = hp_reclaim(record->retired, record->count, hazards, hazard_count);
+
+    if (pthread_mutex_trylock(&hp_orphan_lock) == 0) {
+        hp_orphan_count = hp_reclaim(hp_orphans, hp_orphan_count, hazards, hazard_count);
+        pthread_mutex_unlock(&hp_orphan_lock);
+    }
+}
+
+// Hands the blocks an exiting thread could not free yet to the orphan list
+static void hp_thread_exit(void *arg)
+{
+    hp_record_t *record = (hp_record_t *)arg;
+
+    for (int slot = 0; slot < MEM_HP_SLOTS; slot++) {
+        __atomic_store_n(&record->hazards[slot], NULL, __ATOMIC_RELEASE);
+    }
+    hp_scan_record(record);
+
+    pthread_mutex_lock(&hp_orphan_lock);
+    for (size_t i = 0; i < record->count; i++) {
+        if (hp_orphan_count == hp_orphan_capacity) {
+            size_t capacity = hp_orphan_capacity ? hp_orphan_capacity * 2 : HP_BATCH;
+            void **grown = realloc(hp_orphans, capacity * sizeof(void *));
+            if (grown == NULL) {
+                break;  // Out of memory: the blocks leak rather than being freed early
+            }
+            hp_orphans = grown;
+            hp_orphan_capacity = capacity;
+        }
+        hp_orphans[hp_orphan_count++] = record->retired[i];
+    }
+    pthread_mutex_unlock(&hp_orphan_lock);
+
+    record->count = 0;
+    __atomic_store_n(&record->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void hp_make_key(void)
+{
+    pthread_key_create(&hp_key, hp_thread_exit);
+}
+
+static hp_record_t *hp_record(void)
+{
+    if (hp_self != NULL) {
+        return hp_self;
+    }
+
+    pthread_once(&hp_key_once, hp_make_key);
+
+    // Reuse the record of an exited thread if there is one
+    hp_record_t *record;
+    for (record = __atomic_load_n(&hp_records, __ATOMIC_ACQUIRE); record != NULL; record = record->next) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&record->in_use, &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    if (record == NULL) {
+        record = calloc(1, sizeof(hp_record_t));
+        if (record == NULL) {
+            perror("Hazard pointer record allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        record->in_use = 1;
+        __atomic_fetch_add(&hp_record_count, 1, __ATOMIC_RELEASE);
+        record->next = __atomic_load_n(&hp_records, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&hp_records, &record->next, record, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+    }
+
+    pthread_setspecific(hp_key, record);
+    hp_self = record;
+    return record;
+}
+
+void *mem_hp_protect(int slot, void *const *source)
+{
+    hp_record_t *record = hp_record();
+    void *block = __atomic_load_n(source, __ATOMIC_ACQUIRE);
+
+    for (;;) {
+        __atomic_store_n(&record->hazards[slot], block, __ATOMIC_SEQ_CST);
+        void *again = __atomic_load_n(source, __ATOMIC_SEQ_CST);
+        if (again == block) {
+            return block;  // Still reachable after being published, so not retired before the scan sees it
+        }
+        block = again;
+    }
+}
+
+void mem_hp_clear(int slot)
+{
+    if (hp_self != NULL) {
+        __atomic_store_n(&hp_self->hazards[slot], NULL, __ATOMIC_RELEASE);
+    }
+}
+
+void mem_hp_retire(void *block)
+{
+    if (block == NULL) {
+        return;
+    }
+
+    hp_record_t *record = hp_record();
+    size_t threshold = hp_threshold();
+
+    if (record->count == record->capacity) {
+        size_t capacity = record->capacity > threshold ? record->capacity * 2 : threshold;
+        void **grown = realloc(record->retired, capacity * sizeof(void *));
+        if (grown == NULL) {
+            hp_scan_record(record);  // Make room by reclaiming what we can
+            if (record->count == record->capacity) {
+                perror("Hazard pointer retire list allocation failed");
+                exit(EXIT_FAILURE);
+            }
+        } else {
+            record->retired = grown;
+            record->capacity = capacity;
+        }
+    }
+
+    record->retired[record->count++] = block;
+    __atomic_fetch_add(&hp_unreclaimed, 1, __ATOMIC_RELAXED);
+
+    if (record->count >= threshold) {
+        hp_scan_record(record);
+    }
+}
+
+void mem_hp_scan(void)
+{
+    hp_record_t *record = hp_record();
+    size_t hazard_count;
+    void **hazards = hp_collect_hazards(record, &hazard_count);
+    if (hazards == NULL) {
+        return;
+    }
+
+    record->count = hp_reclaim(record->retired, record->count, hazards, hazard_count);
+    pthread_mutex_lock(&hp_orphan_lock);
+    hp_orphan_count = hp_reclaim(hp_orphans, hp_orphan_count, hazards, hazard_count);
+    pthread_mutex_unlock(&hp_orphan_lock);
+}
+
+size_t mem_hp_unreclaimed(void)
+{
+    return __atomic_load_n(&hp_unreclaimed, __ATOMIC_RELAXED);
+}
+
+size_t mem_hp_bound(void)
+{
+    // Every thread stays below the scan threshold, and exited threads leave at most
+    // one protected block per slot behind
+    size_t threads = __atomic_load_n(&hp_record_count, __ATOMIC_RELAXED);
+    return threads * hp_threshold() + threads * MEM_HP_SLOTS;
+}
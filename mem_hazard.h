@@ -0,0 +1,73 @@
+// mem_hazard.h
+#ifndef MEM_HAZARD_H
+#define MEM_HAZARD_H
+
+#include <stddef.h> // For size_t
+
+// Helps C++ compilers to handle C header files
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * Hazard-pointer reclamation, a bounded-memory alternative to mem_epoch.h.
+     *
+     * Every thread owns MEM_HP_SLOTS hazard slots. A reader publishes each shared
+     * block it is about to dereference in one of its slots; a writer hands unlinked
+     * blocks to mem_hp_retire. Retired blocks are freed with mem_free in batches,
+     * skipping the ones currently published in any slot. Unlike epochs, a stalled
+     * reader only pins the blocks it has published, so the number of unreclaimed
+     * blocks stays below mem_hp_bound().
+     */
+
+#define MEM_HP_SLOTS 4 // Hazard slots per thread
+
+    /**
+     * Reads the pointer stored at *source and protects it in the given slot. The
+     * read is repeated until the published value is still the one in *source, so
+     * the returned block cannot be freed until the slot is cleared or reused.
+     *
+     * @param slot The hazard slot to use, 0 to MEM_HP_SLOTS - 1.
+     * @param source The shared location holding the pointer.
+     * @return The protected pointer (may be NULL).
+     */
+    void *mem_hp_protect(int slot, void *const *source);
+
+    /**
+     * Releases the block protected in the given slot.
+     *
+     * @param slot The hazard slot to clear.
+     */
+    void mem_hp_clear(int slot);
+
+    /**
+     * Defers freeing an unlinked block until no hazard slot refers to it. Once a
+     * thread has retired enough blocks, all slots are scanned and every unprotected
+     * block is released with mem_free.
+     *
+     * @param block A pointer returned by mem_alloc, no longer reachable by new readers.
+     */
+    void mem_hp_retire(void *block);
+
+    /**
+     * Scans the hazard slots now and frees every retired block of the calling
+     * thread, and of exited threads, that is not protected.
+     */
+    void mem_hp_scan(void);
+
+    /**
+     * Returns the number of retired blocks that have not been freed yet.
+     */
+    size_t mem_hp_unreclaimed(void);
+
+    /**
+     * Returns the upper bound on mem_hp_unreclaimed for the threads registered so far.
+     */
+    size_t mem_hp_bound(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MEM_HAZARD_H
@@ -0,0 +1,245 @@
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "memory_manager.h"
+#include "mem_iobuf.h"
+
+// Page-aligned I/O buffers.
+// The buffers are cut from one pool block, starting at its first page boundary. The
+// free ones sit on a stack, so the most recently used, still cached buffer is handed
+// out first. Reference counts are atomic; the lock only guards the stack.
+
+#define IOBUF_MAX_IOV 1024  // Buffers per readv or writev call, IOV_MAX on Linux
+
+struct mem_iobuf_pool
+{
+    char *block;          // The pool block holding the buffers
+    char *base;           // First buffer, page-aligned
+    size_t buf_size;
+    size_t count;
+    pthread_mutex_t lock;
+    size_t free_top;      // Number of buffers on the free stack
+    size_t *free_stack;
+    unsigned int *refs;
+};
+
+mem_iobuf_pool_t *mem_iobuf_pool_create(size_t buf_size, size_t count)
+{
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    if (buf_size == 0 || count == 0 || buf_size > SIZE_MAX / 2) {
+        return NULL;
+    }
+    buf_size = (buf_size + page_size - 1) & ~(page_size - 1);
+    if (count > (SIZE_MAX - page_size) / buf_size) {
+        return NULL;
+    }
+
+    mem_iobuf_pool_t *pool = mem_alloc(sizeof(mem_iobuf_pool_t) + count * (sizeof(size_t) + sizeof(unsigned int)));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->block = mem_alloc(count * buf_size + page_size - 1);
+    if (pool->block == NULL) {
+        mem_free(pool);
+        return NULL;
+    }
+
+    pool->base = (char *)(((uintptr_t)pool->block + page_size - 1) & ~(page_size - 1));
+    pool->buf_size = buf_size;
+    pool->count = count;
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->free_stack = (size_t *)(pool + 1);
+    pool->refs = (unsigned int *)(pool->free_stack + count);
+    for (size_t i = 0; i < count; i++) {
+        pool->free_stack[i] = count - 1 - i;  // The lowest buffer comes out first
+        pool->refs[i] = 0;
+    }
+    pool->free_top = count;
+    return pool;
+}
+
+void mem_iobuf_pool_destroy(mem_iobuf_pool_t *pool)
+{
+    if (pool != NULL) {
+        pthread_mutex_destroy(&pool->lock);
+        mem_free(pool->block);
+        mem_free(pool);
+    }
+}
+
+size_t mem_iobuf_size(const mem_iobuf_pool_t *pool)
+{
+    return pool->buf_size;
+}
+
+size_t mem_iobuf_get_many(mem_iobuf_pool_t *pool, void **bufs, size_t count)
+{
+    size_t taken = 0;
+    pthread_mutex_lock(&pool->lock);
+    for (; taken < count && pool->free_top > 0; taken++) {
+        size_t index = pool->free_stack[--pool->free_top];
+        __atomic_store_n(&pool->refs[index], 1, __ATOMIC_RELAXED);
+        bufs[taken] = pool->base + index * pool->buf_size;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return taken;
+}
+
+void *mem_iobuf_get(mem_iobuf_pool_t *pool)
+{
+    void *buf;
+    return mem_iobuf_get_many(pool, &buf, 1) == 1 ? buf : NULL;
+}
+
+// Returns the index of the buffer holding ptr, or SIZE_MAX if there is none
+static size_t iobuf_index(const mem_iobuf_pool_t *pool, const void *ptr)
+{
+    size_t offset = (uintptr_t)ptr - (uintptr_t)pool->base;
+    if ((uintptr_t)ptr < (uintptr_t)pool->base || offset >= pool->count * pool->buf_size) {
+        return SIZE_MAX;
+    }
+    return offset / pool->buf_size;
+}
+
+int mem_iobuf_ref(mem_iobuf_pool_t *pool, const void *ptr)
+{
+    size_t index = iobuf_index(pool, ptr);
+    if (index == SIZE_MAX || __atomic_load_n(&pool->refs[index], __ATOMIC_RELAXED) == 0) {
+        return -1;
+    }
+    __atomic_fetch_add(&pool->refs[index], 1, __ATOMIC_RELAXED);  // The caller holds a reference already
+    return 0;
+}
+
+int mem_iobuf_put(mem_iobuf_pool_t *pool, const void *ptr)
+{
+    size_t index = iobuf_index(pool, ptr);
+    if (index == SIZE_MAX) {
+        return -1;
+    }
+    unsigned int refs = __atomic_load_n(&pool->refs[index], __ATOMIC_RELAXED);
+    do {
+        if (refs == 0) {
+            return -1;  // Not in use
+        }
+    } while (!__atomic_compare_exchange_n(&pool->refs[index], &refs, refs - 1, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+    if (refs == 1) {
+        pthread_mutex_lock(&pool->lock);
+        pool->free_stack[pool->free_top++] = index;
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return 0;
+}
+
+// Runs readv or writev over all of iov, resuming after short transfers. Stops early
+// at the end of the file, or when a resumed call fails: with O_DIRECT the read that
+// reaches the end of a file is short, and reading on from the unaligned offset it
+// leaves may fail with EINVAL. The bytes already moved are returned then; an error
+// that persists is reported by the next call.
+static ssize_t iobuf_transfer(int fd, struct iovec *iov, size_t count, int write)
+{
+    size_t done = 0;
+    while (count > 0) {
+        int batch = count < IOBUF_MAX_IOV ? (int)count : IOBUF_MAX_IOV;
+        ssize_t moved = write ? writev(fd, iov, batch) : readv(fd, iov, batch);
+        if (moved < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (done > 0) {
+                break;
+            }
+            return -1;
+        }
+        if (moved == 0) {
+            break;  // End of file
+        }
+        done += moved;
+        // Skip the buffers that were completed and advance into the partial one
+        while (count > 0 && (size_t)moved >= iov->iov_len) {
+            moved -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + moved;
+            iov->iov_len -= moved;
+        }
+    }
+    return done;
+}
+
+ssize_t mem_iobuf_readv(mem_iobuf_pool_t *pool, int fd, void *const *bufs, size_t count)
+{
+    ssize_t total = 0;
+    struct iovec iov[IOBUF_MAX_IOV];
+
+    for (size_t first = 0; first < count; first += IOBUF_MAX_IOV) {
+        size_t batch = count - first < IOBUF_MAX_IOV ? count - first : IOBUF_MAX_IOV;
+        for (size_t i = 0; i < batch; i++) {
+            iov[i].iov_base = bufs[first + i];
+            iov[i].iov_len = pool->buf_size;
+        }
+        ssize_t got = iobuf_transfer(fd, iov, batch, 0);
+        if (got < 0) {
+            return -1;
+        }
+        total += got;
+        if ((size_t)got < batch * pool->buf_size) {
+            break;  // End of file
+        }
+    }
+    return total;
+}
+
+ssize_t mem_iobuf_writev(int fd, void *const *bufs, const size_t *lengths, size_t count)
+{
+    ssize_t total = 0;
+    struct iovec iov[IOBUF_MAX_IOV];
+
+    for (size_t first = 0; first < count; first += IOBUF_MAX_IOV) {
+        size_t batch = count - first < IOBUF_MAX_IOV ? count - first : IOBUF_MAX_IOV;
+        size_t wanted = 0;
+        for (size_t i = 0; i < batch; i++) {
+            iov[i].iov_base = bufs[first + i];
+            iov[i].iov_len = lengths[first + i];
+            wanted += lengths[first + i];
+        }
+        ssize_t written = iobuf_transfer(fd, iov, batch, 1);
+        if (written < 0) {
+            return -1;
+        }
+        total += written;
+        if ((size_t)written < wanted) {
+            break;
+        }
+    }
+    return total;
+}
+
+mem_slice_t mem_slice(mem_iobuf_pool_t *pool, const void *data, size_t length)
+{
+    mem_slice_t slice = {NULL, NULL, 0};
+    size_t index = iobuf_index(pool, data);
+    if (index == SIZE_MAX || (uintptr_t)data - (uintptr_t)pool->base + length > (index + 1) * pool->buf_size ||
+        mem_iobuf_ref(pool, data) != 0) {
+        return slice;
+    }
+    slice.pool = pool;
+    slice.data = (char *)data;
+    slice.length = length;
+    return slice;
+}
+
+void mem_slice_release(mem_slice_t *slice)
+{
+    if (slice->data != NULL) {
+        mem_iobuf_put(slice->pool, slice->data);
+    }
+    slice->pool = NULL;
+    slice->data = NULL;
+    slice->length = 0;
+}
@@ -0,0 +1,126 @@
+// mem_iobuf.h
+#ifndef MEM_IOBUF_H
+#define MEM_IOBUF_H
+
+#include <stddef.h>    // For size_t
+#include <sys/types.h> // For ssize_t
+
+// Helps C++ compilers to handle C header files
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * A set of equal, page-aligned I/O buffers carved from one memory pool block.
+     *
+     * Buffer addresses and sizes are multiples of the page size, so they can be used
+     * with files opened with O_DIRECT, and data can be read straight into pool memory
+     * instead of through a bounce buffer. Every buffer has a reference count: slices
+     * of parsed data keep the buffer they point into alive, and it goes back to the
+     * set once the last reference is dropped. All functions are thread-safe.
+     */
+    typedef struct mem_iobuf_pool mem_iobuf_pool_t;
+
+    /**
+     * A piece of a buffer that holds a reference to it, see mem_slice.
+     */
+    typedef struct
+    {
+        mem_iobuf_pool_t *pool;
+        char *data;
+        size_t length;
+    } mem_slice_t;
+
+    /**
+     * Creates a set of buffers from the memory pool.
+     *
+     * @param buf_size The size of each buffer, rounded up to whole pages.
+     * @param count The number of buffers.
+     * @return The set, or NULL if the pool has no room for it.
+     */
+    mem_iobuf_pool_t *mem_iobuf_pool_create(size_t buf_size, size_t count);
+
+    /**
+     * Returns the buffers to the memory pool, whether or not they are still referenced.
+     */
+    void mem_iobuf_pool_destroy(mem_iobuf_pool_t *pool);
+
+    /**
+     * Returns the size of the buffers of a set.
+     */
+    size_t mem_iobuf_size(const mem_iobuf_pool_t *pool);
+
+    /**
+     * Takes a free buffer, with a reference count of one.
+     *
+     * @return The buffer, or NULL if all of them are in use.
+     */
+    void *mem_iobuf_get(mem_iobuf_pool_t *pool);
+
+    /**
+     * Takes up to count free buffers at once.
+     *
+     * @param bufs Receives the buffers.
+     * @return The number of buffers taken.
+     */
+    size_t mem_iobuf_get_many(mem_iobuf_pool_t *pool, void **bufs, size_t count);
+
+    /**
+     * Adds a reference to the buffer that holds ptr.
+     *
+     * @param ptr Any address inside a buffer in use.
+     * @return 0 on success, or -1 if ptr is not inside a buffer in use.
+     */
+    int mem_iobuf_ref(mem_iobuf_pool_t *pool, const void *ptr);
+
+    /**
+     * Drops a reference to the buffer that holds ptr; the buffer is free again once
+     * none is left.
+     *
+     * @param ptr Any address inside a buffer in use.
+     * @return 0 on success, or -1 if ptr is not inside a buffer in use.
+     */
+    int mem_iobuf_put(mem_iobuf_pool_t *pool, const void *ptr);
+
+    /**
+     * Reads from fd into whole buffers with readv, in order, until they are full or
+     * the end of the file is reached. Short reads are retried; if a retry fails, as
+     * it may at the end of a file opened with O_DIRECT, the bytes read so far are
+     * returned.
+     *
+     * @param bufs Buffers of the set, as returned by mem_iobuf_get.
+     * @param count The number of buffers.
+     * @return The number of bytes read, or -1 on error with errno set.
+     */
+    ssize_t mem_iobuf_readv(mem_iobuf_pool_t *pool, int fd, void *const *bufs, size_t count);
+
+    /**
+     * Writes the first lengths[i] bytes of each buffer to fd with writev, in order.
+     * Short writes are retried; if a retry fails, the bytes written so far are
+     * returned.
+     *
+     * @return The number of bytes written, or -1 on error with errno set.
+     */
+    ssize_t mem_iobuf_writev(int fd, void *const *bufs, const size_t *lengths, size_t count);
+
+    /**
+     * Makes a slice of a buffer, adding a reference to it so the data stays valid
+     * after the buffer itself is put back.
+     *
+     * @param data The start of the slice, inside a buffer in use.
+     * @param length The length of the slice, which must not run past the buffer.
+     * @return The slice, or one with NULL data if the arguments are not valid.
+     */
+    mem_slice_t mem_slice(mem_iobuf_pool_t *pool, const void *data, size_t length);
+
+    /**
+     * Drops the reference held by a slice and clears it.
+     */
+    void mem_slice_release(mem_slice_t *slice);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MEM_IOBUF_H
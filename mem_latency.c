@@ -0,0 +1,363 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "memory_manager.h"
+#include "memory_manager_internal.h"
+
+// Allocation latency histograms, built in with -DMEM_LATENCY_HIST.
+// Every thread owns one histogram per operation and size class, allocated with malloc
+// the first time it is needed, and increments it without atomics. Readers sum the
+// histograms of every live thread and of the threads that have exited, which fold
+// theirs into a shared set. Values below 16 ticks get a bucket each; above, every
+// power of two is split into 16 buckets, as in HdrHistogram with 4 bits of precision.
+// A reset only bumps latency_epoch: each owner clears its own histograms the next time
+// it records, and until then readers skip them, so no count from before a reset
+// survives it and none recorded after it is lost.
+
+#ifdef MEM_LATENCY_HIST
+
+#define LATENCY_SUB_BITS 4
+#define LATENCY_SUB (1 << LATENCY_SUB_BITS)
+#define LATENCY_MAX_LG 40  // About 5 minutes of 3 GHz ticks; longer ones land in the last bucket
+#define LATENCY_BUCKETS (LATENCY_SUB + (LATENCY_MAX_LG - LATENCY_SUB_BITS + 1) * LATENCY_SUB)
+
+typedef struct
+{
+    uint64_t buckets[LATENCY_BUCKETS];
+    uint64_t max;
+} latency_hist_t;
+
+typedef struct latency_thread
+{
+    struct latency_thread *next;
+    struct latency_thread *prev;
+    uint64_t epoch;  // Reset the histograms belong to, stored by the owner once they are cleared
+    latency_hist_t *hists[MEM_LATENCY_OPS][MEM_LATENCY_CLASSES];  // NULL until used
+} latency_thread_t;
+
+static pthread_mutex_t latency_lock = PTHREAD_MUTEX_INITIALIZER;  // Guards the thread list and latency_retired
+static uint64_t latency_epoch;  // Number of resets, only bumped under latency_lock
+static latency_thread_t *latency_threads;
+static latency_thread_t latency_retired;  // Histograms of the threads that have exited
+static pthread_key_t latency_key;
+static pthread_once_t latency_once = PTHREAD_ONCE_INIT;
+static __thread latency_thread_t *latency_self;
+
+// Tick rate, measured once at load time
+static double latency_tick_ns = 1.0;
+
+__attribute__((constructor)) static void latency_calibrate(void)
+{
+#if defined(__x86_64__)
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t start_ticks = mem_latency_now();
+    uint64_t ticks;
+    double ns;
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        ticks = mem_latency_now();
+        ns = (now.tv_sec - start.tv_sec) * 1e9 + (now.tv_nsec - start.tv_nsec);
+    } while (ns < 1e6);  // 1 ms keeps the rate within a few parts in 10^5
+    latency_tick_ns = ns / (double)(ticks - start_ticks);
+#endif
+}
+
+static size_t latency_bucket(uint64_t ticks)
+{
+    if (ticks < LATENCY_SUB) {
+        return ticks;
+    }
+    int lg = 63 - __builtin_clzll(ticks);
+    if (lg > LATENCY_MAX_LG) {
+        return LATENCY_BUCKETS - 1;
+    }
+    return LATENCY_SUB + (size_t)(lg - LATENCY_SUB_BITS) * LATENCY_SUB + ((ticks >> (lg - LATENCY_SUB_BITS)) - LATENCY_SUB);
+}
+
+// Largest value that falls into a bucket
+static uint64_t latency_bucket_top(size_t bucket)
+{
+    if (bucket < LATENCY_SUB) {
+        return bucket;
+    }
+    int shift = (int)((bucket - LATENCY_SUB) / LATENCY_SUB);
+    uint64_t sub = LATENCY_SUB + (bucket - LATENCY_SUB) % LATENCY_SUB;
+    return ((sub + 1) << shift) - 1;
+}
+
+static void latency_merge(latency_thread_t *into, latency_thread_t *from)
+{
+    for (int op = 0; op < MEM_LATENCY_OPS; op++) {
+        for (int c = 0; c < MEM_LATENCY_CLASSES; c++) {
+            latency_hist_t *hist = from->hists[op][c];
+            if (hist == NULL) {
+                continue;
+            }
+            if (into->hists[op][c] == NULL) {
+                into->hists[op][c] = hist;  // Hand it over as is
+                continue;
+            }
+            for (size_t b = 0; b < LATENCY_BUCKETS; b++) {
+                into->hists[op][c]->buckets[b] += hist->buckets[b];
+            }
+            if (hist->max > into->hists[op][c]->max) {
+                into->hists[op][c]->max = hist->max;
+            }
+            free(hist);
+        }
+    }
+}
+
+static void latency_free(latency_thread_t *thread)
+{
+    for (int op = 0; op < MEM_LATENCY_OPS; op++) {
+        for (int c = 0; c < MEM_LATENCY_CLASSES; c++) {
+            free(thread->hists[op][c]);
+            thread->hists[op][c] = NULL;
+        }
+    }
+}
+
+static void latency_thread_exit(void *arg)
+{
+    latency_thread_t *self = arg;
+    pthread_mutex_lock(&latency_lock);
+    if (self->prev != NULL) {
+        self->prev->next = self->next;
+    } else {
+        latency_threads = self->next;
+    }
+    if (self->next != NULL) {
+        self->next->prev = self->prev;
+    }
+    if (self->epoch == latency_epoch) {
+        latency_merge(&latency_retired, self);
+    } else {
+        latency_free(self);  // Recorded before the last reset
+    }
+    pthread_mutex_unlock(&latency_lock);
+    free(self);
+}
+
+static void latency_key_create(void)
+{
+    pthread_key_create(&latency_key, latency_thread_exit);
+}
+
+static __attribute__((noinline)) latency_hist_t *latency_hist_create(int op, size_t size_class)
+{
+    if (latency_self == NULL) {
+        latency_thread_t *self = calloc(1, sizeof(latency_thread_t));
+        if (self == NULL) {
+            return NULL;
+        }
+        pthread_once(&latency_once, latency_key_create);
+        pthread_setspecific(latency_key, self);
+        pthread_mutex_lock(&latency_lock);
+        self->epoch = latency_epoch;
+        self->next = latency_threads;
+        if (latency_threads != NULL) {
+            latency_threads->prev = self;
+        }
+        latency_threads = self;
+        pthread_mutex_unlock(&latency_lock);
+        latency_self = self;
+    }
+    latency_hist_t *hist = calloc(1, sizeof(latency_hist_t));
+    if (hist != NULL) {
+        pthread_mutex_lock(&latency_lock);  // Readers walk the table
+        latency_self->hists[op][size_class] = hist;
+        pthread_mutex_unlock(&latency_lock);
+    }
+    return hist;
+}
+
+// Clears the histograms of this thread after a reset, then lets readers see them again
+static __attribute__((noinline)) void latency_thread_restart(latency_thread_t *self)
+{
+    uint64_t epoch = __atomic_load_n(&latency_epoch, __ATOMIC_ACQUIRE);
+    for (int op = 0; op < MEM_LATENCY_OPS; op++) {
+        for (int c = 0; c < MEM_LATENCY_CLASSES; c++) {
+            if (self->hists[op][c] != NULL) {
+                memset(self->hists[op][c], 0, sizeof(latency_hist_t));
+            }
+        }
+    }
+    __atomic_store_n(&self->epoch, epoch, __ATOMIC_RELEASE);
+}
+
+void mem_latency_record(int op, size_t size, uint64_t ticks)
+{
+    size_t size_class = size <= SIZE_MAX / 2 ? mem_size_class_inline(size) : MEM_LATENCY_CLASSES - 1;
+    if (size_class >= MEM_LATENCY_CLASSES) {
+        size_class = MEM_LATENCY_CLASSES - 1;
+    }
+    latency_thread_t *self = latency_self;
+    if (self != NULL && __builtin_expect(self->epoch != __atomic_load_n(&latency_epoch, __ATOMIC_RELAXED), 0)) {
+        latency_thread_restart(self);
+    }
+    latency_hist_t *hist = self != NULL ? self->hists[op][size_class] : NULL;
+    if (__builtin_expect(hist == NULL, 0)) {
+        hist = latency_hist_create(op, size_class);
+        if (hist == NULL) {
+            return;
+        }
+    }
+    // Only this thread writes; the stores are atomic so readers never see torn counts
+    size_t bucket = latency_bucket(ticks);
+    __atomic_store_n(&hist->buckets[bucket], hist->buckets[bucket] + 1, __ATOMIC_RELAXED);
+    if (ticks > hist->max) {
+        __atomic_store_n(&hist->max, ticks, __ATOMIC_RELAXED);
+    }
+}
+
+// Adds the histograms of op and size classes [first, last] of one thread to sum
+static void latency_add(latency_hist_t *sum, latency_thread_t *thread, int op, size_t first, size_t last)
+{
+    for (size_t c = first; c <= last; c++) {
+        latency_hist_t *hist = thread->hists[op][c];
+        if (hist == NULL) {
+            continue;
+        }
+        for (size_t b = 0; b < LATENCY_BUCKETS; b++) {
+            sum->buckets[b] += __atomic_load_n(&hist->buckets[b], __ATOMIC_RELAXED);
+        }
+        uint64_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+        if (max > sum->max) {
+            sum->max = max;
+        }
+    }
+}
+
+static void latency_percentiles(const latency_hist_t *sum, double ns_per_tick, mem_latency_stats_t *stats)
+{
+    static const double quantiles[3] = {0.5, 0.99, 0.999};
+    uint64_t *results[3] = {&stats->p50, &stats->p99, &stats->p999};
+    memset(stats, 0, sizeof(*stats));
+    for (size_t b = 0; b < LATENCY_BUCKETS; b++) {
+        stats->count += sum->buckets[b];
+    }
+    if (stats->count == 0) {
+        return;
+    }
+
+    uint64_t seen = 0;
+    int q = 0;
+    for (size_t b = 0; b < LATENCY_BUCKETS && q < 3; b++) {
+        seen += sum->buckets[b];
+        while (q < 3 && seen >= (uint64_t)(quantiles[q] * stats->count + 0.5)) {
+            uint64_t top = latency_bucket_top(b);
+            *results[q++] = (uint64_t)((top < sum->max ? top : sum->max) * ns_per_tick + 0.5);
+        }
+    }
+    stats->max = (uint64_t)(sum->max * ns_per_tick + 0.5);
+}
+
+// Sums op over size classes [first, last] of every thread, under latency_lock
+static void latency_sum(latency_hist_t *sum, int op, size_t first, size_t last)
+{
+    memset(sum, 0, sizeof(*sum));
+    for (latency_thread_t *thread = latency_threads; thread != NULL; thread = thread->next) {
+        // Histograms not yet cleared since the last reset count as empty
+        if (__atomic_load_n(&thread->epoch, __ATOMIC_ACQUIRE) == latency_epoch) {
+            latency_add(sum, thread, op, first, last);
+        }
+    }
+    latency_add(sum, &latency_retired, op, first, last);
+}
+
+int mem_latency_enabled(void)
+{
+    return 1;
+}
+
+int mem_latency_stats(int op, size_t size_class, mem_latency_stats_t *stats)
+{
+    if (op < 0 || op >= MEM_LATENCY_OPS) {
+        return -1;
+    }
+    size_t first = size_class == MEM_LATENCY_ALL_CLASSES ? 0 : size_class < MEM_LATENCY_CLASSES ? size_class : MEM_LATENCY_CLASSES - 1;
+    size_t last = size_class == MEM_LATENCY_ALL_CLASSES ? MEM_LATENCY_CLASSES - 1 : first;
+    latency_hist_t sum;
+
+    pthread_mutex_lock(&latency_lock);
+    latency_sum(&sum, op, first, last);
+    pthread_mutex_unlock(&latency_lock);
+    latency_percentiles(&sum, latency_tick_ns, stats);
+    return 0;
+}
+
+void mem_latency_reset(void)
+{
+    // Live threads clear their own histograms, see latency_thread_restart
+    pthread_mutex_lock(&latency_lock);
+    __atomic_store_n(&latency_epoch, latency_epoch + 1, __ATOMIC_RELEASE);
+    latency_free(&latency_retired);
+    pthread_mutex_unlock(&latency_lock);
+}
+
+int mem_latency_dump(int fd)
+{
+    static const char *names[MEM_LATENCY_OPS] = {"mem_alloc", "mem_free", "mem_resize"};
+    latency_hist_t sum;
+    mem_latency_stats_t stats;
+    char line[256];
+    int len = snprintf(line, sizeof(line), "%-10s %10s %12s %10s %10s %10s %12s\n", "op", "class size", "count", "p50 ns",
+                       "p99 ns", "p99.9 ns", "max ns");
+    if (write(fd, line, len) != len) {
+        return -1;
+    }
+
+    int result = 0;
+    pthread_mutex_lock(&latency_lock);
+    for (int op = 0; op < MEM_LATENCY_OPS && result == 0; op++) {
+        for (size_t c = 0; c < MEM_LATENCY_CLASSES && result == 0; c++) {
+            latency_sum(&sum, op, c, c);
+            latency_percentiles(&sum, latency_tick_ns, &stats);
+            if (stats.count == 0) {
+                continue;
+            }
+            len = snprintf(line, sizeof(line), "%-10s %9zu%s %12llu %10llu %10llu %10llu %12llu\n", names[op],
+                           mem_size_class_size(c), c == MEM_LATENCY_CLASSES - 1 ? "+" : " ",
+                           (unsigned long long)stats.count, (unsigned long long)stats.p50, (unsigned long long)stats.p99,
+                           (unsigned long long)stats.p999, (unsigned long long)stats.max);
+            if (write(fd, line, len) != len) {
+                result = -1;
+            }
+        }
+    }
+    pthread_mutex_unlock(&latency_lock);
+    return result;
+}
+
+#else
+
+int mem_latency_enabled(void)
+{
+    return 0;
+}
+
+int mem_latency_stats(int op, size_t size_class, mem_latency_stats_t *stats)
+{
+    (void)op;
+    (void)size_class;
+    memset(stats, 0, sizeof(*stats));
+    return -1;
+}
+
+void mem_latency_reset(void)
+{
+}
+
+int mem_latency_dump(int fd)
+{
+    (void)fd;
+    return -1;
+}
+
+#endif // MEM_LATENCY_HIST
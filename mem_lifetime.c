@@ -0,0 +1,77 @@
+#include <stdint.h>
+#include "memory_manager.h"
+#include "memory_manager_internal.h"
+
+// Lifetime learning for MEM_HINT_AUTO.
+// Every call site gets a slot in a fixed hash table. Its blocks carry the slot number
+// and the value of a clock that counts hinted allocations in a trailer word, so
+// mem_free can tell how many allocations each block outlived. A site is predicted
+// short-lived once most of its blocks have been freed young; all others are long-lived.
+// The pool lock serializes every call.
+
+#define LIFETIME_SITES 1024        // Power of two
+#define LIFETIME_PROBES 16         // Slots tried before a site is left untracked
+#define LIFETIME_LEARN 32          // Allocations before a site's prediction is trusted
+#define LIFETIME_SHORT 4096        // Mean lifetime below which a site is short-lived
+#define LIFETIME_WINDOW (1u << 16) // Counts are halved at this point so old behaviour fades
+
+typedef struct
+{
+    void *caller;
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t mean;  // Moving average of the lifetime of freed blocks
+} lifetime_site_t;
+
+static lifetime_site_t lifetime_sites[LIFETIME_SITES];
+static uint32_t lifetime_clock;
+
+static lifetime_site_t *lifetime_find(void *caller, size_t *index)
+{
+    size_t slot = ((uintptr_t)caller >> 2) * 0x9E3779B97F4A7C15ull >> 54;
+    for (int probe = 0; probe < LIFETIME_PROBES; probe++, slot = (slot + 1) & (LIFETIME_SITES - 1)) {
+        lifetime_site_t *site = &lifetime_sites[slot];
+        if (site->caller == NULL) {
+            site->caller = caller;
+        }
+        if (site->caller == caller) {
+            *index = slot;
+            return site;
+        }
+    }
+    return NULL;
+}
+
+size_t mem_lifetime_on_alloc(void *caller, int *hint)
+{
+    size_t index;
+    lifetime_site_t *site = lifetime_find(caller, &index);
+    *hint = MEM_HINT_LONG;
+    if (site == NULL) {
+        return 0;
+    }
+
+    if (++site->allocs == LIFETIME_WINDOW) {
+        site->allocs /= 2;
+        site->frees /= 2;
+    }
+    if (site->allocs >= LIFETIME_LEARN && site->frees * 2 >= site->allocs && site->mean < LIFETIME_SHORT) {
+        *hint = MEM_HINT_SHORT;
+    }
+    return (index + 1) << 32 | lifetime_clock++;
+}
+
+void mem_lifetime_on_free(size_t trailer)
+{
+    size_t index = (trailer >> 32) - 1;
+    if (index >= LIFETIME_SITES) {
+        return;  // Not a trailer written by this process, e.g. in a reopened file pool
+    }
+
+    lifetime_site_t *site = &lifetime_sites[index];
+    uint32_t lifetime = lifetime_clock - (uint32_t)trailer;
+    site->mean = site->mean - site->mean / 8 + lifetime / 8;
+    if (site->frees < site->allocs) {
+        site->frees++;
+    }
+}
@@ -0,0 +1,119 @@
+#include <sched.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include "mem_locks.h"
+
+// Spinning waits yield the CPU every LOCK_YIELD_SPINS iterations, so a preempted
+// lock holder gets to run when there are more threads than CPUs.
+#define LOCK_YIELD_SPINS 128
+#define FUTEX_MAX_SPINS 200
+
+static inline void lock_relax(unsigned int *spins)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+    if (++*spins % LOCK_YIELD_SPINS == 0) {
+        sched_yield();
+    }
+}
+
+void mem_ticket_lock(mem_ticket_lock_t *lock)
+{
+    uint32_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+    unsigned int spins = 0;
+    while (__atomic_load_n(&lock->serving, __ATOMIC_ACQUIRE) != ticket) {
+        lock_relax(&spins);
+    }
+}
+
+void mem_ticket_unlock(mem_ticket_lock_t *lock)
+{
+    __atomic_store_n(&lock->serving, lock->serving + 1, __ATOMIC_RELEASE);
+}
+
+void mem_mcs_lock(mem_mcs_lock_t *lock, mem_mcs_node_t *node)
+{
+    node->next = NULL;
+    node->locked = 1;
+    mem_mcs_node_t *prev = __atomic_exchange_n(&lock->tail, node, __ATOMIC_ACQ_REL);
+    if (prev == NULL) {
+        return;  // The queue was empty
+    }
+
+    __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+    unsigned int spins = 0;
+    while (__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE)) {
+        lock_relax(&spins);
+    }
+}
+
+void mem_mcs_unlock(mem_mcs_lock_t *lock, mem_mcs_node_t *node)
+{
+    mem_mcs_node_t *next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+    if (next == NULL) {
+        mem_mcs_node_t *expected = node;
+        if (__atomic_compare_exchange_n(&lock->tail, &expected, NULL, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            return;  // Nobody is waiting
+        }
+        // A waiter swapped itself in but has not linked to us yet
+        unsigned int spins = 0;
+        while ((next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)) == NULL) {
+            lock_relax(&spins);
+        }
+    }
+    __atomic_store_n(&next->locked, 0, __ATOMIC_RELEASE);
+}
+
+static int futex_spin_limit(void)
+{
+    static int limit = -1;
+    if (limit < 0) {
+        // Spinning cannot help when the holder needs this very CPU to make progress
+        limit = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? FUTEX_MAX_SPINS : 0;
+    }
+    return limit;
+}
+
+void mem_futex_lock(mem_futex_lock_t *lock)
+{
+    int expected = 0;
+    if (__atomic_compare_exchange_n(&lock->state, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    // Spin for about twice as long as recent acquisitions needed, as glibc's adaptive mutex does
+    int average = __atomic_load_n(&lock->spins, __ATOMIC_RELAXED);
+    int budget = average * 2 + 10;
+    int limit = futex_spin_limit();
+    if (budget > limit) {
+        budget = limit;
+    }
+    for (int spin = 0; spin < budget; spin++) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+        expected = 0;
+        if (__atomic_load_n(&lock->state, __ATOMIC_RELAXED) == 0 &&
+            __atomic_compare_exchange_n(&lock->state, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&lock->spins, average + (spin - average) / 8, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+    if (budget > 0) {
+        __atomic_store_n(&lock->spins, average + (budget - average) / 8, __ATOMIC_RELAXED);
+    }
+
+    // Sleep until woken; 2 tells the holder that someone needs a wakeup
+    while (__atomic_exchange_n(&lock->state, 2, __ATOMIC_ACQUIRE) != 0) {
+        syscall(SYS_futex, &lock->state, FUTEX_WAIT_PRIVATE, 2, NULL, NULL, 0);
+    }
+}
+
+void mem_futex_unlock(mem_futex_lock_t *lock)
+{
+    if (__atomic_exchange_n(&lock->state, 0, __ATOMIC_RELEASE) == 2) {
+        syscall(SYS_futex, &lock->state, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
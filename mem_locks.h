@@ -0,0 +1,47 @@
+// mem_locks.h
+#ifndef MEM_LOCKS_H
+#define MEM_LOCKS_H
+
+// Lock implementations for the pool's critical section; not part of the public API.
+// mem_lock_select in memory_manager.h picks one of them for the next pool.
+
+#include <stdint.h>
+
+// FIFO spinlock: threads take a ticket and wait for it to be served
+typedef struct
+{
+    uint32_t next;
+    uint32_t serving;
+} mem_ticket_lock_t;
+
+// MCS queue lock: every waiter spins on its own node, so handing the lock over
+// touches only the next waiter's cache line
+typedef struct mem_mcs_node
+{
+    struct mem_mcs_node *next;
+    int locked;
+} mem_mcs_node_t;
+
+typedef struct
+{
+    mem_mcs_node_t *tail;
+} mem_mcs_lock_t;
+
+// Spin-then-futex lock. state is 0 when free, 1 when held, 2 when held with sleepers.
+// The spin budget follows the number of spins recent acquisitions needed.
+typedef struct
+{
+    int state;
+    int spins;
+} mem_futex_lock_t;
+
+void mem_ticket_lock(mem_ticket_lock_t *lock);
+void mem_ticket_unlock(mem_ticket_lock_t *lock);
+
+void mem_mcs_lock(mem_mcs_lock_t *lock, mem_mcs_node_t *node);
+void mem_mcs_unlock(mem_mcs_lock_t *lock, mem_mcs_node_t *node);
+
+void mem_futex_lock(mem_futex_lock_t *lock);
+void mem_futex_unlock(mem_futex_lock_t *lock);
+
+#endif // MEM_LOCKS_H
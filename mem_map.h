@@ -0,0 +1,30 @@
+// mem_map.h
+#ifndef MEM_MAP_H
+#define MEM_MAP_H
+
+// Binary pool layout written by mem_dump_map and read by mem_map_tool.
+// A header is followed by block_count records in address order. All fields are
+// in host byte order, the snapshot is meant to be read on the same machine.
+
+#include <stdint.h>
+
+#define MEM_MAP_MAGIC 0x50414d4du  // "MMAP"
+#define MEM_MAP_VERSION 1u
+#define MEM_MAP_USED (UINT64_C(1) << 63)  // Set in mem_map_record_t.size for allocated blocks
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t pool_size;
+    uint64_t header_size;  // Per-block metadata bytes in front of each payload
+    uint64_t block_count;
+} mem_map_header_t;
+
+typedef struct
+{
+    uint64_t offset;  // Offset of the block (its metadata) from the start of the pool
+    uint64_t size;    // Payload size, with MEM_MAP_USED set if allocated
+} mem_map_record_t;
+
+#endif // MEM_MAP_H
@@ -0,0 +1,177 @@
+// mem_map_tool.c
+// Renders a pool layout written by mem_dump_map: a heat map of free space across
+// the pool and a histogram of free block sizes.
+//
+// Usage: mem_map_tool <map file> [columns] [rows]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "mem_map.h"
+
+#define HISTOGRAM_BUCKETS 64
+
+// Shades from fully used to fully free
+static const char heat_shades[] = "@%#*+=-:. ";
+
+static void add_span(double *cell_free, uint64_t cell_bytes, size_t cells, uint64_t start, uint64_t end)
+{
+    while (start < end) {
+        size_t cell = start / cell_bytes;
+        if (cell >= cells) {
+            break;
+        }
+        uint64_t cell_end = (cell + 1) * cell_bytes;
+        uint64_t stop = end < cell_end ? end : cell_end;
+        cell_free[cell] += (double)(stop - start);
+        start = stop;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        printf("Usage: %s <map file> [columns] [rows]\n", argv[0]);
+        return 1;
+    }
+
+    size_t columns = argc > 2 ? (size_t)atoi(argv[2]) : 64;
+    size_t rows = argc > 3 ? (size_t)atoi(argv[3]) : 16;
+    if (columns == 0 || rows == 0) {
+        fprintf(stderr, "columns and rows must be positive\n");
+        return 1;
+    }
+    if (columns > SIZE_MAX / sizeof(double) / rows) {
+        fprintf(stderr, "Too many cells for the heat map\n");
+        return 1;
+    }
+
+    FILE *fp = fopen(argv[1], "rb");
+    if (fp == NULL) {
+        perror("Failed to open map file");
+        return 1;
+    }
+
+    mem_map_header_t header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 || header.magic != MEM_MAP_MAGIC || header.version != MEM_MAP_VERSION) {
+        fprintf(stderr, "%s is not a memory map snapshot\n", argv[1]);
+        fclose(fp);
+        return 1;
+    }
+
+    // The block count comes from the file, so it must not promise more records than it holds
+    long records_start = ftell(fp);
+    long file_size = -1;
+    if (records_start >= 0 && fseek(fp, 0, SEEK_END) == 0) {
+        file_size = ftell(fp);
+    }
+    if (file_size < records_start || fseek(fp, records_start, SEEK_SET) != 0 ||
+        header.block_count > (uint64_t)(file_size - records_start) / sizeof(mem_map_record_t)) {
+        fprintf(stderr, "Truncated map file\n");
+        fclose(fp);
+        return 1;
+    }
+
+    mem_map_record_t *records = malloc(header.block_count * sizeof(mem_map_record_t));
+    if (records == NULL || fread(records, sizeof(mem_map_record_t), header.block_count, fp) != header.block_count) {
+        fprintf(stderr, "Truncated map file\n");
+        free(records);
+        fclose(fp);
+        return 1;
+    }
+    fclose(fp);
+
+    size_t cells = columns * rows;
+    uint64_t cell_bytes = (header.pool_size + cells - 1) / cells;
+    if (cell_bytes == 0) {
+        cell_bytes = 1;
+    }
+    double *cell_free = calloc(cells, sizeof(double));
+    if (cell_free == NULL) {
+        fprintf(stderr, "Failed to allocate the heat map\n");
+        free(records);
+        return 1;
+    }
+    uint64_t histogram_count[HISTOGRAM_BUCKETS] = {0};
+    uint64_t histogram_bytes[HISTOGRAM_BUCKETS] = {0};
+    uint64_t used_bytes = 0, free_bytes = 0, largest_free = 0, used_blocks = 0, free_blocks = 0;
+
+    for (uint64_t i = 0; i < header.block_count; i++) {
+        uint64_t size = records[i].size & ~MEM_MAP_USED;
+        if (records[i].size & MEM_MAP_USED) {
+            used_bytes += size;
+            used_blocks++;
+            continue;
+        }
+
+        uint64_t payload = records[i].offset + header.header_size;
+        add_span(cell_free, cell_bytes, cells, payload, payload + size);
+        free_bytes += size;
+        free_blocks++;
+        if (size > largest_free) {
+            largest_free = size;
+        }
+
+        int bucket = 0;
+        while (bucket < HISTOGRAM_BUCKETS - 1 && (UINT64_C(1) << (bucket + 1)) <= size) {
+            bucket++;
+        }
+        histogram_count[bucket]++;
+        histogram_bytes[bucket] += size;
+    }
+
+    printf("Pool: %llu bytes, %llu used in %llu blocks, %llu free in %llu blocks, %llu in headers\n",
+           (unsigned long long)header.pool_size, (unsigned long long)used_bytes, (unsigned long long)used_blocks,
+           (unsigned long long)free_bytes, (unsigned long long)free_blocks,
+           (unsigned long long)(header.block_count * header.header_size));
+    printf("Largest free block: %llu bytes, fragmentation: %.1f%%\n", (unsigned long long)largest_free,
+           free_bytes > 0 ? 100.0 * (1.0 - (double)largest_free / free_bytes) : 0.0);
+
+    printf("\nFree space heat map (%llu bytes per cell, '%c' = used, '%c' = free):\n",
+           (unsigned long long)cell_bytes, heat_shades[0], heat_shades[sizeof(heat_shades) - 2]);
+    for (size_t row = 0; row < rows; row++) {
+        printf("  |");
+        for (size_t column = 0; column < columns; column++) {
+            size_t cell = row * columns + column;
+            uint64_t start = cell * cell_bytes;
+            if (start >= header.pool_size) {
+                putchar(' ');
+                continue;
+            }
+            uint64_t span = header.pool_size - start < cell_bytes ? header.pool_size - start : cell_bytes;
+            double fraction = cell_free[cell] / span;
+            int shade = (int)(fraction * (sizeof(heat_shades) - 2) + 0.5);
+            if (shade > (int)sizeof(heat_shades) - 2) {
+                shade = sizeof(heat_shades) - 2;  // Overlapping records in a corrupt map
+            }
+            putchar(heat_shades[shade]);
+        }
+        printf("|\n");
+    }
+
+    printf("\nFree block sizes:\n");
+    uint64_t most = 0;
+    for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+        if (histogram_count[bucket] > most) {
+            most = histogram_count[bucket];
+        }
+    }
+    for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+        if (histogram_count[bucket] == 0) {
+            continue;
+        }
+        int bar = (int)(40 * histogram_count[bucket] / most);
+        printf("  %10llu - %-10llu %8llu blocks %12llu bytes ",
+               (unsigned long long)(UINT64_C(1) << bucket), (unsigned long long)((UINT64_C(1) << (bucket + 1)) - 1),
+               (unsigned long long)histogram_count[bucket], (unsigned long long)histogram_bytes[bucket]);
+        for (int i = 0; i < (bar > 0 ? bar : 1); i++) {
+            putchar('#');
+        }
+        putchar('\n');
+    }
+
+    free(cell_free);
+    free(records);
+    return 0;
+}
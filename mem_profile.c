@@ -0,0 +1,296 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include "memory_manager.h"
+#include "memory_manager_internal.h"
+
+// Sampling heap profiler.
+// Allocations are sampled per byte: every thread counts down a distance drawn from an
+// exponential distribution with the configured mean, so a block of size s is sampled
+// with probability 1 - exp(-s / interval). Each sample is weighted by the inverse of that
+// probability, which makes the per-site totals unbiased estimates of the real ones.
+
+#define PROF_MAX_FRAMES 32
+#define PROF_SITE_BUCKETS 1024
+#define PROF_LIVE_BUCKETS 4096
+
+typedef struct prof_site
+{
+    struct prof_site *next;  // Next site in the same hash bucket
+    uint64_t hash;
+    int depth;
+    void *frames[PROF_MAX_FRAMES];
+    double alloc_count;  // Estimated allocations since mem_prof_start
+    double alloc_bytes;
+    double live_count;   // Estimated allocations not freed yet
+    double live_bytes;
+} prof_site_t;
+
+typedef struct prof_object
+{
+    struct prof_object *next;  // Next object in the same hash bucket
+    void *block;
+    prof_site_t *site;
+    double count;  // Weight of this sample
+    double bytes;
+} prof_object_t;
+
+static pthread_mutex_t prof_lock = PTHREAD_MUTEX_INITIALIZER;
+static prof_site_t *prof_sites[PROF_SITE_BUCKETS];
+static prof_object_t *prof_live[PROF_LIVE_BUCKETS];
+static prof_object_t *prof_spare;     // Recycled live-table entries
+static double prof_interval;          // Mean number of bytes between samples
+static unsigned int prof_generation;  // Bumped by every mem_prof_start
+
+static __thread double prof_bytes_left;  // Bytes to allocate before the next sample
+static __thread unsigned int prof_thread_generation;
+static __thread unsigned int prof_seed;
+
+static double prof_next_distance(void)
+{
+    if (prof_seed == 0) {
+        prof_seed = (unsigned int)time(NULL) ^ (unsigned int)(uintptr_t)&prof_seed;
+    }
+    double u = (rand_r(&prof_seed) + 1.0) / ((double)RAND_MAX + 2.0);  // In (0, 1)
+    return -log(u) * prof_interval;
+}
+
+static size_t prof_live_bucket(const void *block)
+{
+    return ((uintptr_t)block >> 4) * 0x9E3779B97F4A7C15ull >> 52 & (PROF_LIVE_BUCKETS - 1);
+}
+
+static prof_site_t *prof_find_site(void **frames, int depth)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;  // FNV-1a over the return addresses
+    for (int i = 0; i < depth; i++) {
+        hash = (hash ^ (uintptr_t)frames[i]) * 0x100000001b3ull;
+    }
+
+    prof_site_t **bucket = &prof_sites[hash & (PROF_SITE_BUCKETS - 1)];
+    for (prof_site_t *site = *bucket; site != NULL; site = site->next) {
+        if (site->hash == hash && site->depth == depth && memcmp(site->frames, frames, depth * sizeof(void *)) == 0) {
+            return site;
+        }
+    }
+
+    prof_site_t *site = calloc(1, sizeof(prof_site_t));
+    if (site == NULL) {
+        return NULL;
+    }
+    site->hash = hash;
+    site->depth = depth;
+    memcpy(site->frames, frames, depth * sizeof(void *));
+    site->next = *bucket;
+    *bucket = site;
+    return site;
+}
+
+static __attribute__((noinline)) void prof_sample(void *block, size_t size, void *caller)
+{
+    void *frames[PROF_MAX_FRAMES + 4];
+    int depth = backtrace(frames, PROF_MAX_FRAMES + 4);
+
+    // Drop the allocator's own frames: the trace starts at the caller of mem_alloc
+    int first = 0;
+    for (int i = 0; i < depth; i++) {
+        if (frames[i] == caller) {
+            first = i;
+            break;
+        }
+    }
+    depth -= first;
+    if (depth > PROF_MAX_FRAMES) {
+        depth = PROF_MAX_FRAMES;
+    }
+
+    double bytes = size / -expm1(-(double)size / prof_interval);
+
+    pthread_mutex_lock(&prof_lock);
+
+    prof_site_t *site = prof_find_site(frames + first, depth);
+    prof_object_t *object = prof_spare;
+    if (object != NULL) {
+        prof_spare = object->next;
+    } else {
+        object = malloc(sizeof(prof_object_t));
+    }
+
+    if (site != NULL && object != NULL) {
+        site->alloc_count += bytes / size;
+        site->alloc_bytes += bytes;
+        site->live_count += bytes / size;
+        site->live_bytes += bytes;
+
+        object->block = block;
+        object->site = site;
+        object->count = bytes / size;
+        object->bytes = bytes;
+        size_t bucket = prof_live_bucket(block);
+        object->next = prof_live[bucket];
+        prof_live[bucket] = object;
+    } else {
+        free(object);
+    }
+
+    pthread_mutex_unlock(&prof_lock);
+}
+
+void mem_prof_on_alloc(void *block, size_t size, void *caller)
+{
+    if (prof_thread_generation != prof_generation) {
+        prof_thread_generation = prof_generation;  // Profiling (re)started, draw a fresh distance
+        prof_bytes_left = prof_next_distance();
+    }
+
+    prof_bytes_left -= (double)size;
+    if (prof_bytes_left > 0) {
+        return;
+    }
+
+    // A large block may span several sampling points but is only recorded once;
+    // its weight already accounts for that.
+    do {
+        prof_bytes_left += prof_next_distance();
+    } while (prof_bytes_left <= 0);
+
+    prof_sample(block, size, caller);
+}
+
+void mem_prof_on_free(void *block)
+{
+    pthread_mutex_lock(&prof_lock);
+
+    prof_object_t **link = &prof_live[prof_live_bucket(block)];
+    while (*link != NULL && (*link)->block != block) {
+        link = &(*link)->next;
+    }
+
+    prof_object_t *object = *link;
+    if (object != NULL) {
+        *link = object->next;
+        object->site->live_count -= object->count;
+        object->site->live_bytes -= object->bytes;
+        object->next = prof_spare;
+        prof_spare = object;
+    }
+
+    pthread_mutex_unlock(&prof_lock);
+}
+
+// Drops all tracked live objects. Runs under prof_lock.
+static void prof_drop_live(void)
+{
+    for (size_t i = 0; i < PROF_LIVE_BUCKETS; i++) {
+        while (prof_live[i] != NULL) {
+            prof_object_t *object = prof_live[i];
+            prof_live[i] = object->next;
+            object->site->live_count -= object->count;
+            object->site->live_bytes -= object->bytes;
+            object->next = prof_spare;
+            prof_spare = object;
+        }
+    }
+}
+
+// Drops all tracked live objects, their blocks are gone (mem_deinit) or no longer tracked
+void mem_prof_forget_live(void)
+{
+    pthread_mutex_lock(&prof_lock);
+    prof_drop_live();
+    pthread_mutex_unlock(&prof_lock);
+}
+
+int mem_prof_start(size_t sample_interval)
+{
+    if (sample_interval == 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&prof_lock);
+    prof_interval = (double)sample_interval;
+    prof_generation++;
+    pthread_mutex_unlock(&prof_lock);
+
+    mem_hooks_set(MEM_HOOK_PROFILE);
+    return 0;
+}
+
+void mem_prof_stop(void)
+{
+    mem_hooks_clear(MEM_HOOK_PROFILE);
+    mem_prof_forget_live();
+}
+
+// The live objects go in the same critical section as the sites they point to, so a
+// sample taken meanwhile lands either before (and is dropped) or after (with a new site)
+void mem_prof_reset(void)
+{
+    pthread_mutex_lock(&prof_lock);
+    prof_drop_live();
+    for (size_t i = 0; i < PROF_SITE_BUCKETS; i++) {
+        while (prof_sites[i] != NULL) {
+            prof_site_t *site = prof_sites[i];
+            prof_sites[i] = site->next;
+            free(site);
+        }
+    }
+    pthread_mutex_unlock(&prof_lock);
+}
+
+// Writes a frame as "function", falling back to "module+0xoffset" when there is no symbol
+static void prof_write_frame(FILE *out, void *frame)
+{
+    Dl_info info = {0};
+    int found = dladdr(frame, &info) != 0;
+    if (found && info.dli_sname != NULL) {
+        fputs(info.dli_sname, out);
+    } else if (found && info.dli_fname != NULL) {
+        const char *module = strrchr(info.dli_fname, '/');
+        fprintf(out, "%s+0x%tx", module != NULL ? module + 1 : info.dli_fname, (char *)frame - (char *)info.dli_fbase);
+    } else {
+        fprintf(out, "%p", frame);
+    }
+}
+
+int mem_prof_dump(int fd, int kind)
+{
+    int copy = dup(fd);
+    FILE *out = copy >= 0 ? fdopen(copy, "w") : NULL;
+    if (out == NULL) {
+        if (copy >= 0) {
+            close(copy);
+        }
+        return -1;
+    }
+
+    pthread_mutex_lock(&prof_lock);
+    for (size_t i = 0; i < PROF_SITE_BUCKETS; i++) {
+        for (prof_site_t *site = prof_sites[i]; site != NULL; site = site->next) {
+            double bytes = kind == MEM_PROF_LIVE ? site->live_bytes : site->alloc_bytes;
+            if (bytes < 0.5) {
+                continue;
+            }
+
+            // Folded stacks list the outermost frame first
+            for (int frame = site->depth - 1; frame >= 0; frame--) {
+                prof_write_frame(out, site->frames[frame]);
+                if (frame > 0) {
+                    fputc(';', out);
+                }
+            }
+            fprintf(out, " %.0f\n", bytes);
+        }
+    }
+    pthread_mutex_unlock(&prof_lock);
+
+    return fclose(out) == 0 ? 0 : -1;
+}
@@ -0,0 +1,116 @@
+#include <stdint.h>
+#include "memory_manager.h"
+#include "mem_ring.h"
+
+// Ring allocator.
+// Every block starts with a header word holding its length, header included, and a
+// freed flag. Head and tail count bytes since the ring was created and never wrap, so
+// a tail that moved on can never be mistaken for an old one. When a block does not
+// fit before the end of the region, the rest is filled with a freed padding record
+// and the block starts over at the beginning.
+//
+// Whoever frees a block marks it, then moves the tail past every freed record at it
+// with a compare-and-swap, so several threads may free at once. The mark and the tail
+// are sequentially consistent: of a thread freeing the block at the tail and one
+// freeing the next, at least one sees the other's work, and the tail never stalls
+// behind a freed block.
+
+#define RING_FREE ((uint64_t)1 << 32)  // Freed block or padding
+#define RING_LENGTH 0xffffffffull
+#define RING_LINE 64                   // Keeps the producer's and the freers' words apart
+
+struct mem_ring
+{
+    char *data;
+    size_t capacity;       // A multiple of 8
+    uint64_t head;         // Written by the producer only
+    uint64_t cached_tail;  // The producer's last look at the tail
+    char producer_pad[RING_LINE];
+    uint64_t tail;
+    char tail_pad[RING_LINE];
+};
+
+mem_ring_t *mem_ring_create(size_t capacity)
+{
+    capacity &= ~(size_t)7;
+    if (capacity < 2 * sizeof(uint64_t) || capacity > RING_LENGTH) {
+        return NULL;  // Lengths must fit the header
+    }
+
+    mem_ring_t *ring = mem_alloc(sizeof(mem_ring_t));
+    if (ring == NULL) {
+        return NULL;
+    }
+    ring->data = mem_alloc(capacity);
+    if (ring->data == NULL) {
+        mem_free(ring);
+        return NULL;
+    }
+    ring->capacity = capacity;
+    ring->head = 0;
+    ring->cached_tail = 0;
+    ring->tail = 0;
+    return ring;
+}
+
+void mem_ring_destroy(mem_ring_t *ring)
+{
+    if (ring != NULL) {
+        mem_free(ring->data);
+        mem_free(ring);
+    }
+}
+
+void *mem_ring_alloc(mem_ring_t *ring, size_t size)
+{
+    if (size == 0 || size > ring->capacity - sizeof(uint64_t)) {
+        return NULL;
+    }
+    size_t need = sizeof(uint64_t) + ((size + 7) & ~(size_t)7);
+    uint64_t head = ring->head;
+    size_t pos = head % ring->capacity;
+    size_t pad = pos + need > ring->capacity ? ring->capacity - pos : 0;
+
+    // Only look at the shared tail when the cached one says the ring is full
+    if (head + pad + need - ring->cached_tail > ring->capacity) {
+        ring->cached_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        if (head + pad + need - ring->cached_tail > ring->capacity) {
+            return NULL;
+        }
+    }
+
+    if (pad != 0) {
+        __atomic_store_n((uint64_t *)(ring->data + pos), pad | RING_FREE, __ATOMIC_RELAXED);
+        head += pad;
+        pos = 0;
+    }
+    __atomic_store_n((uint64_t *)(ring->data + pos), need, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->head, head + need, __ATOMIC_RELEASE);  // Publishes the headers too
+    return ring->data + pos + sizeof(uint64_t);
+}
+
+void mem_ring_free(mem_ring_t *ring, void *block)
+{
+    if (block == NULL) {
+        return;
+    }
+    __atomic_fetch_or((uint64_t *)block - 1, RING_FREE, __ATOMIC_SEQ_CST);
+
+    uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+    while (tail != __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+        uint64_t record = __atomic_load_n((uint64_t *)(ring->data + tail % ring->capacity), __ATOMIC_SEQ_CST);
+        if (!(record & RING_FREE)) {
+            break;  // The oldest block is still in use; whoever frees it moves the tail
+        }
+        // Fails if another thread moved the tail first, which reloads tail
+        uint64_t next = tail + (record & RING_LENGTH);
+        if (__atomic_compare_exchange_n(&ring->tail, &tail, next, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            tail = next;
+        }
+    }
+}
+
+size_t mem_ring_used(const mem_ring_t *ring)
+{
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
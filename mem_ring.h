@@ -0,0 +1,64 @@
+// mem_ring.h
+#ifndef MEM_RING_H
+#define MEM_RING_H
+
+#include <stddef.h> // For size_t
+
+// Helps C++ compilers to handle C header files
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * A ring allocator for blocks that are freed in roughly the order they were
+     * allocated, such as queued messages.
+     *
+     * Blocks are cut one after the other from a region of the memory pool: allocation
+     * moves a head forward, and the tail follows as the oldest blocks are freed, so
+     * neither searches. A block freed out of order is only marked; the tail moves
+     * past it once every older block is freed too. One thread may allocate; any
+     * thread may free. Neither takes a lock.
+     */
+    typedef struct mem_ring mem_ring_t;
+
+    /**
+     * Creates a ring from the memory pool.
+     *
+     * @param capacity The size of the ring in bytes, including an 8-byte header per block.
+     * @return The ring, or NULL if the pool has no room for it.
+     */
+    mem_ring_t *mem_ring_create(size_t capacity);
+
+    /**
+     * Returns the ring to the pool. Its blocks must not be used any more.
+     */
+    void mem_ring_destroy(mem_ring_t *ring);
+
+    /**
+     * Allocates a block at the head of the ring. Only one thread may call it.
+     *
+     * @param size The size of the block.
+     * @return The block, 8-byte aligned, or NULL if the ring has no room for it until
+     *         older blocks are freed.
+     */
+    void *mem_ring_alloc(mem_ring_t *ring, size_t size);
+
+    /**
+     * Frees a block of the ring. Any thread may call it.
+     *
+     * @param block A block returned by mem_ring_alloc.
+     */
+    void mem_ring_free(mem_ring_t *ring, void *block);
+
+    /**
+     * Returns the number of bytes between the tail and the head, including blocks
+     * freed out of order that the tail has not passed yet.
+     */
+    size_t mem_ring_used(const mem_ring_t *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MEM_RING_H
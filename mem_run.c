@@ -0,0 +1,259 @@
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "memory_manager.h"
+#include "mem_run.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RUN_X86 1
+#endif
+
+// Bitmap slot runs.
+// A set bit marks a taken slot. The bitmap is padded with set bits to whole 256-bit
+// groups, so the scans always load full groups and never see padding as free. The
+// vector scans are compiled for their instruction sets with target attributes and
+// chosen at run time, so the library needs no special flags and runs on any CPU.
+
+#define RUN_GROUP_WORDS 4  // 256 bits
+
+struct mem_run
+{
+    char *data;           // The slots, a pool block of their own
+    size_t slot_size;
+    size_t slots;
+    size_t words;         // Bitmap words, a multiple of RUN_GROUP_WORDS
+    size_t first_free;    // No word below this one has a free bit
+    size_t available;
+    uint64_t reciprocal;  // ceil(2^64 / slot_size), 0 for one-byte slots
+    uint64_t bitmap[];
+};
+
+// Returns the number of the first free slot at or after word `from`, or SIZE_MAX
+typedef size_t (*run_scan_fn)(const uint64_t *bitmap, size_t from, size_t words);
+
+// Finds the free bit of a group known to have one. Inlined into the scans, so the
+// bit search compiles to tzcnt in those built for BMI.
+static inline size_t run_group_first_free(const uint64_t *bitmap, size_t group)
+{
+    for (size_t word = group;; word++) {
+        if (~bitmap[word] != 0) {
+            return word * 64 + __builtin_ctzll(~bitmap[word]);
+        }
+    }
+}
+
+static size_t run_scan_scalar(const uint64_t *bitmap, size_t from, size_t words)
+{
+    for (size_t word = from; word < words; word++) {
+        if (~bitmap[word] != 0) {
+            return word * 64 + __builtin_ctzll(~bitmap[word]);
+        }
+    }
+    return SIZE_MAX;
+}
+
+#ifdef RUN_X86
+__attribute__((target("bmi"))) static size_t run_scan_tzcnt(const uint64_t *bitmap, size_t from, size_t words)
+{
+    for (size_t group = from & ~(size_t)(RUN_GROUP_WORDS - 1); group < words; group += RUN_GROUP_WORDS) {
+        if ((bitmap[group] & bitmap[group + 1] & bitmap[group + 2] & bitmap[group + 3]) != UINT64_MAX) {
+            return run_group_first_free(bitmap, group);
+        }
+    }
+    return SIZE_MAX;
+}
+
+__attribute__((target("sse4.1"))) static size_t run_scan_sse41(const uint64_t *bitmap, size_t from, size_t words)
+{
+    const __m128i ones = _mm_set1_epi32(-1);
+    for (size_t group = from & ~(size_t)(RUN_GROUP_WORDS - 1); group < words; group += RUN_GROUP_WORDS) {
+        __m128i low = _mm_loadu_si128((const __m128i *)(bitmap + group));
+        __m128i high = _mm_loadu_si128((const __m128i *)(bitmap + group + 2));
+        if (!_mm_testc_si128(_mm_and_si128(low, high), ones)) {
+            return run_group_first_free(bitmap, group);
+        }
+    }
+    return SIZE_MAX;
+}
+
+__attribute__((target("avx2,bmi"))) static size_t run_scan_avx2(const uint64_t *bitmap, size_t from, size_t words)
+{
+    const __m256i ones = _mm256_set1_epi32(-1);
+    for (size_t group = from & ~(size_t)(RUN_GROUP_WORDS - 1); group < words; group += RUN_GROUP_WORDS) {
+        if (!_mm256_testc_si256(_mm256_loadu_si256((const __m256i *)(bitmap + group)), ones)) {
+            return run_group_first_free(bitmap, group);
+        }
+    }
+    return SIZE_MAX;
+}
+#endif
+
+static const char *run_scan_names[] = {"auto", "scalar", "tzcnt", "sse4.1", "avx2"};
+static run_scan_fn run_scan = run_scan_scalar;
+static int run_scan_kind = MEM_RUN_SCAN_SCALAR;
+static pthread_once_t run_scan_once = PTHREAD_ONCE_INIT;
+
+static int run_scan_supported(int kind)
+{
+#ifdef RUN_X86
+    __builtin_cpu_init();
+    switch (kind) {
+    case MEM_RUN_SCAN_TZCNT:
+        return __builtin_cpu_supports("bmi");
+    case MEM_RUN_SCAN_SSE41:
+        return __builtin_cpu_supports("sse4.1");
+    case MEM_RUN_SCAN_AVX2:
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi");
+    }
+#endif
+    return kind == MEM_RUN_SCAN_SCALAR;
+}
+
+int mem_run_select_scan(int kind)
+{
+    if (kind == MEM_RUN_SCAN_AUTO) {
+        for (kind = MEM_RUN_SCAN_AVX2; !run_scan_supported(kind); kind--) {
+        }
+    }
+    if (kind < MEM_RUN_SCAN_SCALAR || kind > MEM_RUN_SCAN_AVX2 || !run_scan_supported(kind)) {
+        return -1;
+    }
+
+    run_scan_fn scan = run_scan_scalar;
+#ifdef RUN_X86
+    if (kind == MEM_RUN_SCAN_TZCNT) {
+        scan = run_scan_tzcnt;
+    } else if (kind == MEM_RUN_SCAN_SSE41) {
+        scan = run_scan_sse41;
+    } else if (kind == MEM_RUN_SCAN_AVX2) {
+        scan = run_scan_avx2;
+    }
+#endif
+    run_scan = scan;
+    run_scan_kind = kind;
+    return 0;
+}
+
+static void run_scan_init(void)
+{
+    mem_run_select_scan(MEM_RUN_SCAN_AUTO);
+}
+
+const char *mem_run_scan_name(void)
+{
+    pthread_once(&run_scan_once, run_scan_init);
+    return run_scan_names[run_scan_kind];
+}
+
+mem_run_t *mem_run_create(size_t slot_size, size_t slots)
+{
+    if (slot_size == 0 || slots == 0 || slots > SIZE_MAX / slot_size) {
+        return NULL;
+    }
+    pthread_once(&run_scan_once, run_scan_init);
+
+    size_t words = ((slots + 63) / 64 + RUN_GROUP_WORDS - 1) & ~(size_t)(RUN_GROUP_WORDS - 1);
+    mem_run_t *run = mem_alloc(sizeof(mem_run_t) + words * sizeof(uint64_t));
+    if (run == NULL) {
+        return NULL;
+    }
+    run->data = mem_alloc(slot_size * slots);
+    if (run->data == NULL) {
+        mem_free(run);
+        return NULL;
+    }
+
+    memset(run->bitmap, 0, slots / 64 * sizeof(uint64_t));
+    for (size_t word = slots / 64; word < words; word++) {
+        run->bitmap[word] = UINT64_MAX;  // Padding is never free
+    }
+    if (slots % 64 != 0) {
+        run->bitmap[slots / 64] = UINT64_MAX << (slots % 64);
+    }
+    run->slot_size = slot_size;
+    run->slots = slots;
+    run->words = words;
+    run->first_free = 0;
+    run->available = slots;
+    run->reciprocal = slot_size > 1 ? UINT64_MAX / slot_size + 1 : 0;
+    return run;
+}
+
+void mem_run_destroy(mem_run_t *run)
+{
+    if (run != NULL) {
+        mem_free(run->data);
+        mem_free(run);
+    }
+}
+
+void *mem_run_alloc(mem_run_t *run)
+{
+    if (run->available == 0) {
+        return NULL;
+    }
+
+    size_t slot = run_scan(run->bitmap, run->first_free, run->words);
+    size_t word = slot / 64;
+    run->bitmap[word] |= (uint64_t)1 << (slot % 64);
+    run->first_free = word;
+    run->available--;
+    return run->data + slot * run->slot_size;
+}
+
+size_t mem_run_alloc_bulk(mem_run_t *run, void **slots, size_t count)
+{
+    size_t taken = 0;
+
+    while (taken < count && run->available > 0) {
+        size_t word = run_scan(run->bitmap, run->first_free, run->words) / 64;
+        uint64_t claim = ~run->bitmap[word];
+        size_t want = count - taken;
+
+        if ((size_t)__builtin_popcountll(claim) > want) {
+            // Keep the lowest `want` free bits only
+            uint64_t rest = claim;
+            for (size_t i = 0; i < want; i++) {
+                rest &= rest - 1;
+            }
+            claim ^= rest;
+        }
+        run->bitmap[word] |= claim;  // Every slot of the word is claimed at once
+        run->first_free = word;
+
+        char *base = run->data + word * 64 * run->slot_size;
+        for (; claim != 0; claim &= claim - 1) {
+            slots[taken++] = base + __builtin_ctzll(claim) * run->slot_size;
+            run->available--;
+        }
+    }
+    return taken;
+}
+
+int mem_run_free(mem_run_t *run, void *slot)
+{
+    size_t offset = (uintptr_t)slot - (uintptr_t)run->data;
+    if ((uintptr_t)slot < (uintptr_t)run->data || offset >= run->slots * run->slot_size) {
+        return -1;
+    }
+
+    // Multiplying by the rounded-up reciprocal is exact for offsets inside the run
+    size_t index = run->reciprocal ? (size_t)(((unsigned __int128)offset * run->reciprocal) >> 64) : offset;
+    uint64_t mask = (uint64_t)1 << (index % 64);
+    if (index * run->slot_size != offset || !(run->bitmap[index / 64] & mask)) {
+        return -1;  // Not the start of a slot, or not taken
+    }
+
+    run->bitmap[index / 64] &= ~mask;
+    run->available++;
+    if (index / 64 < run->first_free) {
+        run->first_free = index / 64;
+    }
+    return 0;
+}
+
+size_t mem_run_available(const mem_run_t *run)
+{
+    return run->available;
+}
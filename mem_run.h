@@ -0,0 +1,92 @@
+// mem_run.h
+#ifndef MEM_RUN_H
+#define MEM_RUN_H
+
+#include <stddef.h> // For size_t
+
+// Helps C++ compilers to handle C header files
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * Runs of fixed-size slots tracked by a bitmap, for pools of objects of one size.
+     *
+     * A run is one mem_alloc block cut into equal slots. Which slots are taken is kept
+     * in a bitmap stored in a separate block, one bit per slot, so the slots carry no
+     * headers and a free slot is found by scanning 256 bits per step with AVX2, SSE4.1
+     * or tzcnt, whichever the CPU supports. A run is not locked; use it from one thread
+     * at a time or serialize the calls.
+     */
+    typedef struct mem_run mem_run_t;
+
+    // Bitmap scans, see mem_run_select_scan
+#define MEM_RUN_SCAN_AUTO 0   // The fastest one the CPU supports
+#define MEM_RUN_SCAN_SCALAR 1 // One 64-bit word per step
+#define MEM_RUN_SCAN_TZCNT 2  // Four words per step, tzcnt to find the bit
+#define MEM_RUN_SCAN_SSE41 3  // Two 128-bit tests per step
+#define MEM_RUN_SCAN_AVX2 4   // One 256-bit test per step
+
+    /**
+     * Creates a run of slots of the given size from the memory pool.
+     *
+     * @param slot_size The size of every slot.
+     * @param slots The number of slots.
+     * @return The run, or NULL if the pool has no room for it.
+     */
+    mem_run_t *mem_run_create(size_t slot_size, size_t slots);
+
+    /**
+     * Returns the run and its slots to the pool. Slots still taken are freed as well.
+     */
+    void mem_run_destroy(mem_run_t *run);
+
+    /**
+     * Takes the free slot with the lowest address.
+     *
+     * @return A pointer to the slot, or NULL if the run is full.
+     */
+    void *mem_run_alloc(mem_run_t *run);
+
+    /**
+     * Takes up to count free slots, claiming every free slot of a bitmap word with a
+     * single update.
+     *
+     * @param slots Receives the pointers to the slots taken.
+     * @param count The number of slots wanted.
+     * @return The number of slots taken, less than count only if the run is full.
+     */
+    size_t mem_run_alloc_bulk(mem_run_t *run, void **slots, size_t count);
+
+    /**
+     * Gives a slot back to its run.
+     *
+     * @param slot A pointer returned by mem_run_alloc or mem_run_alloc_bulk.
+     * @return 0 on success, or -1 if slot is not a taken slot of this run.
+     */
+    int mem_run_free(mem_run_t *run, void *slot);
+
+    /**
+     * Returns the number of free slots in the run.
+     */
+    size_t mem_run_available(const mem_run_t *run);
+
+    /**
+     * Chooses the bitmap scan used by every run, mainly to compare them.
+     *
+     * @param kind One of the MEM_RUN_SCAN_* constants.
+     * @return 0 on success, or -1 if kind is unknown or the CPU does not support it.
+     */
+    int mem_run_select_scan(int kind);
+
+    /**
+     * Returns the name of the scan in use: "avx2", "sse4.1", "tzcnt" or "scalar".
+     */
+    const char *mem_run_scan_name(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MEM_RUN_H
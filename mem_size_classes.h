@@ -0,0 +1,44 @@
+// mem_size_classes.h
+#ifndef MEM_SIZE_CLASSES_H
+#define MEM_SIZE_CLASSES_H
+
+// Small size classes as X(index, size, previous size): every 8 bytes up to 128, then
+// four classes per doubling up to MEM_SIZE_CLASS_SMALL_MAX. The lookup tables in
+// memory_manager.c are generated from this list, so a class is added here only.
+// Larger classes continue the four-per-doubling pattern and are computed, not listed.
+#define MEM_SIZE_CLASSES(X) \
+    X(0, 8, 0)              \
+    X(1, 16, 8)             \
+    X(2, 24, 16)            \
+    X(3, 32, 24)            \
+    X(4, 40, 32)            \
+    X(5, 48, 40)            \
+    X(6, 56, 48)            \
+    X(7, 64, 56)            \
+    X(8, 72, 64)            \
+    X(9, 80, 72)            \
+    X(10, 88, 80)           \
+    X(11, 96, 88)           \
+    X(12, 104, 96)          \
+    X(13, 112, 104)         \
+    X(14, 120, 112)         \
+    X(15, 128, 120)         \
+    X(16, 160, 128)         \
+    X(17, 192, 160)         \
+    X(18, 224, 192)         \
+    X(19, 256, 224)         \
+    X(20, 320, 256)         \
+    X(21, 384, 320)         \
+    X(22, 448, 384)         \
+    X(23, 512, 448)         \
+    X(24, 640, 512)         \
+    X(25, 768, 640)         \
+    X(26, 896, 768)         \
+    X(27, 1024, 896)
+
+#define MEM_SIZE_CLASS_SMALL 28         // Number of listed classes
+#define MEM_SIZE_CLASS_SMALL_LG 10      // log2 of the largest listed class
+#define MEM_SIZE_CLASS_SMALL_MAX (1 << MEM_SIZE_CLASS_SMALL_LG)
+#define MEM_SIZE_CLASS_QUANTUM_LG 3     // Listed sizes are multiples of 8
+
+#endif // MEM_SIZE_CLASSES_H
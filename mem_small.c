@@ -0,0 +1,186 @@
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "memory_manager.h"
+#include "memory_manager_internal.h"
+
+// Header-free small objects.
+// The region selected by mem_small_select is carved into pages, each holding objects of
+// one size class behind a descriptor at the start of the page. Masking an object's
+// address finds its descriptor, and with it the object's size, so objects carry no
+// header. Pages with free objects are kept on a list per class; pages that empty go
+// back to a list of spare pages for any class. Everything here runs under the pool lock.
+
+#define SMALL_CLASSES 16  // Classes 8 to MEM_SMALL_MAX in steps of 8
+
+typedef struct small_page
+{
+    struct small_page *next;  // Pages of the class with free objects, or spare pages
+    struct small_page *prev;
+    void *free;               // Freed objects, linked through their first word
+    uint32_t bump;            // Offset of the first object never handed out
+    uint16_t object_size;
+    uint16_t used;            // Objects handed out
+} small_page_t;
+
+// Objects start right after the descriptor, which keeps 16-byte classes 16-byte aligned
+#define SMALL_FIRST ((sizeof(small_page_t) + 15) & ~(size_t)15)
+
+char *mem_small_base;
+size_t mem_small_span;
+size_t mem_small_limit;
+
+static size_t small_next_page;  // Offset of the first page never used
+static small_page_t *small_spare;
+static small_page_t *small_partial[SMALL_CLASSES];
+static size_t small_pages_used;
+
+size_t mem_small_footprint(void)
+{
+    return small_pages_used * MEM_SMALL_PAGE;
+}
+
+static void small_clear(void)
+{
+    small_next_page = 0;
+    small_spare = NULL;
+    memset(small_partial, 0, sizeof(small_partial));
+    small_pages_used = 0;
+}
+
+int mem_small_setup(size_t region_size)
+{
+    mem_small_teardown();
+    region_size = (region_size + MEM_SMALL_PAGE - 1) & ~(size_t)(MEM_SMALL_PAGE - 1);
+    if (region_size == 0) {
+        return 0;
+    }
+    // Reserve extra so the region can start on a page boundary of its own
+    size_t span = region_size + MEM_SMALL_PAGE;
+    char *region = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        return -1;
+    }
+    size_t skew = (uintptr_t)region & (MEM_SMALL_PAGE - 1);
+    if (skew != 0) {
+        munmap(region, MEM_SMALL_PAGE - skew);
+        region += MEM_SMALL_PAGE - skew;
+        span -= MEM_SMALL_PAGE - skew;
+    }
+    if (span > region_size) {
+        munmap(region + region_size, span - region_size);
+    }
+    mem_small_base = region;
+    mem_small_span = region_size;
+    mem_small_limit = MEM_SMALL_MAX;
+    small_clear();
+    return 0;
+}
+
+void mem_small_teardown(void)
+{
+    if (mem_small_base != NULL) {
+        munmap(mem_small_base, mem_small_span);
+    }
+    mem_small_base = NULL;
+    mem_small_span = 0;
+    mem_small_limit = 0;
+    small_clear();
+}
+
+void mem_small_reset(void)
+{
+    if (mem_small_base != NULL) {
+        small_clear();
+    }
+}
+
+static void small_unlink(small_page_t *page, size_t size_class)
+{
+    if (page->prev != NULL) {
+        page->prev->next = page->next;
+    } else {
+        small_partial[size_class] = page->next;
+    }
+    if (page->next != NULL) {
+        page->next->prev = page->prev;
+    }
+}
+
+static small_page_t *small_page_new(size_t size_class)
+{
+    small_page_t *page = small_spare;
+    if (page != NULL) {
+        small_spare = page->next;
+    } else if (small_next_page < mem_small_span) {
+        page = (small_page_t *)(mem_small_base + small_next_page);
+        small_next_page += MEM_SMALL_PAGE;
+    } else {
+        return NULL;
+    }
+    page->next = NULL;
+    page->prev = NULL;
+    page->free = NULL;
+    page->bump = SMALL_FIRST;
+    page->object_size = (uint16_t)mem_size_class_size_inline(size_class);
+    page->used = 0;
+    small_partial[size_class] = page;
+    small_pages_used++;
+    return page;
+}
+
+void *mem_small_alloc(size_t size)
+{
+    size_t size_class = mem_size_class_inline(size);
+    small_page_t *page = small_partial[size_class];
+    if (page == NULL) {
+        page = small_page_new(size_class);
+        if (page == NULL) {
+            return NULL;  // The region is full, the pool takes over
+        }
+    }
+
+    void *object = page->free;
+    if (object != NULL) {
+        page->free = *(void **)object;
+    } else {
+        object = (char *)page + page->bump;
+        page->bump += page->object_size;
+    }
+    page->used++;
+    if (page->free == NULL && page->bump + page->object_size > MEM_SMALL_PAGE) {
+        small_unlink(page, size_class);  // Full pages are found again through their objects
+    }
+    return object;
+}
+
+void mem_small_free(void *object)
+{
+    small_page_t *page = (small_page_t *)((uintptr_t)object & ~(uintptr_t)(MEM_SMALL_PAGE - 1));
+    size_t size_class = mem_size_class_inline(page->object_size);
+    int was_full = page->free == NULL && page->bump + page->object_size > MEM_SMALL_PAGE;
+
+    *(void **)object = page->free;
+    page->free = object;
+    page->used--;
+    if (page->used == 0) {
+        if (!was_full) {
+            small_unlink(page, size_class);
+        }
+        page->next = small_spare;
+        small_spare = page;
+        small_pages_used--;
+    } else if (was_full) {
+        page->prev = NULL;
+        page->next = small_partial[size_class];
+        if (page->next != NULL) {
+            page->next->prev = page;
+        }
+        small_partial[size_class] = page;
+    }
+}
+
+size_t mem_small_size(const void *object)
+{
+    return ((const small_page_t *)((uintptr_t)object & ~(uintptr_t)(MEM_SMALL_PAGE - 1)))->object_size;
+}
@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "memory_manager.h"
+#include "memory_manager_internal.h"
+#include "mem_stat.h"
+
+// Live metrics.
+// The hooks count operations into process-local atomics while MEM_HOOK_STATS is set;
+// the pool counts its lock acquisitions itself, under the lock.
+// A background thread wakes every interval, measures the pool from a snapshot of its
+// layout and copies everything into the shared segment under the sequence lock. It is
+// the only writer, so the segment needs no other synchronization.
+
+#define STAT_NAME_MAX 64
+
+static pthread_mutex_t stat_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stat_wakeup = PTHREAD_COND_INITIALIZER;
+static pthread_t stat_thread;
+static int stat_running;
+static int stat_stopping;
+static unsigned int stat_interval_ms;
+static char stat_name[STAT_NAME_MAX];
+static mem_stat_segment_t *stat_segment;
+
+static uint64_t stat_allocs;
+static uint64_t stat_failed_allocs;
+static uint64_t stat_frees;
+static uint64_t stat_lock_base[2];  // Lock counts when publishing began
+
+void mem_stat_on_alloc(int failed)
+{
+    __atomic_fetch_add(&stat_allocs, 1, __ATOMIC_RELAXED);
+    if (failed) {
+        __atomic_fetch_add(&stat_failed_allocs, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void mem_stat_on_free(void)
+{
+    __atomic_fetch_add(&stat_frees, 1, __ATOMIC_RELAXED);
+}
+
+static void stat_sample(mem_stat_counters_t *counters)
+{
+    struct timespec now;
+    size_t count;
+    memset(counters, 0, sizeof(*counters));
+
+    mem_block_info_t *blocks = mem_pool_snapshot(&count);
+    if (blocks != NULL) {
+        for (size_t i = 0; i < count; i++) {
+            counters->pool_size += blocks[i].size + sizeof(size_t);
+            if (blocks[i].state == MEM_BLOCK_USED) {
+                counters->used_bytes += blocks[i].size;
+                counters->used_blocks++;
+            } else {
+                counters->free_bytes += blocks[i].size;
+                counters->free_blocks++;
+                if (blocks[i].size > counters->largest_free) {
+                    counters->largest_free = blocks[i].size;
+                }
+            }
+        }
+        free(blocks);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    counters->sample_ns = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    counters->allocs = __atomic_load_n(&stat_allocs, __ATOMIC_RELAXED);
+    counters->failed_allocs = __atomic_load_n(&stat_failed_allocs, __ATOMIC_RELAXED);
+    counters->frees = __atomic_load_n(&stat_frees, __ATOMIC_RELAXED);
+    mem_pool_lock_counts(&counters->lock_acquisitions, &counters->lock_contended);
+    counters->lock_acquisitions -= stat_lock_base[0];
+    counters->lock_contended -= stat_lock_base[1];
+}
+
+static void stat_write(mem_stat_segment_t *segment, const mem_stat_counters_t *counters)
+{
+    const uint64_t *from = (const uint64_t *)counters;
+    uint64_t *to = (uint64_t *)&segment->counters;
+    uint64_t seq = segment->seq;
+
+    __atomic_store_n(&segment->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);  // Readers that see the new counters see the odd seq
+    for (size_t i = 0; i < sizeof(mem_stat_counters_t) / sizeof(uint64_t); i++) {
+        __atomic_store_n(&to[i], from[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&segment->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static void *stat_main(void *arg)
+{
+    mem_stat_counters_t counters;
+    (void)arg;
+
+    pthread_mutex_lock(&stat_lock);
+    while (!stat_stopping) {
+        pthread_mutex_unlock(&stat_lock);
+        stat_sample(&counters);
+        stat_write(stat_segment, &counters);
+        pthread_mutex_lock(&stat_lock);
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += stat_interval_ms / 1000;
+        deadline.tv_nsec += (long)(stat_interval_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        if (!stat_stopping) {
+            pthread_cond_timedwait(&stat_wakeup, &stat_lock, &deadline);
+        }
+    }
+    pthread_mutex_unlock(&stat_lock);
+    return NULL;
+}
+
+int mem_stat_publish(const char *name, unsigned int interval_ms)
+{
+    char default_name[STAT_NAME_MAX];
+    if (name == NULL) {
+        snprintf(default_name, sizeof(default_name), MEM_STAT_NAME_FORMAT, (int)getpid());
+        name = default_name;
+    }
+    if (interval_ms == 0 || strlen(name) >= STAT_NAME_MAX) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&stat_lock);
+    if (stat_running) {
+        pthread_mutex_unlock(&stat_lock);
+        return -1;
+    }
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        pthread_mutex_unlock(&stat_lock);
+        return -1;
+    }
+    mem_stat_segment_t *segment = MAP_FAILED;
+    if (ftruncate(fd, sizeof(mem_stat_segment_t)) == 0) {
+        segment = mmap(NULL, sizeof(mem_stat_segment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (segment == MAP_FAILED) {
+        shm_unlink(name);
+        pthread_mutex_unlock(&stat_lock);
+        return -1;
+    }
+
+    segment->pid = (uint64_t)getpid();
+    segment->interval_ms = interval_ms;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    segment->start_ns = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    segment->version = MEM_STAT_VERSION;
+    __atomic_store_n(&segment->magic, MEM_STAT_MAGIC, __ATOMIC_RELEASE);  // Last, as with shared pools
+
+    strcpy(stat_name, name);
+    stat_segment = segment;
+    stat_interval_ms = interval_ms;
+    stat_stopping = 0;
+    stat_allocs = stat_failed_allocs = stat_frees = 0;  // Counts start with the segment
+    mem_pool_lock_counts(&stat_lock_base[0], &stat_lock_base[1]);
+    mem_hooks_set(MEM_HOOK_STATS);
+    if (pthread_create(&stat_thread, NULL, stat_main, NULL) != 0) {
+        mem_hooks_clear(MEM_HOOK_STATS);
+        munmap(segment, sizeof(mem_stat_segment_t));
+        shm_unlink(name);
+        stat_segment = NULL;
+        pthread_mutex_unlock(&stat_lock);
+        return -1;
+    }
+    stat_running = 1;
+    pthread_mutex_unlock(&stat_lock);
+    return 0;
+}
+
+void mem_stat_unpublish(void)
+{
+    pthread_mutex_lock(&stat_lock);
+    if (!stat_running) {
+        pthread_mutex_unlock(&stat_lock);
+        return;
+    }
+    stat_stopping = 1;
+    pthread_cond_signal(&stat_wakeup);
+    pthread_mutex_unlock(&stat_lock);
+
+    pthread_join(stat_thread, NULL);
+
+    pthread_mutex_lock(&stat_lock);
+    mem_hooks_clear(MEM_HOOK_STATS);
+    munmap(stat_segment, sizeof(mem_stat_segment_t));
+    shm_unlink(stat_name);
+    stat_segment = NULL;
+    stat_running = 0;
+    pthread_mutex_unlock(&stat_lock);
+}
@@ -0,0 +1,61 @@
+// mem_stat.h
+#ifndef MEM_STAT_H
+#define MEM_STAT_H
+
+// Shared-memory segment written by mem_stat_publish and read by mmstat.
+// One thread of the publishing process rewrites the counters every interval under a
+// sequence lock: seq is odd while an update is in progress, so readers retry instead
+// of blocking the writer. Counts are cumulative; readers derive rates from two
+// samples. All fields are in host byte order.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MEM_STAT_MAGIC 0x54534d4du  // "MMST"
+#define MEM_STAT_VERSION 1u
+#define MEM_STAT_NAME_FORMAT "/mmstat.%d"  // Default segment name, from the publisher's pid
+
+typedef struct
+{
+    uint64_t sample_ns;      // CLOCK_MONOTONIC time of the sample
+    uint64_t pool_size;      // 0 while no pool is initialized
+    uint64_t used_bytes;     // Payload bytes of allocated blocks
+    uint64_t used_blocks;
+    uint64_t free_bytes;     // Payload bytes of free blocks and of the untouched tail
+    uint64_t free_blocks;
+    uint64_t largest_free;   // Payload of the largest free block
+    uint64_t allocs;         // mem_alloc and mem_alloc_hint calls
+    uint64_t failed_allocs;  // Those that returned NULL
+    uint64_t frees;          // mem_free calls
+    uint64_t lock_acquisitions;
+    uint64_t lock_contended;  // Acquisitions that found the pool lock held
+} mem_stat_counters_t;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t pid;
+    uint64_t interval_ms;
+    uint64_t start_ns;  // CLOCK_MONOTONIC time publishing began
+    uint64_t seq;
+    mem_stat_counters_t counters;
+} mem_stat_segment_t;
+
+// Copies a consistent set of counters out of the segment
+static inline void mem_stat_read(const mem_stat_segment_t *segment, mem_stat_counters_t *counters)
+{
+    const uint64_t *from = (const uint64_t *)&segment->counters;
+    uint64_t *to = (uint64_t *)counters;
+    uint64_t before, after;
+    do {
+        before = __atomic_load_n(&segment->seq, __ATOMIC_ACQUIRE);
+        for (size_t i = 0; i < sizeof(mem_stat_counters_t) / sizeof(uint64_t); i++) {
+            to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&segment->seq, __ATOMIC_RELAXED);
+    } while ((before & 1) || before != after);
+}
+
+#endif // MEM_STAT_H
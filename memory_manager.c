@@ -2,92 +2,1408 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <execinfo.h>
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include "memory_manager.h"
+#include "memory_manager_internal.h"
+#include "mem_map.h"
+#include "mem_locks.h"
 
 static void *memory_pool;  // Pointer to the memory pool
 static size_t pool_size;   // Total size of the memory pool
+static size_t local_first_free;
+static size_t *pool_first_free = &local_first_free;  // No free block starts below this offset
 static pthread_mutex_t mem_lock = PTHREAD_MUTEX_INITIALIZER;  // Mutex for thread safety
+static pthread_mutex_t *pool_mutex = &mem_lock;  // mem_lock, or the process-shared mutex of a shared pool
+static int pool_lock_kind = MEM_LOCK_PTHREAD;      // Lock used by the current pool
+static int pool_lock_selected = MEM_LOCK_PTHREAD;  // Lock for the next pool, see mem_lock_select
+static mem_ticket_lock_t pool_ticket_lock;
+static mem_mcs_lock_t pool_mcs_lock;
+static mem_futex_lock_t pool_futex_lock;
+static __thread mem_mcs_node_t pool_mcs_node;  // A thread holds at most one pool lock at a time
+static uint64_t pool_lock_acquisitions;  // Counted while MEM_HOOK_STATS is set, see mem_pool_lock_counts
+static uint64_t pool_lock_contended;
+
+volatile unsigned int mem_hooks;  // MEM_HOOK_* bits, see memory_manager_internal.h
+
+// Set in the header of a freed block. Untouched space at the end of the pool has a zero header.
+#define BLOCK_FREE ((size_t)1 << (sizeof(size_t) * 8 - 1))
+// Set on a free block whose whole pages have been returned to the kernel
+#define BLOCK_PURGED ((size_t)1 << (sizeof(size_t) * 8 - 2))
+// Lifetime class of a block allocated by mem_alloc_hint, 0 for mem_alloc
+#define BLOCK_CLASS_SHIFT (sizeof(size_t) * 8 - 4)
+#define BLOCK_CLASS ((size_t)3 << BLOCK_CLASS_SHIFT)
+// Set on a block whose last word records its call site for MEM_HINT_AUTO
+#define BLOCK_TRAILER ((size_t)1 << (sizeof(size_t) * 8 - 5))
+// Set on a block allocated by mem_handle_alloc, whose first word is the handle's index
+#define BLOCK_HANDLE ((size_t)1 << (sizeof(size_t) * 8 - 6))
+#define BLOCK_FLAGS (BLOCK_FREE | BLOCK_PURGED | BLOCK_CLASS | BLOCK_TRAILER | BLOCK_HANDLE)
+
+#define HINT_CLASSES 3              // MEM_HINT_SHORT, MEM_HINT_LONG and MEM_HINT_PERMANENT
+#define HINT_RUN_SIZE (64 * 1024)   // Untouched space a lifetime class claims at once
+#define HINT_MIN_SPLIT 16           // Smallest payload worth splitting off a free block
+
+static size_t local_class_first_free[HINT_CLASSES];
+static size_t *pool_class_first_free = local_class_first_free;  // Per class: no free block of it starts below
+static int pool_hinted;             // Free blocks of a lifetime class may exist
+static unsigned int pool_layout_generation;  // Bumped when blocks are merged or moved
+
+static uint64_t *pool_free_index;  // MEM_LAYOUT_INDEXED: one bit per word, set where a plain free block starts
+static size_t pool_free_index_words;
+static size_t pool_tail;  // Start of the untouched tail, kept up to date for indexed pools only
+static int pool_layout_selected = MEM_LAYOUT_INLINE;  // Layout for the next pool, see mem_layout_select
+static size_t pool_small_selected;  // Small-object region for the next pool, see mem_small_select
+
+#define COMPACT_STEP_BLOCKS 256  // Blocks looked at per lock hold in mem_compact
+static pthread_mutex_t compact_lock = PTHREAD_MUTEX_INITIALIZER;  // One mem_compact at a time
+
+static size_t pool_page_size;
+static size_t pool_dirty_pages;  // Whole pages inside free blocks that have not been purged
+static int pool_purge_busy;      // mem_pool_purge has a block out of circulation
+static unsigned int pool_serial;  // Bumped for every pool set up, so checkpoints know theirs
+
+// Frees deferred by mem_free_batch. A thread collects its blocks here and releases
+// them all the next time it holds the pool lock.
+typedef struct
+{
+    unsigned int generation;  // pool_defer_generation when the blocks were collected
+    int registered;           // The thread-exit destructor is armed
+    size_t count;
+    void *blocks[MEM_FREE_BATCH_MAX];
+} defer_buffer_t;
+
+static size_t defer_batch;                  // Blocks collected before taking the lock, 0 to free at once
+static unsigned int pool_defer_generation;  // Bumped when collected blocks stop being valid
+static __thread defer_buffer_t defer_buffer;
+static pthread_key_t defer_key;
+static pthread_once_t defer_once = PTHREAD_ONCE_INIT;
+
+// Block headers and hints saved by mem_checkpoint
+typedef struct
+{
+    size_t offset;
+    size_t header;
+} checkpoint_block_t;
+
+struct mem_checkpoint
+{
+    unsigned int serial;
+    size_t tail;
+    size_t first_free;
+    size_t class_first_free[HINT_CLASSES];
+    int hinted;
+    size_t dirty_pages;
+    uint64_t root;
+    size_t count;
+    checkpoint_block_t blocks[];
+};
+
+// File-backed pools start with this header; the pool itself follows it.
+// Block headers only hold sizes, so the pool needs no fixup when it is
+// mapped at another address. Everything here is stored as an offset too.
+#define POOL_FILE_MAGIC 0x4c4f4f504d454d31ULL  // "1MEMPOOL"
+#define POOL_FILE_VERSION 1
+
+typedef struct
+{
+    uint64_t magic;
+    uint64_t version;
+    uint64_t pool_size;
+    uint64_t base;   // Address the pool was last mapped at
+    uint64_t root;   // Offset of the root block plus one, 0 if none
+    uint64_t reserved[3];
+} pool_file_header_t;
+
+static pool_file_header_t *pool_file;  // Start of the file mapping, NULL for anonymous pools
+
+// Shared pools start with this header. The mutex and the first-free hint live in
+// it so every process attached to the pool uses the same ones.
+#define POOL_SHM_MAGIC 0x4d4853504d454d31ULL  // "1MEMPSHM"
+#define POOL_SHM_WAIT 100000  // Yields to wait for the creator before giving up
+
+typedef struct
+{
+    uint64_t magic;  // Written last by the creator, once the mutex is ready
+    uint64_t pool_size;
+    uint64_t first_free;
+    uint64_t class_first_free[HINT_CLASSES];
+    pthread_mutex_t lock;
+} __attribute__((aligned(64))) pool_shm_header_t;
+
+static pool_shm_header_t *pool_shm;  // Start of the shared mapping, NULL unless shared
+
+// Sampled guard-page allocations.
+// The guard region is laid out as [guard][slot 0][guard][slot 1][guard] ... [slot n-1][guard],
+// every page being PROT_NONE except the data pages of live slots.
+#define GUARD_MAX_FRAMES 16
+
+enum { GUARD_SLOT_EMPTY, GUARD_SLOT_LIVE, GUARD_SLOT_FREED };
+
+typedef struct
+{
+    void *ptr;     // User pointer, right-aligned against the trailing guard page
+    size_t size;   // Requested size
+    int state;     // GUARD_SLOT_EMPTY, GUARD_SLOT_LIVE or GUARD_SLOT_FREED
+    int alloc_depth;
+    void *alloc_trace[GUARD_MAX_FRAMES];
+    void *free_caller;  // Return address of the mem_free call; unwinding at free costs too much
+} guard_slot_t;
+
+static volatile unsigned int guard_sample_rate;  // 0 when sampling is off
+static char *guard_region;                       // Start of the guard region, NULL if not mapped
+static size_t guard_region_size;
+static size_t guard_num_slots;
+static size_t guard_page_size;
+static guard_slot_t *guard_slots;
+static size_t *guard_free_ring;    // FIFO of reusable slot indices, oldest freed slot first
+static size_t guard_free_head;
+static size_t guard_free_count;
+static pthread_mutex_t guard_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct sigaction guard_old_action;
+// Initial-exec TLS, so mem_alloc reaches the countdown without a __tls_get_addr call
+static __thread unsigned int guard_countdown __attribute__((tls_model("initial-exec")));  // Allocations left before the next sample
+static __thread unsigned int guard_seed __attribute__((tls_model("initial-exec")));
+
+// Returns non-zero if ptr points into the guard region
+static int guard_owns(const void *ptr)
+{
+    return guard_region != NULL && (const char *)ptr >= guard_region && (const char *)ptr < guard_region + guard_region_size;
+}
+
+static char *guard_slot_page(size_t slot)
+{
+    return guard_region + (2 * slot + 1) * guard_page_size;
+}
+
+// Decides whether the current allocation should be sampled; the countdown is
+// re-drawn uniformly from [1, 2 * rate] so the mean interval equals the rate.
+static int guard_should_sample(unsigned int rate)
+{
+    if (guard_countdown > 1) {
+        guard_countdown--;
+        return 0;
+    }
+
+    int first_call = guard_countdown == 0;
+    if (guard_seed == 0) {
+        guard_seed = (unsigned int)time(NULL) ^ (unsigned int)(uintptr_t)&guard_seed;
+    }
+    guard_countdown = 1 + rand_r(&guard_seed) % (2 * rate);
+    return !first_call;  // A thread's first draw only arms the countdown
+}
+
+static void guard_write(const char *text)
+{
+    ssize_t unused = write(STDERR_FILENO, text, strlen(text));
+    (void)unused;
+}
+
+static void guard_report(const void *addr)
+{
+    char line[256];
+    size_t page = ((const char *)addr - guard_region) / guard_page_size;
+    guard_slot_t *slot = NULL;
+    const char *kind;
+
+    if (page % 2 == 1) {
+        // A data page faulted, so it was not live: the access came after mem_free
+        slot = &guard_slots[(page - 1) / 2];
+        kind = slot->state == GUARD_SLOT_FREED ? "use-after-free" : "wild access to an unused slot";
+    } else {
+        // A guard page faulted: blame the nearest live neighbour
+        guard_slot_t *left = page > 0 ? &guard_slots[page / 2 - 1] : NULL;
+        guard_slot_t *right = page / 2 < guard_num_slots ? &guard_slots[page / 2] : NULL;
+        if (left != NULL && left->state != GUARD_SLOT_EMPTY) {
+            slot = left;
+            kind = "heap-buffer-overflow";
+        } else if (right != NULL && right->state != GUARD_SLOT_EMPTY) {
+            slot = right;
+            kind = "heap-buffer-underflow";
+        } else {
+            kind = "wild access to a guard page";
+        }
+    }
+
+    snprintf(line, sizeof(line), "\n*** mem_guard: %s at %p ***\n", kind, addr);
+    guard_write(line);
+    if (slot == NULL || slot->state == GUARD_SLOT_EMPTY) {
+        return;
+    }
+
+    snprintf(line, sizeof(line), "Block of %zu bytes at %p, access is %td bytes from its start.\n",
+             slot->size, slot->ptr, (const char *)addr - (const char *)slot->ptr);
+    guard_write(line);
+    guard_write("Allocated at:\n");
+    backtrace_symbols_fd(slot->alloc_trace, slot->alloc_depth, STDERR_FILENO);
+    if (slot->state == GUARD_SLOT_FREED) {
+        guard_write("Freed by:\n");
+        backtrace_symbols_fd(&slot->free_caller, 1, STDERR_FILENO);
+    }
+}
+
+static void guard_fault_handler(int sig, siginfo_t *info, void *context)
+{
+    if (guard_owns(info->si_addr)) {
+        guard_report(info->si_addr);
+    }
+
+    // Hand the fault back to the previous handler; returning re-executes the faulting access
+    sigaction(SIGSEGV, &guard_old_action, NULL);
+    (void)sig;
+    (void)context;
+}
+
+static void *guard_alloc(size_t size)
+{
+    if (size > guard_page_size) {
+        return NULL;  // Only page-sized allocations fit in a slot
+    }
+
+    pthread_mutex_lock(&guard_lock);
+
+    if (guard_region == NULL || guard_free_count == 0) {
+        pthread_mutex_unlock(&guard_lock);
+        return NULL;  // Every slot is live, fall back to the pool
+    }
+
+    size_t index = guard_free_ring[guard_free_head];
+    guard_free_head = (guard_free_head + 1) % guard_num_slots;
+    guard_free_count--;
+
+    guard_slot_t *slot = &guard_slots[index];
+    char *page = guard_slot_page(index);
+    mprotect(page, guard_page_size, PROT_READ | PROT_WRITE);
+
+    // Right-align the block so an overflow runs straight into the next guard page
+    uintptr_t end = (uintptr_t)page + guard_page_size;
+    slot->ptr = (void *)((end - size) & ~(uintptr_t)(sizeof(size_t) - 1));
+    slot->size = size;
+    slot->state = GUARD_SLOT_LIVE;
+    slot->alloc_depth = backtrace(slot->alloc_trace, GUARD_MAX_FRAMES);
+    slot->free_caller = NULL;
+
+    pthread_mutex_unlock(&guard_lock);
+    return slot->ptr;
+}
+
+static void guard_free(void *block, void *caller)
+{
+    pthread_mutex_lock(&guard_lock);
+
+    size_t page = ((char *)block - guard_region) / guard_page_size;
+    guard_slot_t *slot = page % 2 == 1 ? &guard_slots[(page - 1) / 2] : NULL;
+
+    if (slot == NULL || slot->state != GUARD_SLOT_LIVE || slot->ptr != block) {
+        pthread_mutex_unlock(&guard_lock);
+        fprintf(stderr, "\n*** mem_guard: invalid or double free of %p ***\n", block);
+        abort();
+    }
+
+    slot->state = GUARD_SLOT_FREED;
+    slot->free_caller = caller;
+    mprotect(guard_slot_page((page - 1) / 2), guard_page_size, PROT_NONE);
+
+    // Queue the slot at the back so freed pages stay protected for as long as possible
+    guard_free_ring[(guard_free_head + guard_free_count) % guard_num_slots] = (page - 1) / 2;
+    guard_free_count++;
+
+    pthread_mutex_unlock(&guard_lock);
+}
+
+// Drops every guarded allocation, used when the pool they belong to goes away
+static void guard_release_all(void)
+{
+    pthread_mutex_lock(&guard_lock);
+    if (guard_region != NULL) {
+        mprotect(guard_region, guard_region_size, PROT_NONE);
+        for (size_t i = 0; i < guard_num_slots; i++) {
+            guard_slots[i].state = GUARD_SLOT_EMPTY;
+            guard_free_ring[i] = i;
+        }
+        guard_free_head = 0;
+        guard_free_count = guard_num_slots;
+    }
+    pthread_mutex_unlock(&guard_lock);
+}
+
+// Number of pages lying entirely inside the payload of a block
+static size_t block_whole_pages(void *header, size_t size)
+{
+    if (pool_page_size == 0) {
+        return 0;  // File-backed and shared pools are never purged
+    }
+    uintptr_t start = ((uintptr_t)header + sizeof(size_t) + pool_page_size - 1) & ~(pool_page_size - 1);
+    uintptr_t end = ((uintptr_t)header + sizeof(size_t) + size) & ~(pool_page_size - 1);
+    return end > start ? (end - start) / pool_page_size : 0;
+}
+
+static void defer_release(void);
+
+// Returns non-zero if the pool lock looks held, for the contention count of mem_stat_publish
+static int pool_lock_busy(void)
+{
+    switch (pool_lock_kind) {
+    case MEM_LOCK_TICKET:
+        return __atomic_load_n(&pool_ticket_lock.next, __ATOMIC_RELAXED) != __atomic_load_n(&pool_ticket_lock.serving, __ATOMIC_RELAXED);
+    case MEM_LOCK_MCS:
+        return __atomic_load_n(&pool_mcs_lock.tail, __ATOMIC_RELAXED) != NULL;
+    case MEM_LOCK_ADAPTIVE:
+        return __atomic_load_n(&pool_futex_lock.state, __ATOMIC_RELAXED) != 0;
+    }
+    return 0;
+}
+
+static void pool_lock(void)
+{
+    int stats = __builtin_expect(mem_hooks & MEM_HOOK_STATS, 0);
+    int contended = stats && pool_lock_kind != MEM_LOCK_PTHREAD ? pool_lock_busy() : 0;
+
+    switch (pool_lock_kind) {
+    case MEM_LOCK_TICKET:
+        mem_ticket_lock(&pool_ticket_lock);
+        break;
+    case MEM_LOCK_MCS:
+        mem_mcs_lock(&pool_mcs_lock, &pool_mcs_node);
+        break;
+    case MEM_LOCK_ADAPTIVE:
+        mem_futex_lock(&pool_futex_lock);
+        break;
+    default: {
+        int result = EBUSY;
+        if (stats) {
+            result = pthread_mutex_trylock(pool_mutex);
+            contended = result == EBUSY;
+        }
+        if (result == EBUSY) {
+            result = pthread_mutex_lock(pool_mutex);
+        }
+        if (result == EOWNERDEAD) {
+            // A process died holding the lock of a shared pool. Every header update is a
+            // single store, so the blocks are consistent; only the hint may be too high.
+            *pool_first_free = 0;
+            memset(pool_class_first_free, 0, HINT_CLASSES * sizeof(size_t));
+            pthread_mutex_consistent(pool_mutex);
+        }
+        break;
+    }
+    }
+
+    if (stats) {
+        // Plain counts, the lock is held
+        __atomic_store_n(&pool_lock_acquisitions, pool_lock_acquisitions + 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&pool_lock_contended, pool_lock_contended + contended, __ATOMIC_RELAXED);
+    }
+    if (defer_buffer.count != 0) {
+        defer_release();  // The lock is held anyway, so the thread's deferred frees cost nothing extra
+    }
+}
+
+static void pool_unlock(void)
+{
+    switch (pool_lock_kind) {
+    case MEM_LOCK_TICKET:
+        mem_ticket_unlock(&pool_ticket_lock);
+        return;
+    case MEM_LOCK_MCS:
+        mem_mcs_unlock(&pool_mcs_lock, &pool_mcs_node);
+        return;
+    case MEM_LOCK_ADAPTIVE:
+        mem_futex_unlock(&pool_futex_lock);
+        return;
+    }
+    pthread_mutex_unlock(pool_mutex);
+}
+
+int mem_lock_select(int kind)
+{
+    if (kind < MEM_LOCK_PTHREAD || kind > MEM_LOCK_ADAPTIVE || memory_pool != NULL) {
+        return -1;  // Unknown kind, or a pool is live and its lock may be held
+    }
+    pool_lock_selected = kind;
+    return 0;
+}
+
+int mem_layout_select(int layout)
+{
+    if (layout < MEM_LAYOUT_INLINE || layout > MEM_LAYOUT_INDEXED || memory_pool != NULL) {
+        return -1;
+    }
+    pool_layout_selected = layout;
+    return 0;
+}
+
+int mem_small_select(size_t region_size)
+{
+    if (memory_pool != NULL) {
+        return -1;
+    }
+    pool_small_selected = region_size;
+    return 0;
+}
+
+// The index of an indexed pool follows every plain free block that appears or goes away
+static void pool_index_set(size_t offset)
+{
+    if (pool_free_index != NULL) {
+        size_t bit = offset / sizeof(size_t);
+        pool_free_index[bit / 64] |= (uint64_t)1 << (bit % 64);
+    }
+}
+
+static void pool_index_clear(size_t offset)
+{
+    if (pool_free_index != NULL) {
+        size_t bit = offset / sizeof(size_t);
+        pool_free_index[bit / 64] &= ~((uint64_t)1 << (bit % 64));
+    }
+}
+
+// Clears the bits of [from, to), which may be stale after mem_reset or mem_restore
+static void pool_index_clear_range(size_t from, size_t to)
+{
+    if (pool_free_index == NULL) {
+        return;
+    }
+    size_t bit = from / sizeof(size_t), end = to / sizeof(size_t);
+    for (; bit < end && bit % 64 != 0; bit++) {
+        pool_free_index[bit / 64] &= ~((uint64_t)1 << (bit % 64));
+    }
+    for (; bit + 64 <= end; bit += 64) {
+        pool_free_index[bit / 64] = 0;
+    }
+    for (; bit < end; bit++) {
+        pool_free_index[bit / 64] &= ~((uint64_t)1 << (bit % 64));
+    }
+}
+
+void mem_pool_lock_counts(uint64_t *acquisitions, uint64_t *contended)
+{
+    *acquisitions = __atomic_load_n(&pool_lock_acquisitions, __ATOMIC_RELAXED);
+    *contended = __atomic_load_n(&pool_lock_contended, __ATOMIC_RELAXED);
+}
+
+void mem_hooks_set(unsigned int bits)
+{
+    __atomic_fetch_or(&mem_hooks, bits, __ATOMIC_SEQ_CST);
+}
+
+void mem_hooks_clear(unsigned int bits)
+{
+    __atomic_fetch_and(&mem_hooks, ~bits, __ATOMIC_SEQ_CST);
+}
+
+// Size class tables, generated from MEM_SIZE_CLASSES with GCC range designators
+#define SIZE_CLASS_RANGE(index, size, previous) [(previous) / 8 + 1 ... (size) / 8] = index,
+#define SIZE_CLASS_SIZE(index, size, previous) [index] = size,
+#define SIZE_CLASS_COUNT(index, size, previous) +1
+
+_Static_assert(0 MEM_SIZE_CLASSES(SIZE_CLASS_COUNT) == MEM_SIZE_CLASS_SMALL, "MEM_SIZE_CLASS_SMALL is out of date");
+
+const uint8_t mem_size_class_table[MEM_SIZE_CLASS_SMALL_MAX / 8 + 1] = {MEM_SIZE_CLASSES(SIZE_CLASS_RANGE)};
+const uint16_t mem_size_class_sizes[MEM_SIZE_CLASS_SMALL] = {MEM_SIZE_CLASSES(SIZE_CLASS_SIZE)};
+
+size_t mem_size_class(size_t size)
+{
+    return mem_size_class_inline(size);
+}
+
+size_t mem_size_class_size(size_t size_class)
+{
+    return mem_size_class_size_inline(size_class);
+}
+
+// Returns the payload size of a block handed out by mem_alloc
+static size_t block_payload_size(void *block)
+{
+    if (guard_owns(block)) {
+        return guard_slots[((char *)block - guard_region) / guard_page_size / 2].size;
+    }
+    if (mem_small_owns(block)) {
+        return mem_small_size(block);
+    }
+    size_t header = *(size_t *)((char *)block - sizeof(size_t));
+    return (header & ~BLOCK_FLAGS) - (header & BLOCK_TRAILER ? sizeof(size_t) : 0);
+}
 
 // Initialization function
 void mem_init(size_t size)
 {
-    // Use mmap instead of malloc
-    memory_pool = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    
-    if (memory_pool == MAP_FAILED) {
-        perror("Memory allocation failed");
-        exit(EXIT_FAILURE);  // Exit if allocation failed
+    // Use mmap instead of malloc
+    memory_pool = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    
+    if (memory_pool == MAP_FAILED) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);  // Exit if allocation failed
+    }
+
+    pool_size = size;  // Set the total size of the pool
+    pool_serial++;
+    pool_defer_generation++;
+    *pool_first_free = 0;
+    memset(pool_class_first_free, 0, HINT_CLASSES * sizeof(size_t));
+    pool_hinted = 0;
+    pool_lock_kind = pool_lock_selected;
+    pool_page_size = (size_t)sysconf(_SC_PAGESIZE);
+    pool_dirty_pages = 0;
+    pool_tail = 0;
+    // Fresh anonymous pages are already zero; writing them would commit the whole pool
+
+    if (pool_layout_selected == MEM_LAYOUT_INDEXED) {
+        pool_free_index_words = (size / sizeof(size_t) + 63) / 64;
+        pool_free_index = mmap(NULL, pool_free_index_words * sizeof(uint64_t), PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (pool_free_index == MAP_FAILED) {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (mem_small_setup(pool_small_selected) != 0) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+int mem_init_file(const char *path, size_t size)
+{
+    int fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    pool_file_header_t header;
+    int result = MEM_FILE_CREATED;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    if (st.st_size > 0) {
+        // An existing pool keeps the size it was created with
+        if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) || header.magic != POOL_FILE_MAGIC ||
+            header.version != POOL_FILE_VERSION || (uint64_t)st.st_size != sizeof(header) + header.pool_size) {
+            close(fd);
+            return -1;  // Not a pool file, leave it alone
+        }
+        result = MEM_FILE_REOPENED;
+    } else {
+        if (size == 0 || ftruncate(fd, sizeof(header) + size) != 0) {
+            close(fd);
+            return -1;
+        }
+        // ftruncate zero-fills, which is an empty pool
+        memset(&header, 0, sizeof(header));
+        header.magic = POOL_FILE_MAGIC;
+        header.version = POOL_FILE_VERSION;
+        header.pool_size = size;
+    }
+
+    // Ask for the previous address so raw pointers stored in the pool stay valid
+    size_t map_size = sizeof(header) + header.pool_size;
+    void *map = MAP_FAILED;
+    if (result == MEM_FILE_REOPENED && header.base != 0) {
+        map = mmap((void *)(uintptr_t)(header.base - sizeof(header)), map_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);  // The mapping keeps the file open
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    pool_file = (pool_file_header_t *)map;
+    pool_lock_kind = pool_lock_selected;
+    memory_pool = (char *)map + sizeof(header);
+    pool_size = header.pool_size;
+    pool_serial++;
+    pool_defer_generation++;
+    *pool_first_free = 0;
+    memset(pool_class_first_free, 0, HINT_CLASSES * sizeof(size_t));
+    pool_hinted = 1;  // The file may hold blocks of any class
+
+    if (result == MEM_FILE_CREATED) {
+        *pool_file = header;
+    } else if (pool_file->base != (uint64_t)(uintptr_t)memory_pool) {
+        result = MEM_FILE_MOVED;
+    }
+    pool_file->base = (uint64_t)(uintptr_t)memory_pool;
+    return result;
+}
+
+int mem_init_shared(const char *name, size_t size)
+{
+    int created = 1;
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        created = 0;
+        fd = shm_open(name, O_RDWR, 0600);
+    }
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    size_t map_size;
+    if (created) {
+        map_size = sizeof(pool_shm_header_t) + size;
+        if (size == 0 || ftruncate(fd, map_size) != 0) {
+            close(fd);
+            shm_unlink(name);
+            return -1;
+        }
+    } else {
+        // The creator sizes the object right after creating it
+        int tries = 0;
+        while (fstat(fd, &st) == 0 && (size_t)st.st_size < sizeof(pool_shm_header_t) && tries++ < POOL_SHM_WAIT) {
+            sched_yield();
+        }
+        if ((size_t)st.st_size < sizeof(pool_shm_header_t)) {
+            close(fd);
+            return -1;
+        }
+        map_size = st.st_size;
+    }
+
+    pool_shm_header_t *header = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (header == MAP_FAILED) {
+        if (created) {
+            shm_unlink(name);
+        }
+        return -1;
+    }
+
+    if (created) {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&header->lock, &attr);
+        pthread_mutexattr_destroy(&attr);
+        header->pool_size = size;
+        header->first_free = 0;
+        memset(header->class_first_free, 0, sizeof(header->class_first_free));
+        __atomic_store_n(&header->magic, POOL_SHM_MAGIC, __ATOMIC_RELEASE);
+    } else {
+        int tries = 0;
+        while (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != POOL_SHM_MAGIC && tries++ < POOL_SHM_WAIT) {
+            sched_yield();  // The creator is still setting up the mutex
+        }
+        if (header->magic != POOL_SHM_MAGIC || sizeof(pool_shm_header_t) + header->pool_size != map_size) {
+            munmap(header, map_size);
+            return -1;  // Not a pool, or its creator died before finishing
+        }
+    }
+
+    pool_shm = header;
+    pool_lock_kind = MEM_LOCK_PTHREAD;  // Only the robust mutex survives a dead holder
+    pool_mutex = &header->lock;
+    pool_first_free = &header->first_free;
+    pool_class_first_free = header->class_first_free;
+    pool_hinted = 1;  // Other processes may allocate hinted blocks
+    memory_pool = (char *)header + sizeof(pool_shm_header_t);
+    pool_size = header->pool_size;
+    pool_serial++;
+    pool_defer_generation++;
+    return created ? MEM_FILE_CREATED : MEM_FILE_REOPENED;
+}
+
+int mem_set_root(void *block)
+{
+    if (pool_file == NULL) {
+        return -1;
+    }
+    __atomic_store_n(&pool_file->root, block != NULL ? mem_offset_of(block) + 1 : 0, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void *mem_get_root(void)
+{
+    if (pool_file == NULL) {
+        return NULL;
+    }
+    uint64_t root = __atomic_load_n(&pool_file->root, __ATOMIC_ACQUIRE);
+    return root != 0 ? mem_at_offset(root - 1) : NULL;
+}
+
+size_t mem_offset_of(const void *block)
+{
+    return (const char *)block - (const char *)memory_pool;
+}
+
+void *mem_at_offset(size_t offset)
+{
+    return (char *)memory_pool + offset;
+}
+
+// Keeps pool_dirty_pages in step when the header of a free block changes
+static void block_forget_dirty(char *header, size_t value)
+{
+    if ((value & BLOCK_FREE) && !(value & BLOCK_PURGED)) {
+        pool_dirty_pages -= block_whole_pages(header, value & ~BLOCK_FLAGS);
+    }
+}
+
+static void block_count_dirty(char *header, size_t value)
+{
+    if ((value & BLOCK_FREE) && !(value & BLOCK_PURGED)) {
+        pool_dirty_pages += block_whole_pages(header, value & ~BLOCK_FLAGS);
+    }
+}
+
+// The untouched tail moved from offset to next: hints that pointed at it follow, since
+// no block between the two is free
+static void pool_tail_advanced(size_t offset, size_t next)
+{
+    // After mem_reset or mem_restore the space past the tail holds stale headers and
+    // index bits; a zero header ends every walk at the new tail
+    size_t *end = (size_t*)((char*)memory_pool + next);
+    if (next + sizeof(size_t) <= pool_size && *end != 0) {
+        *end = 0;  // Only written when needed, so untouched pages stay unmapped
+    }
+    pool_index_clear_range(offset, next);
+    pool_tail = next;
+    if (*pool_first_free == offset) {
+        *pool_first_free = next;
+    }
+    for (int i = 0; i < HINT_CLASSES; i++) {
+        if (pool_class_first_free[i] == offset) {
+            pool_class_first_free[i] = next;
+        }
+    }
+}
+
+// Merges the free blocks of the same lifetime class that follow the free block at
+// offset into it and returns its new header. Untagged blocks are never merged.
+static size_t block_merge_following(size_t offset, size_t header)
+{
+    char *current = (char*)memory_pool + offset;
+    size_t block_size = header & ~BLOCK_FLAGS;
+    size_t purged = header & BLOCK_PURGED;
+    size_t next = offset + sizeof(size_t) + block_size;
+    int merged = 0;
+
+    while (next + sizeof(size_t) <= pool_size) {
+        size_t next_header = *(size_t*)((char*)memory_pool + next);
+        size_t next_size = next_header & ~BLOCK_FLAGS;
+        if (next_size == 0 || !(next_header & BLOCK_FREE) || (next_header & BLOCK_CLASS) != (header & BLOCK_CLASS)) {
+            break;
+        }
+        if (!merged) {
+            block_forget_dirty(current, header);
+            merged = 1;
+        }
+        block_forget_dirty((char*)memory_pool + next, next_header);
+        purged &= next_header;  // Partly purged blocks count as dirty, purging them again is harmless
+        block_size += sizeof(size_t) + next_size;
+        next += sizeof(size_t) + next_size;
+    }
+
+    if (merged) {
+        header = block_size | BLOCK_FREE | purged | (header & BLOCK_CLASS);
+        *(size_t*)current = header;
+        block_count_dirty(current, header);
+        pool_layout_generation++;  // Offsets kept across calls may now point into a block
+    }
+    return header;
+}
+
+// Hands out the free block at offset, splitting off what a tagged block does not need
+static void* block_take(size_t offset, size_t header, size_t size)
+{
+    char *current = (char*)memory_pool + offset;
+    size_t block_size = header & ~BLOCK_FLAGS;
+    size_t tag = header & BLOCK_CLASS;
+
+    block_forget_dirty(current, header);
+    pool_index_clear(offset);
+    if (tag != 0 && block_size >= size + sizeof(size_t) + HINT_MIN_SPLIT) {
+        char *rest = current + sizeof(size_t) + size;
+        size_t rest_header = (block_size - size - sizeof(size_t)) | BLOCK_FREE | tag | (header & BLOCK_PURGED);
+        *(size_t*)rest = rest_header;
+        block_count_dirty(rest, rest_header);
+        block_size = size;
+    }
+    *(size_t*)current = block_size | tag;
+    return current + sizeof(size_t);
+}
+
+// First fit within one lifetime class; claims a new run from the untouched tail if none
+// of the class's free blocks is large enough
+static void* pool_alloc_class(size_t size, int hint)
+{
+    size_t tag = (size_t)hint << BLOCK_CLASS_SHIFT;
+    size_t *class_first_free = &pool_class_first_free[hint - 1];
+    size_t offset = *class_first_free;
+    size_t first_skipped = SIZE_MAX;
+
+    while (offset + sizeof(size_t) <= pool_size) {
+        char *current = (char*)memory_pool + offset;
+        size_t header = *(size_t*)current;
+        size_t block_size = header & ~BLOCK_FLAGS;
+
+        if (block_size == 0) {
+            size_t left = pool_size - offset - sizeof(size_t);
+            if (left < size) {
+                break;
+            }
+            size_t run = size > HINT_RUN_SIZE - sizeof(size_t) ? size : HINT_RUN_SIZE - sizeof(size_t);
+            if (run + sizeof(size_t) > left) {
+                run = left;  // Too little would be left for another block
+            }
+            // Untouched pages are not resident yet, which is what purged means
+            header = run | BLOCK_FREE | BLOCK_PURGED | tag;
+            *(size_t*)current = header;
+            pool_hinted = 1;
+            pool_tail_advanced(offset, offset + sizeof(size_t) + run);
+        }
+
+        if ((header & BLOCK_FREE) && (header & BLOCK_CLASS) == tag) {
+            header = block_merge_following(offset, header);
+            block_size = header & ~BLOCK_FLAGS;
+            if (block_size >= size) {
+                void *block = block_take(offset, header, size);
+                *class_first_free = first_skipped != SIZE_MAX ? first_skipped
+                                                              : offset + sizeof(size_t) + (*(size_t*)current & ~BLOCK_FLAGS);
+                return block;
+            }
+            if (first_skipped == SIZE_MAX) {
+                first_skipped = offset;
+            }
+        }
+        offset += block_size + sizeof(size_t);
+    }
+
+    *class_first_free = first_skipped != SIZE_MAX ? first_skipped : offset;
+    return NULL;
+}
+
+// Last resort once the untouched space is used up: any free block that fits, whatever
+// its class. Walks the whole pool, so it only runs when the pool is nearly full.
+static void* pool_alloc_anywhere(size_t size)
+{
+    size_t offset = 0;
+    while (offset + sizeof(size_t) <= pool_size) {
+        size_t header = *(size_t*)((char*)memory_pool + offset);
+        size_t block_size = header & ~BLOCK_FLAGS;
+        if (block_size == 0) {
+            break;
+        }
+        if (header & BLOCK_FREE) {
+            if (header & BLOCK_CLASS) {
+                header = block_merge_following(offset, header);
+                block_size = header & ~BLOCK_FLAGS;
+            }
+            if (block_size >= size) {
+                return block_take(offset, header, size);
+            }
+        }
+        offset += block_size + sizeof(size_t);
+    }
+    return NULL;
+}
+
+// First fit for indexed pools. Only the bitmap and the headers of free blocks are
+// read; blocks in use are skipped without touching them. Runs with the lock held.
+static void* pool_alloc_indexed(size_t size)
+{
+    size = (size + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1);  // Keeps every header on a bitmap bit
+    size_t first_skipped = SIZE_MAX;
+    size_t bit = *pool_first_free / sizeof(size_t);
+    size_t end_word = (pool_tail / sizeof(size_t) + 63) / 64;  // No free block starts past the tail
+    size_t word = bit / 64;
+    uint64_t pending = word < end_word ? pool_free_index[word] & (UINT64_MAX << (bit % 64)) : 0;
+
+    for (;;) {
+        while (pending == 0 && ++word < end_word) {
+            pending = pool_free_index[word];
+        }
+        if (pending == 0) {
+            break;
+        }
+        size_t offset = (word * 64 + __builtin_ctzll(pending)) * sizeof(size_t);
+        pending &= pending - 1;
+        if (offset >= pool_tail) {
+            break;  // A stale bit past the tail
+        }
+
+        char* current = (char*)memory_pool + offset;
+        size_t header = *(size_t*)current;
+        size_t block_size = header & ~BLOCK_FLAGS;
+        if ((header & (BLOCK_FREE | BLOCK_CLASS)) != BLOCK_FREE) {
+            continue;  // Being purged; mem_pool_purge lowers the hint again afterwards
+        }
+        if (block_size >= size) {
+            block_forget_dirty(current, header);
+            pool_index_clear(offset);
+            *(size_t*)current = block_size;
+            *pool_first_free = first_skipped != SIZE_MAX ? first_skipped : offset + block_size + sizeof(size_t);
+            return current + sizeof(size_t);
+        }
+        if (first_skipped == SIZE_MAX) {
+            first_skipped = offset;
+        }
+    }
+
+    size_t offset = pool_tail;
+    if (pool_size - offset >= size + sizeof(size_t)) {
+        *(size_t*)((char*)memory_pool + offset) = size;
+        *pool_first_free = first_skipped != SIZE_MAX ? first_skipped : offset + size + sizeof(size_t);
+        pool_tail_advanced(offset, offset + size + sizeof(size_t));
+        return (char*)memory_pool + offset + sizeof(size_t);
+    }
+    *pool_first_free = first_skipped != SIZE_MAX ? first_skipped : offset;
+    return pool_hinted ? pool_alloc_anywhere(size) : NULL;
+}
+
+// Allocates a block with a header from the pool itself
+static void* pool_alloc_block(size_t size)
+{
+    pool_lock();  // Lock for thread safety
+
+    // Ensure that size is not zero
+    if (size == 0 || size + sizeof(size_t) > pool_size) {
+        pool_unlock();
+        return NULL;  // Not enough space in the pool or zero size
+    }
+    if (pool_free_index != NULL) {
+        void* block = size <= pool_size - 2 * sizeof(size_t) ? pool_alloc_indexed(size) : NULL;
+        pool_unlock();
+        return block;
+    }
+
+    // Every block below the hint is in use, so first fit can start there
+    void* current_block = (char*)memory_pool + *pool_first_free;
+    size_t first_skipped = SIZE_MAX;  // Offset of the first free block that was too small
+
+    // Traverse through the pool to find a free block
+    while ((char*)current_block < (char*)memory_pool + pool_size) {
+        size_t offset = (char*)current_block - (char*)memory_pool;
+        size_t header = *(size_t*)current_block;
+        size_t block_size = header & ~BLOCK_FLAGS;  // Get the block size
+
+        // Check if the block is untouched space (block size is 0)
+        if (block_size == 0) { 
+            // Check if the remaining space is sufficient for the new block
+            if (pool_size - ((char*)current_block - (char*)memory_pool) >= size + sizeof(size_t)) {
+                // Mark block as allocated
+                *(size_t*)current_block = size;  // Set the size of the allocated block
+                *pool_first_free = first_skipped != SIZE_MAX ? first_skipped : offset + size + sizeof(size_t);
+                pool_tail_advanced(offset, offset + size + sizeof(size_t));
+                pool_unlock();  // Unlock after allocation
+                return (char*)current_block + sizeof(size_t);  // Return memory after size field
+            }
+            if (first_skipped == SIZE_MAX) {
+                first_skipped = offset;
+            }
+            break;  // Nothing has been allocated past this point
+        }
+
+        // Reuse a freed block if it is large enough; it keeps its original extent.
+        // Blocks of a lifetime class are left to mem_alloc_hint.
+        if ((header & (BLOCK_FREE | BLOCK_CLASS)) == BLOCK_FREE && block_size >= size) {
+            if (!(header & BLOCK_PURGED)) {
+                pool_dirty_pages -= block_whole_pages(current_block, block_size);
+            }
+            *(size_t*)current_block = block_size;  // Clear the free and purged flags
+            *pool_first_free = first_skipped != SIZE_MAX ? first_skipped : offset + block_size + sizeof(size_t);
+            pool_unlock();
+            return (char*)current_block + sizeof(size_t);
+        }
+        if ((header & (BLOCK_FREE | BLOCK_CLASS)) == BLOCK_FREE && first_skipped == SIZE_MAX) {
+            first_skipped = offset;
+        }
+
+        // Move to the next block in the pool
+        current_block = (char*)current_block + block_size + sizeof(size_t);
+    }
+
+    if (first_skipped != SIZE_MAX) {
+        *pool_first_free = first_skipped;
+    }
+    void* block = pool_hinted ? pool_alloc_anywhere(size) : NULL;
+    pool_unlock();  // Unlock if no free block found
+    return block;  // NULL if no free block found
+}
+
+static void* pool_alloc(size_t size)
+{
+    // Small requests go to pages of their size class while those have room;
+    // size - 1 wraps for 0, which pool_alloc_block turns down
+    if (size - 1 < mem_small_limit) {
+        pool_lock();
+        void* object = mem_small_alloc(size);
+        pool_unlock();
+        if (object != NULL) {
+            return object;
+        }
+    }
+    return pool_alloc_block(size);
+}
+
+static void* pool_alloc_hinted(size_t size, int hint, void* caller)
+{
+    if (size == 0 || size + 2 * sizeof(size_t) > pool_size) {
+        return NULL;  // Also keeps the rounding below from overflowing
+    }
+    // Whole words keep the headers of split blocks aligned
+    size = (size + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1);
+    size_t trailer = 0;
+
+    pool_lock();
+
+    if (hint == MEM_HINT_AUTO) {
+        // Sites are known by their address, which means nothing to other processes
+        if (pool_shm == NULL) {
+            trailer = mem_lifetime_on_alloc(caller, &hint);
+        } else {
+            hint = MEM_HINT_LONG;
+        }
+        if (trailer != 0) {
+            size += sizeof(size_t);
+        }
+    }
+
+    void* block = pool_alloc_class(size, hint);
+    if (block == NULL) {
+        block = pool_alloc_anywhere(size);
+    }
+    if (block != NULL && trailer != 0) {
+        size_t* header = (size_t*)block - 1;
+        *header |= BLOCK_TRAILER;
+        *(size_t*)((char*)block + (*header & ~BLOCK_FLAGS) - sizeof(size_t)) = trailer;
+    }
+
+    pool_unlock();
+    return block;
+}
+
+// Slow path of mem_alloc, taken only while guard sampling or profiling is enabled
+static __attribute__((noinline)) void* mem_alloc_hooked(size_t size, void* caller)
+{
+    unsigned int hooks = mem_hooks;
+    unsigned int rate = guard_sample_rate;
+    void* block = NULL;
+
+    // Sampled allocations bypass the pool entirely, so blocks of a shared pool are never
+    // sampled: the guard region is private to this process. The countdown is re-armed
+    // regardless, which lets mem_alloc stay on its fast path until the next sample.
+    if ((hooks & MEM_HOOK_GUARD_SAMPLE) && rate != 0 && guard_should_sample(rate) && size != 0 && pool_shm == NULL) {
+        block = guard_alloc(size);
+    }
+    if (block == NULL) {
+        block = pool_alloc(size);
+    }
+    if ((hooks & MEM_HOOK_PROFILE) && block != NULL) {
+        mem_prof_on_alloc(block, size, caller);
+    }
+    if (hooks & MEM_HOOK_STATS) {
+        mem_stat_on_alloc(block == NULL);
+    }
+    return block;
+}
+
+void* mem_alloc(size_t size)
+{
+#ifdef MEM_LATENCY_HIST
+    uint64_t start = mem_latency_now();
+#endif
+    void* block;
+    unsigned int hooks = mem_hooks;
+    if (__builtin_expect(hooks & MEM_HOOKS_ALLOC, 0)) {
+        // With guard sampling the only hook, allocations between samples just count down
+        unsigned int countdown = guard_countdown;
+        if ((hooks & MEM_HOOKS_ALLOC) == MEM_HOOK_GUARD_SAMPLE && countdown > 1) {
+            guard_countdown = countdown - 1;
+            block = pool_alloc(size);
+        } else {
+            block = mem_alloc_hooked(size, __builtin_return_address(0));
+        }
+    } else {
+        block = pool_alloc(size);
+    }
+#ifdef MEM_LATENCY_HIST
+    mem_latency_record(MEM_LATENCY_ALLOC, size, mem_latency_now() - start);
+#endif
+    return block;
+}
+
+void* mem_alloc_hint(size_t size, int hint)
+{
+    void* caller = __builtin_return_address(0);
+    void* block;
+
+    if (hint >= MEM_HINT_SHORT && hint <= MEM_HINT_AUTO) {
+        block = pool_alloc_hinted(size, hint, caller);
+    } else {
+        block = pool_alloc(size);
+    }
+    if (__builtin_expect(mem_hooks & (MEM_HOOK_PROFILE | MEM_HOOK_STATS), 0)) {
+        if ((mem_hooks & MEM_HOOK_PROFILE) && block != NULL) {
+            mem_prof_on_alloc(block, size, caller);
+        }
+        if (mem_hooks & MEM_HOOK_STATS) {
+            mem_stat_on_alloc(block == NULL);
+        }
+    }
+    return block;
+}
+
+static void block_release(void* block);
+static void defer_free(void* block);
+
+// Deallocation function
+static void pool_free(void* block, void* caller)
+{
+    if (block == NULL) {
+        return;  // Do nothing if the block is null
+    }
+
+    unsigned int hooks = mem_hooks;
+    if (__builtin_expect(hooks & MEM_HOOKS_FREE, 0)) {
+        if (hooks & MEM_HOOK_PROFILE) {
+            mem_prof_on_free(block);
+        }
+        if (hooks & MEM_HOOK_STATS) {
+            mem_stat_on_free();
+        }
+        if (guard_owns(block)) {
+            guard_free(block, caller);  // Sampled block, protect its page again
+            return;
+        }
+    }
+
+    if (defer_batch != 0 && (mem_small_owns(block) || !(*((size_t*)block - 1) & (BLOCK_TRAILER | BLOCK_HANDLE)))) {
+        defer_free(block);
+        return;
+    }
+
+    pool_lock();  // Lock for thread safety
+    block_release(block);
+    pool_unlock();  // Unlock after freeing
+}
+
+void mem_free(void* block)
+{
+#ifdef MEM_LATENCY_HIST
+    if (block != NULL) {
+        size_t size = block_payload_size(block);
+        uint64_t start = mem_latency_now();
+        pool_free(block, __builtin_return_address(0));
+        mem_latency_record(MEM_LATENCY_FREE, size, mem_latency_now() - start);
+        return;
+    }
+#endif
+    pool_free(block, __builtin_return_address(0));
+}
+
+// Returns a block to the pool. Runs under the pool lock.
+static void block_release(void* block)
+{
+    if (mem_small_owns(block)) {
+        mem_small_free(block);  // Small objects have no header; their page knows their size
+        return;
+    }
+    // Flag the block as free, keeping its size so the pool can still be walked past it
+    size_t* block_size_ptr = (size_t*)((char*)block - sizeof(size_t));
+    size_t header = *block_size_ptr;
+    if (header & BLOCK_TRAILER) {
+        mem_lifetime_on_free(*(size_t*)((char*)block + (header & ~BLOCK_FLAGS) - sizeof(size_t)));
     }
+    header &= ~(BLOCK_TRAILER | BLOCK_HANDLE);
+    *block_size_ptr = header | BLOCK_FREE;  // Mark the block as free
+    pool_dirty_pages += block_whole_pages(block_size_ptr, header & ~BLOCK_FLAGS);
 
-    pool_size = size;  // Set the total size of the pool
-    memset(memory_pool, 0, pool_size);  // Initialize memory to zero
+    // Lower the hint of the block's lifetime class, or the one of mem_alloc
+    size_t offset = (char*)block_size_ptr - (char*)memory_pool;
+    size_t* first_free = header & BLOCK_CLASS ? &pool_class_first_free[(header >> BLOCK_CLASS_SHIFT & 3) - 1] : pool_first_free;
+    if (offset < *first_free) {
+        *first_free = offset;
+    }
+    if (!(header & BLOCK_CLASS)) {
+        pool_index_set(offset);
+    }
 }
 
-void* mem_alloc(size_t size)
+// Releases the blocks the calling thread deferred. Runs under the pool lock.
+static void defer_release(void)
 {
-    pthread_mutex_lock(&mem_lock);  // Lock for thread safety
-
-    // Ensure that size is not zero
-    if (size == 0 || size + sizeof(size_t) > pool_size) {
-        pthread_mutex_unlock(&mem_lock);
-        return NULL;  // Not enough space in the pool or zero size
+    defer_buffer_t *buffer = &defer_buffer;
+    if (buffer->generation == pool_defer_generation && memory_pool != NULL) {
+        for (size_t i = 0; i < buffer->count; i++) {
+            block_release(buffer->blocks[i]);
+        }
     }
+    buffer->count = 0;
+}
 
-    void* current_block = memory_pool;  // Start at the beginning of the pool
+static void defer_thread_exit(void *unused)
+{
+    (void)unused;
+    mem_flush();
+}
 
-    // Traverse through the pool to find a free block
-    while ((char*)current_block < (char*)memory_pool + pool_size) {
-        size_t block_size = *(size_t*)current_block;  // Get the block size
+static void defer_key_create(void)
+{
+    pthread_key_create(&defer_key, defer_thread_exit);
+}
 
-        // Check if the block is free (block size is 0)
-        if (block_size == 0) { 
-            // Check if the remaining space is sufficient for the new block
-            if (pool_size - ((char*)current_block - (char*)memory_pool) >= size + sizeof(size_t)) {
-                // Mark block as allocated
-                *(size_t*)current_block = size;  // Set the size of the allocated block
-                pthread_mutex_unlock(&mem_lock);  // Unlock after allocation
-                return (char*)current_block + sizeof(size_t);  // Return memory after size field
-            }
+static void defer_free(void* block)
+{
+    defer_buffer_t *buffer = &defer_buffer;
+    if (buffer->count != 0 && buffer->generation != pool_defer_generation) {
+        buffer->count = 0;  // Collected from a pool that is gone or was reset
+    }
+    if (buffer->count == 0) {
+        buffer->generation = pool_defer_generation;
+        if (!buffer->registered) {
+            // Any value but NULL makes the destructor run when the thread exits
+            pthread_once(&defer_once, defer_key_create);
+            pthread_setspecific(defer_key, buffer);
+            buffer->registered = 1;
         }
-
-        // Move to the next block in the pool
-        current_block = (char*)current_block + block_size + sizeof(size_t);
     }
+    buffer->blocks[buffer->count++] = block;
+    if (buffer->count >= defer_batch) {
+        mem_flush();
+    }
+}
 
-    pthread_mutex_unlock(&mem_lock);  // Unlock if no free block found
-    return NULL;  // No free block found
+void mem_flush(void)
+{
+    if (defer_buffer.count != 0) {
+        pool_lock();  // Releases the buffer
+        pool_unlock();
+    }
 }
 
+int mem_free_batch(size_t count)
+{
+    if (count > MEM_FREE_BATCH_MAX) {
+        return -1;
+    }
+    defer_batch = count;
+    return 0;
+}
 
-// Deallocation function
-void mem_free(void* block)
+// Grows the plain block at offset in place to want bytes, or to as many as there are
+// but at least need, by taking in the free blocks and the untouched space behind it.
+// A large free block taken in is split so the block ends near want. Returns the new
+// payload size, or 0 if need does not fit. Runs under the pool lock.
+static size_t block_grow(size_t offset, size_t need, size_t want)
 {
-    if (block == NULL) {
-        return;  // Do nothing if the block is null
+    char *current = (char*)memory_pool + offset;
+    size_t header = *(size_t*)current;
+    if (header & BLOCK_FLAGS) {
+        return 0;  // Tagged, trailer and handle blocks keep their extent
+    }
+    if (pool_free_index != NULL) {
+        need = (need + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1);
+        want = (want + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1);
     }
 
-    pthread_mutex_lock(&mem_lock);  // Lock for thread safety
+    // Find how far the block can reach without moving anything
+    size_t start = offset + sizeof(size_t) + header;
+    size_t end = start, tail = SIZE_MAX;
+    while (end - offset - sizeof(size_t) < want && end + sizeof(size_t) <= pool_size) {
+        size_t next_header = *(size_t*)((char*)memory_pool + end);
+        size_t next_size = next_header & ~BLOCK_FLAGS;
+        if (next_size == 0) {
+            tail = end;
+            break;
+        }
+        if ((next_header & (BLOCK_FREE | BLOCK_CLASS)) != BLOCK_FREE) {
+            break;  // In use, tagged or being purged
+        }
+        end += sizeof(size_t) + next_size;
+    }
+    size_t grown = end - offset - sizeof(size_t);
+    if (tail != SIZE_MAX) {
+        size_t left = pool_size - offset - sizeof(size_t);
+        if (pool_free_index != NULL) {
+            left &= ~(sizeof(size_t) - 1);
+        }
+        grown = want < left ? want : left;
+    }
+    if (grown < need) {
+        return 0;
+    }
 
-    // Set the size of the block to 0, indicating it's free
-    size_t* block_size_ptr = (size_t*)((char*)block - sizeof(size_t));
-    *block_size_ptr = 0;  // Mark the block as free by setting size to 0
+    for (size_t at = start; at < end;) {
+        size_t taken = *(size_t*)((char*)memory_pool + at);
+        block_forget_dirty((char*)memory_pool + at, taken);
+        pool_index_clear(at);
+        at += sizeof(size_t) + (taken & ~BLOCK_FLAGS);
+    }
+    if (tail != SIZE_MAX) {
+        pool_tail_advanced(tail, offset + sizeof(size_t) + grown);
+    } else if (grown >= want + sizeof(size_t) + HINT_MIN_SPLIT) {
+        size_t rest = offset + sizeof(size_t) + want;
+        size_t rest_header = (grown - want - sizeof(size_t)) | BLOCK_FREE;
+        *(size_t*)((char*)memory_pool + rest) = rest_header;
+        block_count_dirty((char*)memory_pool + rest, rest_header);
+        pool_index_set(rest);
+        grown = want;
+    }
+    *(size_t*)current = grown;
+
+    // No free block starts inside the grown block any more
+    size_t grown_end = offset + sizeof(size_t) + grown;
+    if (*pool_first_free > offset && *pool_first_free < grown_end) {
+        *pool_first_free = grown_end;
+    }
+    for (int i = 0; i < HINT_CLASSES; i++) {
+        if (pool_class_first_free[i] > offset && pool_class_first_free[i] < grown_end) {
+            pool_class_first_free[i] = grown_end;
+        }
+    }
+    if (end > start) {
+        pool_layout_generation++;  // Headers of the blocks taken in are gone
+    }
+    return grown;
+}
 
-    pthread_mutex_unlock(&mem_lock);  // Unlock after freeing
+// Grows a block of the pool in place, see block_grow. Sampled and small blocks never grow.
+static size_t pool_grow(void* block, size_t need, size_t want)
+{
+    if (guard_owns(block) || mem_small_owns(block)) {
+        return 0;
+    }
+    pool_lock();
+    size_t grown = memory_pool != NULL ? block_grow((char*)block - sizeof(size_t) - (char*)memory_pool, need, want) : 0;
+    pool_unlock();
+    return grown;
 }
 
 // Resize function
-void* mem_resize(void* block, size_t new_size)
+static void* pool_resize(void* block, size_t new_size)
 {
     if (block == NULL) {
         return mem_alloc(new_size);  // Allocate new if block is NULL
     }
 
-    pthread_mutex_lock(&mem_lock);  // Lock for thread safety
+    // Get the original size of the block. mem_alloc and mem_free take mem_lock
+    // themselves, so it must not be held here.
+    size_t original_size = block_payload_size(block);
 
-    // Get the original size of the block
-    size_t original_size = *(size_t*)((char*)block - sizeof(size_t));
+    // Slack left by rounding or by a larger free block absorbs small changes, and
+    // free space right behind the block lets it grow without a copy
+    if (new_size != 0 && new_size <= original_size && new_size >= original_size / 2) {
+        return block;
+    }
+    if (new_size > original_size && pool_grow(block, new_size, new_size) != 0) {
+        return block;
+    }
 
     // Allocate new memory for the block
     void* new_block = mem_alloc(new_size);
@@ -100,16 +1416,656 @@ void* mem_resize(void* block, size_t new_size)
     // Deallocate the old block
     mem_free(block);
 
-    pthread_mutex_unlock(&mem_lock);  // Unlock after resizing
-
     return new_block;  // Return the new block
 }
 
+void* mem_resize(void* block, size_t new_size)
+{
+#ifdef MEM_LATENCY_HIST
+    uint64_t start = mem_latency_now();
+    void* new_block = pool_resize(block, new_size);
+    mem_latency_record(MEM_LATENCY_RESIZE, new_size, mem_latency_now() - start);
+    return new_block;
+#else
+    return pool_resize(block, new_size);
+#endif
+}
+
+size_t mem_usable_size(const void* block)
+{
+    return block != NULL ? block_payload_size((void*)block) : 0;
+}
+
+static void* pool_resize_ex(void* block, size_t min_size, size_t preferred_size)
+{
+    if (min_size == 0) {
+        min_size = 1;
+    }
+    if (preferred_size < min_size) {
+        preferred_size = min_size;
+    }
+    size_t original_size = block != NULL ? block_payload_size(block) : 0;
+    if (block != NULL && min_size <= original_size) {
+        return block;  // The slack already covers it
+    }
+
+    // Grow by at least half, so a loop adding one element at a time moves the block
+    // a logarithmic number of times
+    size_t target = original_size + original_size / 2;
+    if (target < preferred_size || target < original_size) {
+        target = preferred_size;
+    }
+    if (block != NULL && pool_grow(block, min_size, target) != 0) {
+        return block;
+    }
+
+    void* new_block = mem_alloc(target);
+    if (new_block == NULL && target > min_size) {
+        new_block = mem_alloc(min_size);
+    }
+    if (new_block == NULL) {
+        return NULL;  // The old block stays valid
+    }
+    if (block != NULL) {
+        memcpy(new_block, block, original_size);
+        mem_free(block);
+    }
+    return new_block;
+}
+
+void* mem_resize_ex(void* block, size_t min_size, size_t preferred_size)
+{
+#ifdef MEM_LATENCY_HIST
+    uint64_t start = mem_latency_now();
+    void* new_block = pool_resize_ex(block, min_size, preferred_size);
+    mem_latency_record(MEM_LATENCY_RESIZE, min_size, mem_latency_now() - start);
+    return new_block;
+#else
+    return pool_resize_ex(block, min_size, preferred_size);
+#endif
+}
+
+// Waits, with the lock held, until the block being purged is back in circulation,
+// since mem_pool_purge writes its header again after the madvise call
+static void pool_wait_purge(void)
+{
+    while (pool_purge_busy) {
+        pool_unlock();
+        sched_yield();
+        pool_lock();
+    }
+}
+
+void mem_reset(void)
+{
+    pool_lock();
+    pool_wait_purge();
+    if (memory_pool != NULL) {
+        *(size_t*)memory_pool = 0;  // The whole pool is untouched space again
+        *pool_first_free = 0;
+        memset(pool_class_first_free, 0, HINT_CLASSES * sizeof(size_t));
+        pool_hinted = pool_file != NULL || pool_shm != NULL;  // As after mem_init_file or mem_init_shared
+        pool_tail = 0;
+        pool_dirty_pages = 0;
+        pool_layout_generation++;
+        pool_defer_generation++;
+        if (pool_file != NULL) {
+            pool_file->root = 0;
+        }
+        mem_small_reset();
+    }
+    pool_unlock();
+
+    mem_handle_reset();
+    mem_arena_reset();
+    guard_release_all();
+    mem_prof_forget_live();
+}
+
+mem_checkpoint_t *mem_checkpoint(void)
+{
+    size_t capacity = 256;
+    mem_checkpoint_t *checkpoint = malloc(sizeof(mem_checkpoint_t) + capacity * sizeof(checkpoint_block_t));
+    if (checkpoint == NULL) {
+        return NULL;
+    }
+
+    pool_lock();
+    pool_wait_purge();
+    if (memory_pool == NULL) {
+        pool_unlock();
+        free(checkpoint);
+        return NULL;
+    }
+
+    size_t offset = 0, used = 0;
+    while (offset + sizeof(size_t) <= pool_size) {
+        size_t header = *(size_t*)((char*)memory_pool + offset);
+        if (header == 0) {
+            break;
+        }
+        if (used == capacity) {
+            capacity *= 2;
+            mem_checkpoint_t *grown = realloc(checkpoint, sizeof(mem_checkpoint_t) + capacity * sizeof(checkpoint_block_t));
+            if (grown == NULL) {
+                pool_unlock();
+                free(checkpoint);
+                return NULL;
+            }
+            checkpoint = grown;
+        }
+        checkpoint->blocks[used].offset = offset;
+        checkpoint->blocks[used].header = header;
+        used++;
+        offset += (header & ~BLOCK_FLAGS) + sizeof(size_t);
+    }
+
+    checkpoint->serial = pool_serial;
+    checkpoint->tail = offset;
+    checkpoint->first_free = *pool_first_free;
+    memcpy(checkpoint->class_first_free, pool_class_first_free, sizeof(checkpoint->class_first_free));
+    checkpoint->hinted = pool_hinted;
+    checkpoint->dirty_pages = pool_dirty_pages;
+    checkpoint->root = pool_file != NULL ? pool_file->root : 0;
+    checkpoint->count = used;
+    pool_unlock();
+    return checkpoint;
+}
+
+int mem_restore(const mem_checkpoint_t *checkpoint)
+{
+    pool_lock();
+    pool_wait_purge();
+    if (memory_pool == NULL || checkpoint == NULL || checkpoint->serial != pool_serial) {
+        pool_unlock();
+        return -1;
+    }
+
+    if (pool_free_index != NULL) {
+        memset(pool_free_index, 0, (checkpoint->tail / sizeof(size_t) + 63) / 64 * sizeof(uint64_t));
+    }
+    // Writing back the saved headers rebuilds the whole layout below the saved tail;
+    // headers written since then lie inside restored blocks and are never read
+    for (size_t i = 0; i < checkpoint->count; i++) {
+        *(size_t*)((char*)memory_pool + checkpoint->blocks[i].offset) = checkpoint->blocks[i].header;
+        if ((checkpoint->blocks[i].header & (BLOCK_FREE | BLOCK_CLASS)) == BLOCK_FREE) {
+            pool_index_set(checkpoint->blocks[i].offset);
+        }
+    }
+    if (checkpoint->tail + sizeof(size_t) <= pool_size) {
+        *(size_t*)((char*)memory_pool + checkpoint->tail) = 0;
+    }
+
+    *pool_first_free = checkpoint->first_free;
+    memcpy(pool_class_first_free, checkpoint->class_first_free, sizeof(checkpoint->class_first_free));
+    pool_hinted = checkpoint->hinted;
+    pool_tail = checkpoint->tail;
+    pool_dirty_pages = checkpoint->dirty_pages;
+    pool_layout_generation++;
+    pool_defer_generation++;
+    if (pool_file != NULL) {
+        pool_file->root = checkpoint->root;
+    }
+    pool_unlock();
+    return 0;
+}
+
+void mem_checkpoint_free(mem_checkpoint_t *checkpoint)
+{
+    free(checkpoint);
+}
+
 // Deinitialization function
 void mem_deinit()
 {
-    if (memory_pool != NULL) {
+    mem_decay_stop();  // The purge thread must not touch the mapping once it is gone
+    pool_defer_generation++;  // Blocks other threads still hold back are dropped
+
+    if (pool_shm != NULL) {
+        // Other processes may still use the pool; the object lives on until shm_unlink
+        munmap(pool_shm, sizeof(pool_shm_header_t) + pool_size);
+        pool_shm = NULL;
+        pool_mutex = &mem_lock;
+        pool_first_free = &local_first_free;
+        pool_class_first_free = local_class_first_free;
+        memory_pool = NULL;
+    } else if (pool_file != NULL) {
+        // Write the pool back so it can be reopened after a restart
+        msync(pool_file, sizeof(pool_file_header_t) + pool_size, MS_SYNC);
+        munmap(pool_file, sizeof(pool_file_header_t) + pool_size);
+        pool_file = NULL;
+        memory_pool = NULL;
+    } else if (memory_pool != NULL) {
         munmap(memory_pool, pool_size);  // Use munmap to free the allocated memory
         memory_pool = NULL;
     }
+    pool_page_size = 0;
+    pool_dirty_pages = 0;
+    if (pool_free_index != NULL) {
+        munmap(pool_free_index, pool_free_index_words * sizeof(uint64_t));
+        pool_free_index = NULL;
+    }
+    mem_small_teardown();
+
+    mem_handle_reset();
+    mem_arena_reset();
+    guard_release_all();  // Guarded blocks belong to the pool as well
+    mem_prof_forget_live();
+}
+
+size_t mem_pool_alloc_handle(size_t size, size_t index)
+{
+    if (pool_shm != NULL || size > SIZE_MAX - sizeof(size_t)) {
+        return SIZE_MAX;  // The handle table is private to this process
+    }
+
+    size_t* block = pool_alloc_block(size + sizeof(size_t));
+    if (block == NULL) {
+        return SIZE_MAX;
+    }
+    pool_lock();
+    block[0] = index;
+    block[-1] |= BLOCK_HANDLE;
+    pool_unlock();
+    return (char*)(block - 1) - (char*)memory_pool;
+}
+
+// Turns [offset, end) of the pool back into zero-filled untouched space
+static void pool_zero(size_t offset, size_t end)
+{
+    char* start = (char*)memory_pool + offset;
+    size_t length = end - offset;
+
+    if (pool_page_size != 0 && length >= 2 * pool_page_size) {
+        // Private anonymous pages read back as zero once dropped
+        char* first = (char*)(((uintptr_t)start + pool_page_size - 1) & ~(pool_page_size - 1));
+        char* last = (char*)(((uintptr_t)start + length) & ~(pool_page_size - 1));
+        memset(start, 0, first - start);
+        madvise(first, last - first, MADV_DONTNEED);
+        memset(last, 0, start + length - last);
+    } else {
+        memset(start, 0, length);
+    }
+}
+
+// Makes the gap [offset, end) left by compaction one free block
+static void pool_emit_gap(size_t offset, size_t end)
+{
+    if (offset < end) {
+        size_t header = (end - offset - sizeof(size_t)) | BLOCK_FREE;
+        *(size_t*)((char*)memory_pool + offset) = header;
+        block_count_dirty((char*)memory_pool + offset, header);
+        pool_index_set(offset);
+    }
+}
+
+// One step of mem_compact, run with the pool lock and the handle table lock held.
+// Blocks between *write and *read have been slid down or were free; between steps
+// that gap is an ordinary free block. Returns non-zero once the whole pool is done.
+static int pool_compact_step(size_t* read_offset, size_t* write_offset, size_t* moved, unsigned int* generation)
+{
+    size_t read = *read_offset, write = *write_offset;
+    int done = 0, changed = 0;
+
+    if (*generation != pool_layout_generation) {
+        read = write = 0;  // Blocks were merged since the last step, the offsets may be stale
+    } else if (write < read) {
+        size_t header = *(size_t*)((char*)memory_pool + write);
+        if ((header & ~BLOCK_PURGED) != ((read - write - sizeof(size_t)) | BLOCK_FREE)) {
+            write = read;  // The gap was allocated in the meantime
+        } else {
+            block_forget_dirty((char*)memory_pool + write, header);
+            pool_index_clear(write);
+        }
+    }
+
+    for (int visited = 0; visited < COMPACT_STEP_BLOCKS; visited++) {
+        if (read + sizeof(size_t) > pool_size) {
+            done = 1;
+            break;
+        }
+        char* current = (char*)memory_pool + read;
+        size_t header = *(size_t*)current;
+        size_t extent = (header & ~BLOCK_FLAGS) + sizeof(size_t);
+
+        if (extent == sizeof(size_t)) {
+            // The gap runs into the untouched tail and becomes part of it
+            pool_zero(write, read);
+            changed |= write < read;
+            read = write;
+            pool_tail = write;
+            done = 1;
+            break;
+        }
+
+        size_t payload = extent - sizeof(size_t);
+        size_t needed = header & BLOCK_HANDLE ? mem_handle_movable(*(size_t*)(current + sizeof(size_t)), read) : 0;
+
+        if (header & BLOCK_FREE) {
+            block_forget_dirty(current, header);
+            pool_index_clear(read);
+            changed = 1;
+        } else if (needed != 0) {
+            // Slide the block down and trim what a reused free block gave it beyond its request
+            needed = (needed + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1);  // Headers stay word-aligned
+            if (needed > payload || payload - needed < 2 * sizeof(size_t)) {
+                needed = payload;  // Too little to trim for a block of its own
+            }
+            if (write < read || needed < payload) {
+                memmove((char*)memory_pool + write, current, sizeof(size_t) + needed);
+                *(size_t*)((char*)memory_pool + write) = needed | BLOCK_HANDLE;
+                mem_handle_moved(*(size_t*)((char*)memory_pool + write + sizeof(size_t)), write);
+                *moved += sizeof(size_t) + needed;
+                changed = 1;
+            }
+            write += sizeof(size_t) + needed;
+        } else {
+            pool_emit_gap(write, read);  // Pinned or not relocatable, the gap ends here
+            write = read + extent;
+        }
+        read += extent;
+    }
+    pool_emit_gap(write, read);
+
+    if (changed) {
+        // Hints may point into the gap; starting over from the bottom is always right
+        *pool_first_free = 0;
+        memset(pool_class_first_free, 0, HINT_CLASSES * sizeof(size_t));
+        pool_layout_generation++;
+    }
+    *generation = pool_layout_generation;
+    *read_offset = read;
+    *write_offset = write;
+    return done;
+}
+
+size_t mem_compact(void)
+{
+    size_t read = 0, write = 0, moved = 0;
+    int done = 0;
+
+    pthread_mutex_lock(&compact_lock);
+    pool_lock();
+    unsigned int generation = pool_layout_generation;
+    pool_unlock();
+
+    while (!done) {
+        pool_lock();
+        if (memory_pool == NULL || pool_shm != NULL) {
+            done = 1;  // Nothing in a shared pool can be relocated
+        } else {
+            mem_handle_table_lock();
+            done = pool_compact_step(&read, &write, &moved, &generation);
+            mem_handle_table_unlock();
+        }
+        pool_unlock();
+    }
+
+    pthread_mutex_unlock(&compact_lock);
+    return moved;
+}
+
+// Copies the block layout of the pool. It runs under mem_lock, which is held only
+// for a single pass over the block headers.
+mem_block_info_t *mem_pool_snapshot(size_t *count)
+{
+    size_t capacity = 256;
+    size_t used = 0;
+    mem_block_info_t *blocks = malloc(capacity * sizeof(mem_block_info_t));
+    if (blocks == NULL) {
+        return NULL;
+    }
+
+    pool_lock();
+
+    if (memory_pool == NULL) {
+        pool_unlock();
+        free(blocks);
+        return NULL;
+    }
+
+    size_t offset = 0;
+    while (offset + sizeof(size_t) <= pool_size) {
+        size_t header = *(size_t*)((char*)memory_pool + offset);
+        size_t block_size = header & ~BLOCK_FLAGS;
+
+        if (used == capacity) {
+            capacity *= 2;
+            mem_block_info_t *grown = realloc(blocks, capacity * sizeof(mem_block_info_t));
+            if (grown == NULL) {
+                pool_unlock();
+                free(blocks);
+                return NULL;
+            }
+            blocks = grown;
+        }
+
+        if (block_size == 0) {
+            // Untouched space up to the end of the pool is one free block
+            blocks[used].offset = offset;
+            blocks[used].size = pool_size - offset - sizeof(size_t);
+            blocks[used].state = MEM_BLOCK_FREE;
+            used++;
+            break;
+        }
+
+        blocks[used].offset = offset;
+        blocks[used].size = block_size;
+        blocks[used].state = (header & BLOCK_FREE) ? MEM_BLOCK_FREE : MEM_BLOCK_USED;
+        used++;
+        offset += block_size + sizeof(size_t);
+    }
+
+    pool_unlock();
+
+    *count = used;
+    return blocks;
+}
+
+size_t mem_pool_purge(size_t *cursor, int advice, int *wrapped)
+{
+    pool_lock();
+
+    if (memory_pool == NULL || pool_page_size == 0) {
+        pool_unlock();
+        *wrapped = 1;  // Only anonymous pools are purged
+        return 0;
+    }
+
+    // Merging blocks may have left the cursor inside one
+    static unsigned int purge_generation;
+    if (purge_generation != pool_layout_generation) {
+        purge_generation = pool_layout_generation;
+        *cursor = 0;
+    }
+
+    // Find the next free block with unpurged pages, looking at a bounded number of headers
+    size_t offset = *cursor;
+    size_t found = SIZE_MAX, pages = 0, block_size = 0, header = 0;
+    for (int visited = 0; visited < MEM_PURGE_SCAN_BLOCKS; visited++) {
+        header = offset + sizeof(size_t) <= pool_size ? *(size_t*)((char*)memory_pool + offset) : 0;
+        block_size = header & ~BLOCK_FLAGS;
+        if (block_size == 0) {
+            *wrapped = 1;  // Reached the untouched tail, start over
+            offset = 0;
+            break;
+        }
+        if ((header & BLOCK_FREE) && !(header & BLOCK_PURGED)) {
+            pages = block_whole_pages((char*)memory_pool + offset, block_size);
+            if (pages > 0) {
+                found = offset;
+                offset += block_size + sizeof(size_t);
+                break;
+            }
+        }
+        offset += block_size + sizeof(size_t);
+    }
+    *cursor = offset;
+
+    if (found == SIZE_MAX) {
+        pool_unlock();
+        return 0;
+    }
+
+    // Take the block out of circulation by making it look allocated, so the madvise
+    // call itself runs without the lock
+    char *block = (char*)memory_pool + found;
+    size_t tag = header & BLOCK_CLASS;
+    *(size_t*)block = block_size | tag;
+    pool_dirty_pages -= pages;
+    pool_purge_busy = 1;
+    pool_unlock();
+
+    uintptr_t start = ((uintptr_t)block + sizeof(size_t) + pool_page_size - 1) & ~(pool_page_size - 1);
+    madvise((void*)start, pages * pool_page_size, advice == MEM_PURGE_FREE ? MADV_FREE : MADV_DONTNEED);
+
+    pool_lock();
+    pool_purge_busy = 0;
+    *(size_t*)block = block_size | BLOCK_FREE | BLOCK_PURGED | tag;
+    size_t *first_free = tag ? &pool_class_first_free[(tag >> BLOCK_CLASS_SHIFT) - 1] : pool_first_free;
+    if (found < *first_free) {
+        *first_free = found;
+    }
+    pool_unlock();
+    return pages;
+}
+
+size_t mem_dirty_pages(void)
+{
+    return __atomic_load_n(&pool_dirty_pages, __ATOMIC_RELAXED);
+}
+
+int mem_walk(mem_walk_callback callback, void *ctx)
+{
+    size_t count;
+    mem_block_info_t *blocks = mem_pool_snapshot(&count);
+    if (blocks == NULL) {
+        return -1;
+    }
+
+    // The callbacks run without mem_lock, so they are free to allocate
+    for (size_t i = 0; i < count; i++) {
+        callback((char*)memory_pool + blocks[i].offset + sizeof(size_t), blocks[i].size, blocks[i].state, ctx);
+    }
+
+    free(blocks);
+    return 0;
+}
+
+int mem_dump_map(int fd)
+{
+    size_t count;
+    mem_block_info_t *blocks = mem_pool_snapshot(&count);
+    if (blocks == NULL) {
+        return -1;
+    }
+
+    mem_map_header_t header = {
+        .magic = MEM_MAP_MAGIC,
+        .version = MEM_MAP_VERSION,
+        .pool_size = pool_size,
+        .header_size = sizeof(size_t),
+        .block_count = count,
+    };
+    mem_map_record_t *records = malloc(count * sizeof(mem_map_record_t));
+    if (records == NULL) {
+        free(blocks);
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        records[i].offset = blocks[i].offset;
+        records[i].size = blocks[i].size | (blocks[i].state == MEM_BLOCK_USED ? MEM_MAP_USED : 0);
+    }
+    free(blocks);
+
+    int result = 0;
+    const char *data = (const char *)&header;
+    size_t left = sizeof(header);
+    for (int part = 0; part < 2 && result == 0; part++) {
+        while (left > 0) {
+            ssize_t written = write(fd, data, left);
+            if (written < 0) {
+                result = -1;
+                break;
+            }
+            data += written;
+            left -= written;
+        }
+        data = (const char *)records;
+        left = count * sizeof(mem_map_record_t);
+    }
+
+    free(records);
+    return result;
+}
+
+int mem_guard_enable(unsigned int sample_rate, size_t num_slots)
+{
+    pthread_mutex_lock(&guard_lock);
+
+    if (guard_region == NULL) {
+        if (num_slots == 0) {
+            pthread_mutex_unlock(&guard_lock);
+            return -1;
+        }
+
+        guard_page_size = (size_t)sysconf(_SC_PAGESIZE);
+        guard_region_size = (2 * num_slots + 1) * guard_page_size;
+        char *region = mmap(NULL, guard_region_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        guard_slots = calloc(num_slots, sizeof(guard_slot_t));
+        guard_free_ring = calloc(num_slots, sizeof(size_t));
+        if (region == MAP_FAILED || guard_slots == NULL || guard_free_ring == NULL) {
+            if (region != MAP_FAILED) {
+                munmap(region, guard_region_size);
+            }
+            free(guard_slots);
+            free(guard_free_ring);
+            guard_slots = NULL;
+            guard_free_ring = NULL;
+            pthread_mutex_unlock(&guard_lock);
+            return -1;
+        }
+
+        for (size_t i = 0; i < num_slots; i++) {
+            guard_free_ring[i] = i;
+        }
+        guard_num_slots = num_slots;
+        guard_free_head = 0;
+        guard_free_count = num_slots;
+
+        // backtrace() loads the unwinder lazily; do it now rather than on the first sample
+        void *warmup[1];
+        backtrace(warmup, 1);
+
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = guard_fault_handler;
+        action.sa_flags = SA_SIGINFO;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGSEGV, &action, &guard_old_action);
+
+        guard_region = region;
+        mem_hooks_set(MEM_HOOK_GUARD_REGION);
+    }
+
+    guard_sample_rate = sample_rate;
+    if (sample_rate != 0) {
+        mem_hooks_set(MEM_HOOK_GUARD_SAMPLE);
+    } else {
+        mem_hooks_clear(MEM_HOOK_GUARD_SAMPLE);
+    }
+    pthread_mutex_unlock(&guard_lock);
+    return 0;
+}
+
+void mem_guard_disable(void)
+{
+    // The region stays mapped so outstanding guarded blocks can still be freed and checked
+    mem_hooks_clear(MEM_HOOK_GUARD_SAMPLE);
+    guard_sample_rate = 0;
+}
+
+int mem_guard_owns(const void *block)
+{
+    return guard_owns(block);
 }
@@ -2,6 +2,8 @@
 #define MEMORY_MANAGER_H
 
 #include <stddef.h> // For size_t
+#include <stdint.h> // For uint8_t and uint16_t
+#include "mem_size_classes.h"
 
 // Helps C++ compilers to handle C header files
 #ifdef __cplusplus
@@ -36,6 +38,70 @@ extern "C"
      */
     void mem_free(void *block);
 
+#define MEM_FREE_BATCH_MAX 256 // Largest batch mem_free_batch accepts
+
+    /**
+     * Lets mem_free defer its work: each thread collects the blocks it frees and
+     * releases count of them under a single acquisition of the pool lock, instead of
+     * taking the lock once per block. A thread also releases what it collected
+     * whenever it takes the lock for something else, mem_alloc included, so its own
+     * allocations still reuse the blocks it freed; other threads see them only once
+     * the batch fills, the thread calls mem_flush or the thread exits. Until then the
+     * blocks count as allocated, for mem_walk too. Blocks of mem_handle_alloc and of
+     * MEM_HINT_AUTO are always freed at once.
+     *
+     * @param count Blocks per batch, up to MEM_FREE_BATCH_MAX; 0, the default, frees at once.
+     * @return 0 on success, or -1 if count is too large.
+     */
+    int mem_free_batch(size_t count);
+
+    /**
+     * Releases the blocks whose frees the calling thread deferred, see mem_free_batch.
+     */
+    void mem_flush(void);
+
+    /**
+     * Drops every allocation at once, leaving the pool mapped and its pages resident
+     * for the next job. Only the first block header and the free-space hints are
+     * written, whatever the number of blocks. Handles, sampled blocks, arena chunks
+     * and the root block of a file-backed pool are forgotten too. No other thread may use the
+     * pool across the call.
+     */
+    void mem_reset(void);
+
+    /**
+     * Saved block layout of the pool, see mem_checkpoint.
+     */
+    typedef struct mem_checkpoint mem_checkpoint_t;
+
+    /**
+     * Saves the block headers and free-space hints of the pool, so mem_restore can
+     * bring them back, for instance once warm-up allocations are done and before
+     * each work unit. The checkpoint holds one entry per block in the pool.
+     *
+     * @return The checkpoint, to be released with mem_checkpoint_free, or NULL if no
+     *         pool is initialized or memory ran out.
+     */
+    mem_checkpoint_t *mem_checkpoint(void);
+
+    /**
+     * Rolls the pool back to a checkpoint: blocks allocated since are dropped and
+     * blocks freed since are allocated again, with whatever contents they now have.
+     * Only headers are written, so blocks that stayed allocated keep their data.
+     * Handles created after the checkpoint must not be used afterwards. No other
+     * thread may use the pool across the call. A checkpoint can be restored any
+     * number of times.
+     *
+     * @param checkpoint A checkpoint taken from the current pool.
+     * @return 0 on success, or -1 if the checkpoint belongs to another pool.
+     */
+    int mem_restore(const mem_checkpoint_t *checkpoint);
+
+    /**
+     * Releases a checkpoint.
+     */
+    void mem_checkpoint_free(mem_checkpoint_t *checkpoint);
+
     /**
      * Changes the size of an existing memory block, possibly moving it to accommodate
      * the new size. It may also shrink the block if the new size is smaller than the current size.
@@ -46,6 +112,60 @@ extern "C"
      */
     void *mem_resize(void *block, size_t size);
 
+    /**
+     * Returns how many bytes of a block can be used, which may be more than were
+     * requested: small objects are rounded up to their size class, and a block that
+     * reuses a larger free block keeps all of it.
+     *
+     * @param block A block returned by mem_alloc, mem_resize or mem_resize_ex, or NULL.
+     * @return The usable size, 0 for NULL.
+     */
+    size_t mem_usable_size(const void *block);
+
+    /**
+     * Resizes a block for a growing buffer. Returns the block unchanged if its usable
+     * size already reaches min_size. Otherwise the block grows in place into free space
+     * directly behind it, or moves, and its new usable size is at least min_size and
+     * usually at least preferred_size and 1.5 times the old usable size, so growing
+     * one element at a time copies the contents a logarithmic number of times. The
+     * contents are kept up to the old usable size. Callers should track the capacity
+     * with mem_usable_size.
+     *
+     * @param block The block to resize, or NULL to allocate one.
+     * @param min_size The size the caller needs.
+     * @param preferred_size The size the caller would like; below min_size it counts as min_size.
+     * @return The resized block, or NULL if not even min_size is available, in which
+     *         case the old block is left as it was.
+     */
+    void *mem_resize_ex(void *block, size_t min_size, size_t preferred_size);
+
+    // Expected lifetimes for mem_alloc_hint
+#define MEM_HINT_NONE 0      // Same as mem_alloc
+#define MEM_HINT_SHORT 1     // Scratch buffers freed soon after they are allocated
+#define MEM_HINT_LONG 2      // Objects that outlive many other allocations
+#define MEM_HINT_PERMANENT 3 // Objects that are never freed
+#define MEM_HINT_AUTO 4      // SHORT or LONG, learned from earlier blocks of the same call site
+
+    /**
+     * Allocates a block like mem_alloc, placing it by its expected lifetime. Every
+     * lifetime class claims its own runs of the pool, 64 KB at a time, and reuses only
+     * its own free blocks, splitting them as needed and merging neighbours that were
+     * freed in the meantime. Short-lived blocks thus give back whole runs instead of
+     * leaving holes between long-lived ones. The regions are soft: once the untouched
+     * space is used up, an allocation of any class, mem_alloc included, takes whatever
+     * free block fits.
+     *
+     * With MEM_HINT_AUTO the class is predicted from how long the blocks allocated by
+     * the same call site lived, measured in hinted allocations; such blocks cost one
+     * extra word. What has been learned carries over to later pools. Shared pools treat
+     * MEM_HINT_AUTO as MEM_HINT_LONG. Hinted blocks are never sampled into guard slots.
+     *
+     * @param size The size of the memory block to allocate.
+     * @param hint One of the MEM_HINT_* constants.
+     * @return A pointer to the allocated memory block, or NULL if allocation fails.
+     */
+    void *mem_alloc_hint(size_t size, int hint);
+
     /**
      * Frees up the entire memory pool that was initially allocated by mem_init.
      * This function should be called to clean up the memory manager resources before
@@ -53,6 +173,458 @@ extern "C"
      */
     void mem_deinit();
 
+    // A relocatable block, see mem_handle_alloc. 0 is never a valid handle.
+    typedef size_t mem_handle_t;
+
+    /**
+     * Allocates a block that mem_compact may move. The block is reached through
+     * mem_handle_lock, which pins it in place until the matching mem_handle_unlock;
+     * pointers obtained that way must not be used once the block is unpinned.
+     * Handles are local to the process and not available with shared pools.
+     *
+     * @param size The size of the memory block to allocate.
+     * @return A handle to the block, or 0 if allocation fails.
+     */
+    mem_handle_t mem_handle_alloc(size_t size);
+
+    /**
+     * Pins a handle's block and returns its current address. Pins nest: the block
+     * stays put until mem_handle_unlock has been called as many times.
+     *
+     * @param handle A handle returned by mem_handle_alloc.
+     * @return A pointer to the block, or NULL if the handle is not valid.
+     */
+    void *mem_handle_lock(mem_handle_t handle);
+
+    /**
+     * Releases one pin taken by mem_handle_lock.
+     *
+     * @param handle A handle returned by mem_handle_alloc.
+     */
+    void mem_handle_unlock(mem_handle_t handle);
+
+    /**
+     * Frees a handle and its block.
+     *
+     * @param handle A handle returned by mem_handle_alloc.
+     * @return 0 on success, or -1 if the handle is not valid or its block is pinned.
+     */
+    int mem_handle_free(mem_handle_t handle);
+
+    /**
+     * Slides unpinned handle blocks towards the start of the pool, so the free space
+     * between them becomes one contiguous extent again. Space left behind the last
+     * used block goes back to the untouched tail. Blocks from mem_alloc and pinned
+     * handles stay where they are and free space in front of them becomes a single
+     * free block. The pool is compacted in short steps and the lock is released in
+     * between, so other threads keep allocating while it runs.
+     *
+     * @return The number of bytes moved.
+     */
+    size_t mem_compact(void);
+
+    // Locks for the pool's critical section, see mem_lock_select
+#define MEM_LOCK_PTHREAD 0  // pthread mutex
+#define MEM_LOCK_TICKET 1   // FIFO ticket spinlock
+#define MEM_LOCK_MCS 2      // MCS queue lock, each waiter spins on its own cache line
+#define MEM_LOCK_ADAPTIVE 3 // Spins briefly, then sleeps on a futex
+
+    /**
+     * Chooses the lock that serializes allocations and frees in the next pool set
+     * up by mem_init or mem_init_file. The spinning locks yield the CPU now and then
+     * so they keep working with more threads than CPUs. Shared pools always use a
+     * robust pthread mutex.
+     *
+     * @param kind One of the MEM_LOCK_* constants.
+     * @return 0 on success, or -1 if kind is unknown or a pool is currently initialized.
+     */
+    int mem_lock_select(int kind);
+
+    // Where the pool looks up free blocks, see mem_layout_select
+#define MEM_LAYOUT_INLINE 0  // Walks the header in front of every block
+#define MEM_LAYOUT_INDEXED 1 // Keeps a bitmap of free block starts beside the pool
+
+    /**
+     * Chooses how the next pool set up by mem_init finds free blocks. With
+     * MEM_LAYOUT_INDEXED, a bitmap with one bit per pool word marks where free blocks
+     * start, so mem_alloc reads only the bitmap and the headers of free blocks instead
+     * of walking the header of every block in use. Block sizes are then rounded up to
+     * whole words, and the bitmap takes 1/64 of the pool size. File-backed and shared
+     * pools always use MEM_LAYOUT_INLINE.
+     *
+     * @param layout One of the MEM_LAYOUT_* constants.
+     * @return 0 on success, or -1 if layout is unknown or a pool is currently initialized.
+     */
+    int mem_layout_select(int layout);
+
+#define MEM_SMALL_MAX 128    // Largest request served from small-object pages
+#define MEM_SMALL_PAGE 4096  // Size and alignment of a small-object page
+
+    /**
+     * Reserves a region of region_size bytes beside the next pool set up by mem_init
+     * for requests of 1 to MEM_SMALL_MAX bytes. The region is split into pages that
+     * each hold objects of one size class behind a descriptor at the start of the
+     * page, found by masking an object's address, so the objects carry no header: a
+     * 16-byte node takes 16 bytes instead of 24. Objects are freed and resized with
+     * mem_free and mem_resize as usual. Once the region is full, small requests are
+     * served by the pool. Small objects are not seen by mem_walk, mem_checkpoint,
+     * mem_restore or mem_compact, and lifetime hints always use the pool. File-backed
+     * and shared pools never use a small-object region.
+     *
+     * @param region_size Bytes to reserve, rounded up to whole pages, or 0 for none.
+     * @return 0 on success, or -1 if a pool is currently initialized.
+     */
+    int mem_small_select(size_t region_size);
+
+    /**
+     * Returns the bytes of small-object pages that hold at least one object.
+     */
+    size_t mem_small_footprint(void);
+
+    // Results of mem_init_file and mem_init_shared
+#define MEM_FILE_CREATED 0  // A new, empty pool was created
+#define MEM_FILE_REOPENED 1 // An existing pool was opened (a file one at its previous address)
+#define MEM_FILE_MOVED 2    // An existing pool was mapped at a new address
+
+    /**
+     * Initializes the memory manager with a pool that lives in a file mapped with
+     * MAP_SHARED, so its contents survive the process. If the file already holds a
+     * pool it is reopened as is and size is ignored; otherwise it is created with
+     * room for size bytes. mem_deinit writes the pool back to the file.
+     *
+     * The pool's own metadata is offset-based and valid at any address. Blocks that
+     * store raw pointers to each other stay valid only if the result is
+     * MEM_FILE_REOPENED; the previous address is requested but cannot be guaranteed.
+     * Structures that must survive a move should link blocks with mem_offset_of.
+     *
+     * @param path The file holding the pool.
+     * @param size The size of the memory pool, used when the file is created.
+     * @return MEM_FILE_CREATED, MEM_FILE_REOPENED or MEM_FILE_MOVED, or -1 if the file
+     *         could not be opened or mapped, or is not a pool file.
+     */
+    int mem_init_file(const char *path, size_t size);
+
+    /**
+     * Initializes the memory manager with a pool in POSIX shared memory, so several
+     * processes on one host can allocate from and free into the same pool. The first
+     * caller creates the object and its process-shared robust mutex; later callers
+     * attach to it and size is ignored. A process that dies while holding the lock
+     * does not block the others.
+     *
+     * Every process maps the pool at its own address, so blocks are exchanged as
+     * offsets: one process passes mem_offset_of(block), another one reads it through
+     * mem_at_offset and may mem_free it. Guard-page sampling is skipped for shared
+     * pools. mem_deinit detaches the calling process only; call shm_unlink(name)
+     * once the pool is no longer needed.
+     *
+     * @param name The shared memory object name, starting with '/'.
+     * @param size The size of the memory pool, used when the object is created.
+     * @return MEM_FILE_CREATED or MEM_FILE_REOPENED, or -1 if the object could not be
+     *         created, opened or mapped, or is not a pool.
+     */
+    int mem_init_shared(const char *name, size_t size);
+
+    /**
+     * Records the block from which the application finds its structures after the
+     * pool is reopened with mem_init_file. Only file-backed pools have a root.
+     *
+     * @param block A pointer returned by mem_alloc, or NULL to clear the root.
+     * @return 0 on success, or -1 if the pool is not file-backed.
+     */
+    int mem_set_root(void *block);
+
+    /**
+     * Returns the block recorded with mem_set_root, translated to the current
+     * mapping, or NULL if there is none.
+     */
+    void *mem_get_root(void);
+
+    /**
+     * Converts a pointer into the pool to an offset from the start of the pool,
+     * which remains meaningful when a file-backed pool is mapped elsewhere.
+     */
+    size_t mem_offset_of(const void *block);
+
+    /**
+     * Converts an offset returned by mem_offset_of back to a pointer.
+     */
+    void *mem_at_offset(size_t offset);
+
+    // How mem_decay_start returns pages to the kernel
+#define MEM_PURGE_DONTNEED 0 // MADV_DONTNEED: RSS drops at once, reuse faults in zeroed pages
+#define MEM_PURGE_FREE 1     // MADV_FREE: pages are reclaimed only under memory pressure
+
+    /**
+     * Starts a background thread that returns the whole pages of freed blocks to the
+     * kernel once they have stayed unused for a while. Recently freed pages are kept,
+     * since they are likely to be reused; the number allowed to stay resident decays
+     * smoothly to zero over decay_ms, so after a spike the RSS of an idle process
+     * falls back within one decay period. The pool lock is held only while looking
+     * for the next block to purge, never during the madvise call.
+     *
+     * Only pools created by mem_init are purged. Calling it again while the thread
+     * runs changes the parameters; mem_deinit stops the thread.
+     *
+     * @param decay_ms Time after which a freed page is purged.
+     * @param advice MEM_PURGE_DONTNEED or MEM_PURGE_FREE.
+     * @return 0 on success, or -1 on invalid arguments or if the thread could not start.
+     */
+    int mem_decay_start(unsigned int decay_ms, int advice);
+
+    /**
+     * Stops the decay thread and waits for it to exit. Pages already purged stay purged.
+     */
+    void mem_decay_stop(void);
+
+    /**
+     * Returns the number of whole pages inside free blocks that have not been purged.
+     */
+    size_t mem_dirty_pages(void);
+
+    /**
+     * Returns the number of pages purged by the decay thread since it was started.
+     */
+    size_t mem_decay_purged_pages(void);
+
+    /**
+     * Publishes the allocator's counters in a POSIX shared-memory segment laid out as
+     * in mem_stat.h, for the mmstat tool or any other reader. A background thread
+     * refreshes the used and free bytes, the largest free block and the cumulative
+     * counts of allocations, frees and pool lock acquisitions, contended ones
+     * included, every interval_ms milliseconds. Readers never block it. While
+     * publishing, every operation updates shared atomic counters; otherwise mem_alloc
+     * and mem_free pay a single branch for it.
+     *
+     * @param name The segment name, such as "/myapp", or NULL for "/mmstat.<pid>".
+     * @param interval_ms Time between refreshes, at least 1.
+     * @return 0 on success, or -1 on invalid arguments, if already publishing, or if
+     *         the segment or the thread could not be created.
+     */
+    int mem_stat_publish(const char *name, unsigned int interval_ms);
+
+    /**
+     * Stops publishing and removes the segment.
+     */
+    void mem_stat_unpublish(void);
+
+    // Sample rate for always-on use in production, see mem_guard_enable
+#define MEM_GUARD_PRODUCTION_RATE 10000
+
+    /**
+     * Enables sampled guard-page allocations. On average one in every sample_rate
+     * calls to mem_alloc is served from a dedicated page that is right-aligned
+     * against a PROT_NONE guard page, so an overflow faults immediately. Freed
+     * sampled blocks are protected again, which turns a later use-after-free
+     * into a fault as well. A report with the allocation stack trace and the
+     * caller of mem_free is written to stderr before the process is terminated by
+     * the fault.
+     *
+     * Sampling can be enabled before or after mem_init and stays enabled across
+     * mem_init/mem_deinit cycles. Requests larger than a page, or made while every
+     * slot is live, are served from the pool as usual.
+     *
+     * Between samples mem_alloc only counts down a thread-local counter. A sampled
+     * allocation and its free cost two mprotect calls and a stack capture, a few
+     * microseconds. Test case 4 measures both and projects the slowdown of its
+     * concurrency workload: under 1% at MEM_GUARD_PRODUCTION_RATE, a few percent
+     * at a rate of 1000.
+     *
+     * @param sample_rate The average number of allocations per sampled allocation.
+     * @param num_slots The number of guarded blocks that may be live at once (used on first call only).
+     * @return 0 on success, or -1 if the guard region could not be set up.
+     */
+    int mem_guard_enable(unsigned int sample_rate, size_t num_slots);
+
+    /**
+     * Stops sampling new allocations. Outstanding guarded blocks remain valid and
+     * are still checked when they are freed.
+     */
+    void mem_guard_disable(void);
+
+    /**
+     * Tells whether a block returned by mem_alloc was served from a guarded slot.
+     *
+     * @param block A pointer returned by mem_alloc.
+     * @return Non-zero if the block lives in the guard region.
+     */
+    int mem_guard_owns(const void *block);
+
+    // Block states reported by mem_walk
+#define MEM_BLOCK_FREE 0
+#define MEM_BLOCK_USED 1
+
+    typedef void (*mem_walk_callback)(void *block, size_t size, int state, void *ctx);
+
+    /**
+     * Calls callback once for every block of the pool, in address order, with the
+     * block's payload address, payload size and state (MEM_BLOCK_USED or MEM_BLOCK_FREE).
+     * The layout is copied under the pool lock first and the callbacks run after
+     * it has been released, so they may allocate and free. The reported layout is
+     * the one at the time of the copy.
+     *
+     * @param callback The function to call for each block.
+     * @param ctx Passed through to callback.
+     * @return 0 on success, or -1 if there is no pool or the copy could not be made.
+     */
+    int mem_walk(mem_walk_callback callback, void *ctx);
+
+    /**
+     * Writes a compact binary snapshot of the pool layout to fd (see mem_map.h
+     * for the format). The mem_map_tool program renders it as a fragmentation
+     * heat map and a free-block-size histogram.
+     *
+     * @param fd The file descriptor to write to.
+     * @return 0 on success, or -1 on error.
+     */
+    int mem_dump_map(int fd);
+
+    // Profile kinds for mem_prof_dump
+#define MEM_PROF_LIVE 0       // Sampled blocks that have not been freed yet
+#define MEM_PROF_CUMULATIVE 1 // Every sampled allocation since mem_prof_start
+
+    /**
+     * Starts the sampling heap profiler. A stack trace is captured on average once
+     * every sample_interval allocated bytes (Poisson sampling), and each sampled
+     * block is tracked until it is freed. While the profiler is stopped, mem_alloc
+     * and mem_free pay a single branch for it.
+     *
+     * Stack traces are symbolized with dladdr, so executables should be linked with
+     * -rdynamic to get function names instead of module offsets.
+     *
+     * @param sample_interval The mean number of bytes allocated between two samples.
+     * @return 0 on success, or -1 if sample_interval is zero.
+     */
+    int mem_prof_start(size_t sample_interval);
+
+    /**
+     * Stops sampling and forgets the tracked live blocks. Cumulative totals are kept
+     * until mem_prof_reset is called.
+     */
+    void mem_prof_stop(void);
+
+    /**
+     * Discards every recorded call site and tracked block. May be called while
+     * profiling runs: sampling goes on, and samples taken after the reset are
+     * recorded against fresh call sites.
+     */
+    void mem_prof_reset(void);
+
+    /**
+     * Writes the profile in folded-stack format, one call site per line with its
+     * frames outermost first, separated by ';', followed by the estimated number of
+     * bytes: "main;build_list;list_insert 123456". The output can be fed directly to
+     * flamegraph.pl or imported by pprof.
+     *
+     * @param fd The file descriptor to write to.
+     * @param kind MEM_PROF_LIVE or MEM_PROF_CUMULATIVE.
+     * @return 0 on success, or -1 on a write error.
+     */
+    int mem_prof_dump(int fd, int kind);
+
+    // Operations timed by the latency histograms, see mem_latency_stats
+#define MEM_LATENCY_ALLOC 0
+#define MEM_LATENCY_FREE 1
+#define MEM_LATENCY_RESIZE 2
+#define MEM_LATENCY_OPS 3
+#define MEM_LATENCY_CLASSES 64           // Size classes from 63 up are counted together
+#define MEM_LATENCY_ALL_CLASSES SIZE_MAX // Every size class of an operation
+
+    // Latency percentiles of one operation, in nanoseconds
+    typedef struct
+    {
+        uint64_t count;
+        uint64_t p50;
+        uint64_t p99;
+        uint64_t p999;
+        uint64_t max;
+    } mem_latency_stats_t;
+
+    /**
+     * Returns non-zero if the library was built with MEM_LATENCY_HIST (make
+     * LATENCY_HIST=1). Only then do mem_alloc, mem_free and mem_resize time
+     * themselves; otherwise the timing code is not compiled in at all.
+     */
+    int mem_latency_enabled(void);
+
+    /**
+     * Reports the latency of an operation over the blocks of one size class, as
+     * given by mem_size_class for the requested size (the size of the block for
+     * mem_free, the new size for mem_resize). Every thread records into its own
+     * log-linear histograms, 16 buckets per power of two, so percentiles are within
+     * 1/16 of the true value; max is exact. mem_resize includes the mem_alloc and
+     * mem_free it performs, which are recorded on their own too.
+     *
+     * @param op One of the MEM_LATENCY_* operations.
+     * @param size_class A size class, or MEM_LATENCY_ALL_CLASSES.
+     * @param stats Filled with the percentiles, all zero if nothing was recorded.
+     * @return 0 on success, or -1 if op is unknown or latency histograms are not built in.
+     */
+    int mem_latency_stats(int op, size_t size_class, mem_latency_stats_t *stats);
+
+    /**
+     * Clears the histograms of every thread. Each thread drops its own counts the
+     * next time it records and is left out of the results until then, so nothing
+     * recorded before the reset survives it. Operations that finish while it runs
+     * may land on either side.
+     */
+    void mem_latency_reset(void);
+
+    /**
+     * Writes one line per operation and size class that has samples, with the
+     * count, p50, p99, p99.9 and max in nanoseconds.
+     *
+     * @param fd The file descriptor to write to.
+     * @return 0 on success, or -1 on a write error or if latency histograms are not built in.
+     */
+    int mem_latency_dump(int fd);
+
+    /**
+     * Returns the size class that holds blocks of the given size: the smallest class
+     * at least that large. Sizes up to MEM_SIZE_CLASS_SMALL_MAX map to the classes
+     * of mem_size_classes.h, larger ones to four classes per power of two.
+     *
+     * @param size The requested size, at most SIZE_MAX / 2.
+     * @return The class index.
+     */
+    size_t mem_size_class(size_t size);
+
+    /**
+     * Returns the block size of a size class.
+     *
+     * @param size_class A class index returned by mem_size_class.
+     */
+    size_t mem_size_class_size(size_t size_class);
+
+    // Lookup tables generated from MEM_SIZE_CLASSES, indexed by size in 8-byte steps
+    // and by class
+    extern const uint8_t mem_size_class_table[MEM_SIZE_CLASS_SMALL_MAX / 8 + 1];
+    extern const uint16_t mem_size_class_sizes[MEM_SIZE_CLASS_SMALL];
+
+    /**
+     * Inline variant of mem_size_class for allocation fast paths: a table load for
+     * small sizes, a count of leading zeros and two shifts for larger ones.
+     */
+    static inline size_t mem_size_class_inline(size_t size)
+    {
+        if (size <= MEM_SIZE_CLASS_SMALL_MAX) {
+            return mem_size_class_table[(size + 7) >> MEM_SIZE_CLASS_QUANTUM_LG];
+        }
+        size_t lg = 63 - __builtin_clzll(size - 1);  // Doubling that holds the size
+        return MEM_SIZE_CLASS_SMALL + (lg - MEM_SIZE_CLASS_SMALL_LG) * 4 + (((size - 1) >> (lg - 2)) & 3);
+    }
+
+    /**
+     * Inline variant of mem_size_class_size.
+     */
+    static inline size_t mem_size_class_size_inline(size_t size_class)
+    {
+        if (size_class < MEM_SIZE_CLASS_SMALL) {
+            return mem_size_class_sizes[size_class];
+        }
+        size_t large = size_class - MEM_SIZE_CLASS_SMALL;
+        return (size_t)(5 + (large & 3)) << (large / 4 + MEM_SIZE_CLASS_SMALL_LG - 2);
+    }
+
 #ifdef __cplusplus
 }
 #endif
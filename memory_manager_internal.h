@@ -0,0 +1,122 @@
+// memory_manager_internal.h
+#ifndef MEMORY_MANAGER_INTERNAL_H
+#define MEMORY_MANAGER_INTERNAL_H
+
+// Shared between the memory manager translation units; not part of the public API.
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bits of mem_hooks. mem_alloc and mem_free test the whole word with a single branch,
+// so the common path pays nothing for the optional instrumentation.
+#define MEM_HOOK_GUARD_SAMPLE 0x1u   // Sample allocations into guard slots
+#define MEM_HOOK_GUARD_REGION 0x2u   // A guard region is mapped, frees must be checked against it
+#define MEM_HOOK_PROFILE 0x4u        // Heap profiler is running
+#define MEM_HOOK_STATS 0x8u          // Live metrics are being published
+
+#define MEM_HOOKS_ALLOC (MEM_HOOK_GUARD_SAMPLE | MEM_HOOK_PROFILE | MEM_HOOK_STATS)
+#define MEM_HOOKS_FREE (MEM_HOOK_GUARD_REGION | MEM_HOOK_PROFILE | MEM_HOOK_STATS)
+
+extern volatile unsigned int mem_hooks;
+
+void mem_hooks_set(unsigned int bits);
+void mem_hooks_clear(unsigned int bits);
+
+// One block of the pool as seen by mem_pool_snapshot
+typedef struct
+{
+    size_t offset;  // Offset of the block header from the start of the pool
+    size_t size;    // Payload size
+    int state;      // MEM_BLOCK_USED or MEM_BLOCK_FREE
+} mem_block_info_t;
+
+// Returns a malloc'd copy of the pool layout in address order, or NULL without a pool
+mem_block_info_t *mem_pool_snapshot(size_t *count);
+
+// Heap profiler hooks (mem_profile.c)
+void mem_prof_on_alloc(void *block, size_t size, void *caller);
+void mem_prof_on_free(void *block);
+void mem_prof_forget_live(void);
+
+// Live metrics hooks (mem_stat.c)
+void mem_stat_on_alloc(int failed);
+void mem_stat_on_free(void);
+// Pool lock acquisitions, and those that found it held, counted while MEM_HOOK_STATS is
+// set. Shared pools count this process's acquisitions only.
+void mem_pool_lock_counts(uint64_t *acquisitions, uint64_t *contended);
+
+#ifdef MEM_LATENCY_HIST
+#include <time.h>
+
+// Latency histograms (mem_latency.c). Timestamps are TSC ticks on x86-64, converted
+// to nanoseconds only when the histograms are read, and nanoseconds elsewhere.
+static inline uint64_t mem_latency_now(void)
+{
+#if defined(__x86_64__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+void mem_latency_record(int op, size_t size, uint64_t ticks);
+#endif
+
+// Dirty page decay (mem_decay.c)
+#define MEM_PURGE_SCAN_BLOCKS 256  // Block headers looked at per mem_pool_purge call
+
+// Returns the pages of one free block to the kernel with the given MEM_PURGE_* advice,
+// searching from *cursor. The lock is held for the search only, not for the madvise
+// call. Advances *cursor and sets *wrapped once the search has reached the end of the
+// pool or the pool cannot be purged. Returns the number of pages purged, 0 if none.
+size_t mem_pool_purge(size_t *cursor, int advice, int *wrapped);
+
+// Lifetime learning for MEM_HINT_AUTO (mem_lifetime.c), called with the pool lock held.
+// Sets *hint to the class predicted for the call site and returns the trailer word to
+// store at the end of the block, or 0 if the site cannot be tracked.
+size_t mem_lifetime_on_alloc(void *caller, int *hint);
+void mem_lifetime_on_free(size_t trailer);
+
+// Relocatable blocks (mem_handle.c). A handle block keeps its handle's index in its
+// first word. mem_compact holds the pool lock and then the table lock while it moves
+// blocks; the handle functions never take the pool lock with the table lock held.
+void mem_handle_table_lock(void);
+void mem_handle_table_unlock(void);
+// Returns the payload size the block at offset needs if it belongs to handle index and
+// is not pinned, 0 if it must stay put
+size_t mem_handle_movable(size_t index, size_t offset);
+void mem_handle_moved(size_t index, size_t offset);
+// Forgets every handle, used when the pool goes away
+void mem_handle_reset(void);
+
+// Allocates a handle block for index and returns the offset of its header, or SIZE_MAX
+size_t mem_pool_alloc_handle(size_t size, size_t index);
+
+// Arenas (mem_arena.c). Forgets every chunk without freeing it, used when the pool goes away
+void mem_arena_reset(void);
+
+// Header-free small objects (mem_small.c), called with the pool lock held except for
+// mem_small_setup and mem_small_teardown. mem_small_limit is MEM_SMALL_MAX while a
+// region is mapped and 0 otherwise, so a single comparison routes a request.
+extern char *mem_small_base;
+extern size_t mem_small_span;
+extern size_t mem_small_limit;
+
+static inline int mem_small_owns(const void *block)
+{
+    return (uintptr_t)block - (uintptr_t)mem_small_base < mem_small_span;
+}
+
+// Maps a region of region_size bytes, rounded up to pages; 0 maps none. -1 on failure.
+int mem_small_setup(size_t region_size);
+void mem_small_teardown(void);
+// Forgets every object, used by mem_reset
+void mem_small_reset(void);
+// Returns NULL once the region is full
+void *mem_small_alloc(size_t size);
+void mem_small_free(void *object);
+size_t mem_small_size(const void *object);
+
+#endif // MEMORY_MANAGER_INTERNAL_H
@@ -0,0 +1,93 @@
+// mmstat.c
+// Watches the counters a process publishes with mem_stat_publish, printing one line
+// per interval like vmstat: pool usage, fragmentation, operation rates and how often
+// the pool lock was found held. The first line covers the time since publishing began.
+//
+// Usage: mmstat <pid | segment name> [interval seconds] [count]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "mem_stat.h"
+
+#define HEADER_EVERY 20  // Lines between repeated column headers
+
+static void print_header(void)
+{
+    printf("%10s %10s %10s %6s %6s %10s %10s %8s %10s %6s\n", "used KB", "free KB", "largest KB", "blocks", "frag%",
+           "allocs/s", "frees/s", "fails/s", "locks/s", "cont%");
+}
+
+static void print_line(const mem_stat_counters_t *now, const mem_stat_counters_t *before)
+{
+    double seconds = (now->sample_ns - before->sample_ns) / 1e9;
+    if (seconds <= 0) {
+        seconds = 1e-9;
+    }
+    uint64_t locks = now->lock_acquisitions - before->lock_acquisitions;
+    uint64_t contended = now->lock_contended - before->lock_contended;
+    // Share of free space outside the largest free block: 0 when it is all in one piece
+    double fragmentation = now->free_bytes ? 100.0 * (1.0 - (double)now->largest_free / now->free_bytes) : 0.0;
+
+    printf("%10llu %10llu %10llu %6llu %6.1f %10.0f %10.0f %8.0f %10.0f %6.1f\n", (unsigned long long)(now->used_bytes / 1024),
+           (unsigned long long)(now->free_bytes / 1024), (unsigned long long)(now->largest_free / 1024),
+           (unsigned long long)now->used_blocks, fragmentation, (now->allocs - before->allocs) / seconds,
+           (now->frees - before->frees) / seconds, (now->failed_allocs - before->failed_allocs) / seconds, locks / seconds,
+           locks ? 100.0 * contended / locks : 0.0);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        printf("Usage: %s <pid | segment name> [interval seconds] [count]\n", argv[0]);
+        return 1;
+    }
+
+    char name[64];
+    if (argv[1][0] == '/') {
+        snprintf(name, sizeof(name), "%s", argv[1]);
+    } else {
+        snprintf(name, sizeof(name), MEM_STAT_NAME_FORMAT, atoi(argv[1]));
+    }
+    double interval = argc > 2 ? atof(argv[2]) : 1.0;
+    long count = argc > 3 ? atol(argv[3]) : -1;
+    if (interval <= 0) {
+        fprintf(stderr, "interval must be positive\n");
+        return 1;
+    }
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        perror("Failed to open the metrics segment");
+        return 1;
+    }
+    mem_stat_segment_t *segment = mmap(NULL, sizeof(mem_stat_segment_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (segment == MAP_FAILED || __atomic_load_n(&segment->magic, __ATOMIC_ACQUIRE) != MEM_STAT_MAGIC ||
+        segment->version != MEM_STAT_VERSION) {
+        fprintf(stderr, "%s is not a memory manager metrics segment\n", name);
+        return 1;
+    }
+
+    mem_stat_counters_t before = {0}, now;
+    before.sample_ns = segment->start_ns;  // Nothing was counted before publishing began
+    mem_stat_read(segment, &now);
+    for (long line = 0; count < 0 || line < count; line++) {
+        if (line % HEADER_EVERY == 0) {
+            print_header();
+        }
+        if (line > 0) {
+            usleep((useconds_t)(interval * 1e6));
+            mem_stat_read(segment, &now);
+        }
+        print_line(&now, &before);
+        before = now;
+    }
+    munmap(segment, sizeof(mem_stat_segment_t));
+    return 0;
+}
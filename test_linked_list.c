@@ -1,16 +1,21 @@
 #include "linked_list.h"
+#include "mem_epoch.h"
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
 #include <time.h>
 #include <stddef.h>
 #include <math.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <stdlib.h>
 #include "common_defs.h"
 #include "gitdata.h"
 
 typedef struct
 {
     Node **head; // Pointer to the head of the linked list
+    List *list;  // List shared through the list_sync_* functions
     Node *prev_node;
     int start_value; // Value of the node to insert after
     int thread_id;   // Unique ID for each thread
@@ -519,27 +524,111 @@ void test_list_cleanup()
     printf_green("[PASS].\n");
 }
 
+// Adapt the descriptor display functions to capture_stdout
+static List *display_list;
+
+static void display_desc(Node **head, Node *start_node, Node *end_node)
+{
+    list_desc_display(display_list);
+}
+
+static void display_range_desc(Node **head, Node *start_node, Node *end_node)
+{
+    list_desc_display_range(display_list, start_node, end_node);
+}
+
+void test_list_descriptor()
+{
+    printf_yellow("  Testing the List descriptor ---> ");
+    mem_init(1 << 20);
+    List list;
+    list_desc_init(&list);
+    my_assert(list_desc_count_nodes(&list) == 0 && list.head == NULL && list.tail == NULL);
+
+    list_desc_insert(&list, 10);
+    list_desc_insert(&list, 30);
+    my_assert(list.head->data == 10 && list.tail->data == 30);
+    list_desc_insert_after(&list, list.tail, 40);
+    my_assert(list.tail->data == 40);
+    list_desc_insert_after(&list, list.head, 20);
+    list_desc_insert_before(&list, list.head, 5);
+    list_desc_insert_before(&list, list_desc_search(&list, 40), 35);
+    my_assert(list.head->data == 5 && list.tail->data == 40);
+    my_assert(list_desc_count_nodes(&list) == 6 && list_count_nodes(&list.head) == 6);
+
+    char buffer[128] = {0};
+    display_list = &list;
+    capture_stdout(buffer, sizeof(buffer), display_desc, NULL, NULL, NULL);
+    my_assert(strcmp(buffer, "5 -> 10 -> 20 -> 30 -> 35 -> 40 -> NULL\n") == 0);
+    memset(buffer, 0, sizeof(buffer));
+    capture_stdout(buffer, sizeof(buffer), display_range_desc, NULL, list_desc_search(&list, 20), list_desc_search(&list, 35));
+    my_assert(strcmp(buffer, "20 -> 30 -> 35 -> NULL\n") == 0);
+
+    // Deleting the tail moves it back; a missing value changes nothing
+    list_desc_delete(&list, 40);
+    my_assert(list.tail->data == 35);
+    list_desc_delete(&list, 99);
+    list_desc_delete(&list, 5);
+    my_assert(list.head->data == 10 && list_desc_count_nodes(&list) == 4);
+    list_desc_delete_deferred(&list, 35);
+    my_assert(list.tail->data == 30 && list_desc_count_nodes(&list) == 3);
+    mem_epoch_synchronize();
+    my_assert(list_desc_search(&list, 35) == NULL);
+
+    // Down to empty and back
+    list_desc_delete(&list, 10);
+    list_desc_delete(&list, 20);
+    list_desc_delete(&list, 30);
+    my_assert(list.head == NULL && list.tail == NULL && list_desc_count_nodes(&list) == 0);
+    list_desc_insert(&list, 1);
+    my_assert(list.head == list.tail && list_desc_count_nodes(&list) == 1);
+    list_desc_cleanup(&list);
+    my_assert(list.head == NULL && list.tail == NULL && list_desc_count_nodes(&list) == 0);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
 // ********* Stress and edge cases *********
 
-void test_list_insert_loop(int count)
+// Appends count nodes one at a time, through a head pointer or a List descriptor,
+// checks the list and returns how long the appends took in ms
+double test_list_insert_loop(int count, bool use_descriptor)
 {
-    printf_yellow("  Testing list_insert loop ---> ");
     Node *head = NULL;
-    list_init(&head, sizeof(Node) * count);
-    for (int i = 0; i < count; i++)
+    List list;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (use_descriptor)
     {
-        list_insert(&head, i);
+        list_desc_init(&list);
+        for (int i = 0; i < count; i++)
+            list_desc_insert(&list, (uint16_t)i);
+        head = list.head;
     }
+    else
+    {
+        list_init(&head, sizeof(Node) * count);
+        for (int i = 0; i < count; i++)
+            list_insert(&head, (uint16_t)i);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
 
     Node *current = head;
     for (int i = 0; i < count; i++)
     {
-        my_assert(current->data == i);
+        my_assert(current->data == (uint16_t)i);
         current = current->next;
     }
-
-    list_cleanup(&head);
-    printf_green("[PASS].\n");
+    my_assert(current == NULL);
+    if (use_descriptor)
+    {
+        my_assert(list_desc_count_nodes(&list) == (size_t)count && list.tail->data == (uint16_t)(count - 1));
+        list_desc_cleanup(&list);
+    }
+    else
+        list_cleanup(&head);
+    return (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
 }
 
 void test_list_insert_after_loop(int count)
@@ -644,6 +733,394 @@ void test_list_edge_cases()
     printf_green("[PASS].\n");
 }
 
+// ********* Benchmarks *********
+
+/*
+ * Read-mostly traversal with concurrent deletes. Reader threads walk the whole list
+ * while one writer keeps deleting a random node and inserting it again. With epoch
+ * reclamation the readers take no lock; the baseline protects the list with a
+ * reader-writer lock and frees deleted nodes immediately.
+ */
+typedef struct
+{
+    Node **head;
+    bool use_epochs;
+    volatile bool *stop;
+    pthread_rwlock_t *rwlock;
+    long operations; // Traversals for readers, delete/insert pairs for the writer
+} traversal_data_t;
+
+void *traversal_reader(void *arg)
+{
+    traversal_data_t *data = (traversal_data_t *)arg;
+    unsigned long sum = 0;
+
+    while (!*data->stop)
+    {
+        if (data->use_epochs)
+            mem_epoch_enter();
+        else
+            pthread_rwlock_rdlock(data->rwlock);
+
+        for (Node *current = __atomic_load_n(data->head, __ATOMIC_ACQUIRE); current != NULL; current = __atomic_load_n(&current->next, __ATOMIC_ACQUIRE))
+            sum += current->data;
+
+        if (data->use_epochs)
+            mem_epoch_exit();
+        else
+            pthread_rwlock_unlock(data->rwlock);
+        data->operations++;
+    }
+    return (void *)sum;
+}
+
+void *traversal_writer(void *arg)
+{
+    traversal_data_t *data = (traversal_data_t *)arg;
+    Node *first = *data->head; // Never deleted, new nodes go right after it
+    unsigned int seed = 1;
+
+    while (!*data->stop)
+    {
+        uint16_t value = 1 + rand_r(&seed) % 1023;
+        Node *node = (Node *)mem_alloc(sizeof(Node));
+        node->data = value;
+        pthread_mutex_init(&node->lock, NULL);
+
+        if (data->use_epochs)
+        {
+            list_delete_deferred(data->head, value);
+            node->next = first->next;
+            __atomic_store_n(&first->next, node, __ATOMIC_RELEASE);
+        }
+        else
+        {
+            pthread_rwlock_wrlock(data->rwlock);
+            list_delete(data->head, value);
+            node->next = first->next;
+            first->next = node;
+            pthread_rwlock_unlock(data->rwlock);
+        }
+        data->operations++;
+    }
+    return NULL;
+}
+
+void bench_traversal_with_deletes(TestParams *params, bool use_epochs)
+{
+    Node *head = NULL;
+    volatile bool stop = false;
+    pthread_rwlock_t rwlock;
+    pthread_rwlock_init(&rwlock, NULL);
+
+    mem_init(params->num_nodes * sizeof(Node) * 64);
+    list_init(&head, sizeof(Node) * params->num_nodes);
+    list_insert(&head, 0);
+    Node *tail = head;
+    for (int i = 1; i < params->num_nodes; i++)
+    {
+        list_insert_after(tail, i);
+        tail = tail->next;
+    }
+
+    int num_threads = params->num_threads + 1; // Readers plus one writer
+    pthread_t threads[num_threads];
+    traversal_data_t thread_data[num_threads];
+    for (int i = 0; i < num_threads; i++)
+    {
+        thread_data[i] = (traversal_data_t){.head = &head, .use_epochs = use_epochs, .stop = &stop, .rwlock = &rwlock};
+        pthread_create(&threads[i], NULL, i == 0 ? traversal_writer : traversal_reader, &thread_data[i]);
+    }
+
+    usleep(1000000);
+    stop = true;
+
+    long traversals = 0;
+    for (int i = 0; i < num_threads; i++)
+    {
+        pthread_join(threads[i], NULL);
+        if (i > 0)
+            traversals += thread_data[i].operations;
+    }
+
+    printf_yellow("  %-14s readers: %3d, nodes: %5d ---> %8ld traversals/s, %8ld deletes/s\n",
+                  use_epochs ? "epochs:" : "rwlock:", params->num_threads, params->num_nodes, traversals, thread_data[0].operations);
+
+    list_cleanup(&head);
+    mem_epoch_synchronize();
+    mem_deinit();
+    pthread_rwlock_destroy(&rwlock);
+}
+
+/*
+ * Warm restart: building a list from scratch in an anonymous pool, against reopening
+ * the same list from a file-backed pool and finding it again through the root.
+ */
+double elapsed_ms(struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+Node *build_sequential_list(int num_nodes)
+{
+    Node *head = NULL;
+    list_init(&head, sizeof(Node) * num_nodes);
+    list_insert(&head, 0);
+    Node *tail = head;
+    for (int i = 1; i < num_nodes; i++)
+    {
+        list_insert_after(tail, (uint16_t)i);
+        tail = tail->next;
+    }
+    return head;
+}
+
+void bench_warm_restart(int num_nodes)
+{
+    size_t pool = (size_t)num_nodes * (sizeof(Node) + sizeof(size_t)) + 4096;
+    char path[] = "/tmp/list_pool_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    mem_init(pool);
+    Node *head = build_sequential_list(num_nodes);
+    double rebuild = elapsed_ms(&start);
+    assert(list_count_nodes(&head) == num_nodes);
+    mem_deinit();
+
+    // The first run builds the list in the file and records it as the root
+    assert(mem_init_file(path, pool) == MEM_FILE_CREATED);
+    head = build_sequential_list(num_nodes);
+    mem_set_root(head);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    mem_deinit();
+    double sync = elapsed_ms(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int reopened = mem_init_file(path, pool);
+    head = (Node *)mem_get_root();
+    double reopen = elapsed_ms(&start);
+    assert(reopened == MEM_FILE_REOPENED); // Raw next pointers need the old address
+    int count = list_count_nodes(&head);
+    double traverse = elapsed_ms(&start);
+    assert(count == num_nodes);
+    mem_deinit();
+    unlink(path);
+
+    printf_yellow("  nodes: %8d ---> rebuild: %9.1f ms, reopen: %7.3f ms, reopen + first traversal: %8.1f ms (write-back on deinit: %.1f ms)\n",
+                  num_nodes, rebuild, reopen, traverse, sync);
+}
+
+typedef struct
+{
+    Node *head;
+    size_t batch;
+} cleanup_args_t;
+
+void *cleanup_thread(void *arg)
+{
+    cleanup_args_t *args = arg;
+    list_cleanup(&args->head);
+    mem_flush();
+    return NULL;
+}
+
+// Frees num_nodes nodes with list_cleanup, split over num_threads lists cleaned up at once
+void bench_batched_cleanup(int num_nodes, int num_threads, size_t batch)
+{
+    size_t pool = (size_t)num_nodes * (sizeof(Node) + sizeof(size_t)) + 4096;
+    cleanup_args_t args[num_threads];
+    pthread_t threads[num_threads];
+    struct timespec start;
+
+    mem_init(pool);
+    for (int t = 0; t < num_threads; t++)
+        args[t].head = build_sequential_list(num_nodes / num_threads);
+    assert(mem_free_batch(batch) == 0);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int t = 0; t < num_threads; t++)
+        pthread_create(&threads[t], NULL, cleanup_thread, &args[t]);
+    for (int t = 0; t < num_threads; t++)
+        pthread_join(threads[t], NULL);
+    double ms = elapsed_ms(&start);
+
+    mem_free_batch(0);
+    mem_deinit();
+    printf_yellow("  nodes: %8d, threads: %d, batch: %3zu ---> %7.1f ms, %6.1f M frees/s\n",
+                  num_nodes, num_threads, batch, ms, num_nodes / ms / 1e3);
+}
+
+// Builds lists of 1K to max_nodes nodes by appending one node at a time. Through a
+// head pointer every append walks to the tail, so those stop at 100K nodes.
+void bench_list_insert_loop(int max_nodes)
+{
+    printf("  %10s %14s %14s %14s\n", "nodes", "Node ** ms", "List ms", "List ns/node");
+    for (int count = 1000; count <= max_nodes; count *= 10)
+    {
+        mem_init((size_t)count * (sizeof(Node) + sizeof(size_t)) + 4096);
+        char head_ms[32] = "-";
+        if (count <= 100000)
+            snprintf(head_ms, sizeof(head_ms), "%.1f", test_list_insert_loop(count, false));
+        double list_ms = test_list_insert_loop(count, true);
+        mem_deinit();
+        printf_yellow("  %10d %14s %14.1f %14.1f\n", count, head_ms, list_ms, list_ms * 1e6 / count);
+    }
+}
+
+// ********* Lock coupling *********
+
+void *thread_sync_insert_function(void *arg)
+{
+    thread_data_t *data = (thread_data_t *)arg;
+    for (int i = 0; i < data->num_nodes; i++)
+        list_sync_insert(data->list, data->start_value + i);
+    return NULL;
+}
+
+void *thread_sync_delete_function(void *arg)
+{
+    thread_data_t *data = (thread_data_t *)arg;
+    for (int i = 0; i < data->num_nodes; i++)
+    {
+        uint16_t data_value = data->thread_id * data->num_nodes + i;
+        my_assert(list_sync_search(data->list, data_value));
+        my_assert(list_sync_delete(data->list, data_value));
+        my_assert(!list_sync_search(data->list, data_value) && !list_sync_delete(data->list, data_value));
+    }
+    return NULL;
+}
+
+// As test_list_insert_multithread and test_list_delete_multithreaded, through the
+// lock-coupling functions: every value inserted shows up exactly once, in the order
+// its thread inserted it, and deleting them all at once leaves an empty list
+void test_list_sync_multithread(TestParams *params)
+{
+    printf_yellow("  Testing list_sync_insert and list_sync_delete (threads: %d, nodes: %d) ---> ", params->num_threads, params->num_nodes);
+    mem_init((size_t)params->num_nodes * (sizeof(Node) + sizeof(size_t)) + 4096);
+    List list;
+    list_desc_init(&list);
+
+    pthread_t threads[params->num_threads];
+    thread_data_t thread_data[params->num_threads];
+    int nodes_per_thread = params->num_nodes / params->num_threads;
+    for (int i = 0; i < params->num_threads; i++)
+    {
+        thread_data[i].list = &list;
+        thread_data[i].thread_id = i;
+        thread_data[i].start_value = i * nodes_per_thread;
+        thread_data[i].num_nodes = nodes_per_thread;
+        pthread_create(&threads[i], NULL, thread_sync_insert_function, &thread_data[i]);
+    }
+    for (int i = 0; i < params->num_threads; i++)
+        pthread_join(threads[i], NULL);
+
+    int total = nodes_per_thread * params->num_threads;
+    my_assert(list_sync_count_nodes(&list) == (size_t)total && list_count_nodes(&list.head) == total);
+    int next_expected[params->num_threads];
+    memset(next_expected, 0, sizeof(next_expected));
+    for (Node *current = list.head; current != NULL; current = current->next)
+    {
+        int thread = current->data / nodes_per_thread;
+        my_assert(current->data == thread * nodes_per_thread + next_expected[thread]);
+        next_expected[thread]++;
+        if (current->next == NULL)
+            my_assert(list.tail == current);
+    }
+
+    for (int i = 0; i < params->num_threads; i++)
+        pthread_create(&threads[i], NULL, thread_sync_delete_function, &thread_data[i]);
+    for (int i = 0; i < params->num_threads; i++)
+        pthread_join(threads[i], NULL);
+    my_assert(list.head == NULL && list.tail == NULL && list_sync_count_nodes(&list) == 0);
+
+    list_desc_cleanup(&list);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+/*
+ * Mixed workload on a shared list of MIXED_BENCH_NODES values: each operation searches
+ * for a random value, or deletes one and appends it again, the writes making up
+ * write_percent of the operations. Lock coupling is compared with one mutex around
+ * list_search, list_delete and list_insert.
+ */
+#define MIXED_BENCH_NODES 1000
+#define MIXED_BENCH_OPS 20000
+
+typedef struct
+{
+    List *list;
+    pthread_mutex_t *coarse; // NULL for lock coupling
+    int write_percent;
+    unsigned int seed;
+} mixed_args_t;
+
+void *mixed_thread(void *arg)
+{
+    mixed_args_t *args = arg;
+    for (int op = 0; op < MIXED_BENCH_OPS; op++)
+    {
+        uint16_t value = rand_r(&args->seed) % MIXED_BENCH_NODES;
+        bool write = (int)(rand_r(&args->seed) % 100) < args->write_percent;
+        if (args->coarse != NULL)
+        {
+            pthread_mutex_lock(args->coarse);
+            if (write && list_search(&args->list->head, value) != NULL)
+            {
+                list_delete(&args->list->head, value);
+                list_insert(&args->list->head, value);
+            }
+            else
+                list_search(&args->list->head, value);
+            pthread_mutex_unlock(args->coarse);
+        }
+        else if (write)
+        {
+            if (list_sync_delete(args->list, value))
+                list_sync_insert(args->list, value);
+        }
+        else
+            list_sync_search(args->list, value);
+    }
+    return NULL;
+}
+
+void bench_list_sync_mixed(int num_threads, int write_percent, bool coupling)
+{
+    pthread_mutex_t coarse = PTHREAD_MUTEX_INITIALIZER;
+    pthread_t threads[num_threads];
+    mixed_args_t args[num_threads];
+    struct timespec start;
+
+    mem_init((size_t)(MIXED_BENCH_NODES + num_threads) * (sizeof(Node) + sizeof(size_t)) + 4096);
+    List list;
+    list_desc_init(&list);
+    for (int i = 0; i < MIXED_BENCH_NODES; i++)
+        list_desc_insert(&list, (uint16_t)i);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int t = 0; t < num_threads; t++)
+    {
+        args[t] = (mixed_args_t){&list, coupling ? NULL : &coarse, write_percent, (unsigned int)t + 1};
+        pthread_create(&threads[t], NULL, mixed_thread, &args[t]);
+    }
+    for (int t = 0; t < num_threads; t++)
+        pthread_join(threads[t], NULL);
+    double ms = elapsed_ms(&start);
+
+    my_assert(list_count_nodes(&list.head) == MIXED_BENCH_NODES && list_desc_count_nodes(&list) == MIXED_BENCH_NODES);
+    list_desc_cleanup(&list);
+    mem_deinit();
+    printf_yellow("  threads: %2d, writes: %2d%%, %-13s ---> %8.1f ms, %7.1f K ops/s\n", num_threads, write_percent,
+                  coupling ? "lock coupling" : "one mutex", ms, num_threads * MIXED_BENCH_OPS / ms);
+}
+
 // Main function to run all tests
 int main(int argc, char *argv[])
 {
@@ -670,6 +1147,11 @@ int main(int argc, char *argv[])
         printf(" 6. test_list_insert_after - Test multiple insertions after a given node\n");
         printf(" 7. test_list_insert_after - Test multiple insertions after a given node\n");
         printf(" 8. test_list_delete - Test multiple detelions\n");
+        printf(" 9. bench_traversal_with_deletes - Read-mostly traversal with concurrent deletes, epochs vs rwlock\n");
+        printf("10. bench_warm_restart - Rebuilding a list against reopening it from a file-backed pool\n");
+        printf("11. bench_batched_cleanup - list_cleanup of 1M nodes with mem_free taking the lock per block or per batch\n");
+        printf("12. bench_list_insert_loop - Appending up to 10M nodes through a head pointer and through a List descriptor\n");
+        printf("13. bench_list_sync_mixed - Lock coupling against one list mutex under mixed searches and writes\n");
         printf(" 0. Run all tests\n");
         return 1;
     }
@@ -729,6 +1211,36 @@ int main(int argc, char *argv[])
             for (int j = 8; j < 14; j++) // from 2^8 = 256 up to 2^14 = 16384 nodes
                 test_list_delete_multithreaded(&(TestParams){.num_threads = pow(2, i), .num_nodes = pow(2, j)});
         break;
+    case 9:
+        for (int i = 1; i <= 8; i *= 2) // from 1 up to 8 reader threads
+        {
+            bench_traversal_with_deletes(&(TestParams){.num_threads = i, .num_nodes = 1024}, false);
+            bench_traversal_with_deletes(&(TestParams){.num_threads = i, .num_nodes = 1024}, true);
+        }
+        break;
+    case 10:
+        for (int n = 10000; n <= 10000000; n *= 10) // from 10K up to 10M nodes
+            bench_warm_restart(n);
+        break;
+    case 11:
+        for (int threads = 1; threads <= 4; threads *= 4)
+            for (size_t batch = 0; batch <= MEM_FREE_BATCH_MAX; batch = batch == 0 ? 16 : batch * 4)
+                bench_batched_cleanup(1000000, threads, batch);
+        break;
+    case 12:
+        test_list_descriptor();
+        bench_list_insert_loop(10000000);
+        break;
+    case 13:
+        for (int threads = 1; threads <= 8; threads *= 2)
+            test_list_sync_multithread(&(TestParams){.num_threads = threads, .num_nodes = 2048});
+        for (int write_percent = 10; write_percent <= 50; write_percent += 40)
+            for (int threads = 1; threads <= 8; threads *= 2)
+            {
+                bench_list_sync_mixed(threads, write_percent, false);
+                bench_list_sync_mixed(threads, write_percent, true);
+            }
+        break;
 
     default:
         printf("Invalid test function\n");
@@ -1,8 +1,15 @@
+#define _GNU_SOURCE // For O_DIRECT
 #include <pthread.h>
 #include <sys/time.h>
 #include <math.h>
 #include <stdbool.h>
 #include "memory_manager.h"
+#include "mem_epoch.h"
+#include "mem_hazard.h"
+#include "mem_run.h"
+#include "mem_iobuf.h"
+#include "mem_ring.h"
+#include "mem_arena.h"
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
@@ -11,7 +18,14 @@
 #include <dlfcn.h>
 #include <sys/mman.h>
 #include <fcntl.h>
+#include <signal.h>
+#include <sched.h>
+#include <limits.h>
+#include <sys/sysinfo.h>
+#include <sys/wait.h>
 #include "common_defs.h"
+#include "mem_map.h"
+#include "mem_stat.h"
 
 #include <unistd.h>
 
@@ -887,6 +901,2850 @@ void test_looking_for_out_of_bounds(){
   printf("[PASS].\n");
 }
 
+/*
+ * Sampled guard-page allocations: a guarded block must be usable up to its last byte,
+ * and both an overflow and a use-after-free must kill the process with SIGSEGV.
+ */
+
+void *alloc_guarded(size_t size)
+{
+    // With a sample rate of 1 every other allocation or so is guarded
+    for (int i = 0; i < 64; i++)
+    {
+        void *block = mem_alloc(size);
+        if (mem_guard_owns(block))
+            return block;
+    }
+    return NULL;
+}
+
+int guard_child_faults(bool use_after_free)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        char *block = alloc_guarded(24);
+        if (block == NULL)
+            _exit(2);
+        if (use_after_free)
+        {
+            mem_free(block);
+            block[0] = 1; // Must fault
+        }
+        else
+        {
+            block[24] = 1; // One past the end, must fault
+        }
+        _exit(0);
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV;
+}
+
+void test_guard_sampling()
+{
+    printf_yellow("  Testing sampled guard-page allocations ---> \n");
+    mem_init(4096);
+    my_assert(mem_guard_enable(1, 8) == 0);
+
+    char *block = alloc_guarded(24);
+    my_assert(block != NULL);
+    memset(block, 0xAB, 24);
+    sanityCheck(24, block, (char)0xAB);
+
+    fflush(stdout);
+    my_assert(guard_child_faults(false));
+    my_assert(guard_child_faults(true));
+
+    mem_guard_disable();
+    for (int i = 0; i < 16; i++)
+    {
+        void *plain = mem_alloc(8);
+        my_assert(!mem_guard_owns(plain));
+        mem_free(plain);
+    }
+
+    // Resizing reads the size of a guarded block from its slot
+    char *resized = mem_resize(block, 100);
+    my_assert(resized != NULL);
+    sanityCheck(24, resized, (char)0xAB);
+    mem_deinit();
+    printf_green("  ... [PASS].\n");
+}
+
+/*
+ * Compares the run_concurrency_test workload with sampling off and with a production sample rate.
+ * The pool is sized with room for block headers so that no allocation fails. Runs with sampling
+ * off and on are interleaved and the medians compared, which keeps scheduler noise and drift
+ * from favouring either side.
+ */
+long time_concurrency_workload(TestParams params)
+{
+    struct timeval start_time, end_time;
+    pthread_t threads[params.num_threads];
+    thread_data_t params_t[params.num_threads];
+
+    gettimeofday(&start_time, NULL);
+    mem_init(params.num_blocks * params.block_size * 2);
+    for (int i = 0; i < params.num_threads; i++)
+    {
+        params_t[i].thread_id = i;
+        params_t[i].num_blocks = params.num_blocks / params.num_threads;
+        params_t[i].block_size = params.block_size;
+        params_t[i].simulate_work = false;
+        pthread_create(&threads[i], NULL, thread_function, &params_t[i]);
+    }
+    for (int i = 0; i < params.num_threads; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    mem_deinit();
+    gettimeofday(&end_time, NULL);
+
+    return (end_time.tv_sec - start_time.tv_sec) * 1000000 + (end_time.tv_usec - start_time.tv_usec);
+}
+
+#define GUARD_BENCH_RUNS 21
+#define GUARD_BENCH_OPS (1 << 16)
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double median(double *values, int count)
+{
+    qsort(values, count, sizeof(double), compare_double);
+    return values[count / 2];
+}
+
+#define GUARD_BENCH_CHUNKS 201
+#define GUARD_BENCH_CHUNK_OPS 4096
+
+// Nanoseconds per mem_alloc/mem_free pair over count pairs
+static double guard_loop_ns(int count)
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < count; i++)
+        mem_free(mem_alloc(128));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / count;
+}
+
+// Stores the nanoseconds per pair into the double arg points to
+static void *guard_dense_thread(void *arg)
+{
+    *(double *)arg = guard_loop_ns(GUARD_BENCH_OPS);
+    return NULL;
+}
+
+/*
+ * Alternates short chunks with sampling off and with sampling on at a rate so large that
+ * nothing is sampled, and stores the median cost of a pair with sampling off and the
+ * median extra cost per pair with it on into the two doubles arg points to. Pairing
+ * neighbouring chunks keeps drift and interruptions out of the difference.
+ */
+static void *guard_armed_thread(void *arg)
+{
+    double off[GUARD_BENCH_CHUNKS], extra[GUARD_BENCH_CHUNKS];
+    for (int i = 0; i < GUARD_BENCH_CHUNKS; i++)
+    {
+        mem_guard_disable();
+        off[i] = guard_loop_ns(GUARD_BENCH_CHUNK_OPS);
+        mem_guard_enable(UINT_MAX / 2, 64);
+        extra[i] = guard_loop_ns(GUARD_BENCH_CHUNK_OPS) - off[i];
+    }
+    mem_guard_disable();
+    ((double *)arg)[0] = median(off, GUARD_BENCH_CHUNKS);
+    ((double *)arg)[1] = median(extra, GUARD_BENCH_CHUNKS);
+    return NULL;
+}
+
+// Runs one of the loops above on a fresh pool and thread, whose sampling countdown starts
+// from the rate of its first allocation
+static void guard_bench_thread(void *(*loop)(void *), unsigned int sample_rate, double *result)
+{
+    pthread_t thread;
+    if (sample_rate == 0)
+        mem_guard_disable();
+    else
+        mem_guard_enable(sample_rate, 64);
+    mem_init(1 << 20);
+    pthread_create(&thread, NULL, loop, result);
+    pthread_join(thread, NULL);
+    mem_deinit();
+    mem_guard_disable();
+}
+
+/*
+ * Reports the sampling overhead two ways, each from the median of many runs.
+ * The concurrency workload gives the end-to-end cost, but on a busy or single-core machine
+ * its run-to-run noise can exceed 1%. Single-thread mem_alloc/mem_free loops therefore
+ * split the cost into what every allocation pays once sampling is on, see
+ * guard_armed_thread, and the cost of one sampled allocation, measured at a rate of 16
+ * whose mean interval is 16.5. Together with the cost of a pair of the concurrency
+ * workload they project its overhead at sample_rate, which is checked against the 1% bound.
+ */
+void bench_guard_overhead(unsigned int sample_rate)
+{
+    TestParams params = {.num_threads = 4, .num_blocks = (int)pow(2, 14), .block_size = 128};
+    double off[GUARD_BENCH_RUNS], on[GUARD_BENCH_RUNS], ratio[GUARD_BENCH_RUNS];
+
+    printf_yellow("  Timing the concurrency workload (threads: %d, blocks: %d, block size: %zu, median of %d) ---> ",
+                  params.num_threads, params.num_blocks, params.block_size, GUARD_BENCH_RUNS);
+    for (int i = 0; i < GUARD_BENCH_RUNS; i++)
+    {
+        mem_guard_disable();
+        off[i] = time_concurrency_workload(params);
+        mem_guard_enable(sample_rate, 64);
+        on[i] = time_concurrency_workload(params);
+        ratio[i] = on[i] / off[i];
+    }
+    mem_guard_disable();
+    double workload_off = median(off, GUARD_BENCH_RUNS);
+    double paired = median(ratio, GUARD_BENCH_RUNS);
+    printf_yellow("sampling 1/%u: %.0f us off, %.0f us on, overhead %.2f%% (median of paired runs)\n",
+                  sample_rate, workload_off, median(on, GUARD_BENCH_RUNS), 100.0 * (paired - 1));
+
+    double costs[2], dense[GUARD_BENCH_RUNS];
+    guard_bench_thread(guard_armed_thread, 0, costs);
+    for (int i = 0; i < GUARD_BENCH_RUNS; i++)
+        guard_bench_thread(guard_dense_thread, 16, &dense[i]);
+    double base = costs[0];
+    double armed = costs[1];
+    double sampled = (median(dense, GUARD_BENCH_RUNS) - base - armed) * 16.5;
+    double per_pair = armed + sampled / (sample_rate + 0.5);
+    printf_yellow("  Single thread: %.1f ns per alloc/free pair, %+.1f ns with sampling on, %.0f ns per sampled pair\n",
+                  base, armed, sampled);
+
+    // The workload allocates and frees num_blocks blocks per run
+    double workload_pair = workload_off * 1e3 / params.num_blocks;
+    double projected = 100.0 * per_pair / workload_pair;
+    printf_yellow("  Projected overhead at 1/%u: %.2f ns on a %.0f ns workload pair, %.2f%% (%s the 1%% bound)\n",
+                  sample_rate, per_pair, workload_pair, projected, projected < 1.0 ? "within" : "above");
+}
+
+/*
+ * Heap profiler: blocks allocated from two call sites, one of which frees everything.
+ * The live profile must attribute the remaining bytes to the other site, and the
+ * Poisson-weighted estimate must be close to the real number of bytes.
+ */
+__attribute__((noinline)) void prof_site_kept(void **blocks, int count, size_t size)
+{
+    for (int i = 0; i < count; i++)
+        blocks[i] = mem_alloc(size);
+}
+
+__attribute__((noinline)) void prof_site_freed(int count, size_t size)
+{
+    for (int i = 0; i < count; i++)
+        mem_free(mem_alloc(size));
+}
+
+// Returns the bytes reported for the first profile line mentioning site, or -1
+double prof_bytes_for(const char *profile, const char *site)
+{
+    const char *line = strstr(profile, site);
+    if (line == NULL)
+        return -1;
+    const char *value = strchr(line, ' ');
+    return value != NULL ? atof(value + 1) : -1;
+}
+
+void test_heap_profiler()
+{
+    printf_yellow("  Testing the sampling heap profiler ---> ");
+    int count = 4096;
+    size_t size = 200;
+    void **blocks = malloc(count * sizeof(void *));
+    char *profile = calloc(1, 1 << 16);
+
+    mem_init(2 * count * (size + 64));
+    my_assert(mem_prof_start(4096) == 0);
+    prof_site_kept(blocks, count, size);
+    prof_site_freed(count, size);
+
+    FILE *fp = tmpfile();
+    my_assert(mem_prof_dump(fileno(fp), MEM_PROF_LIVE) == 0);
+    rewind(fp);
+    fread(profile, 1, (1 << 16) - 1, fp);
+    fclose(fp);
+
+    double kept = prof_bytes_for(profile, "prof_site_kept");
+    my_assert(prof_bytes_for(profile, "prof_site_freed") < 0);
+    my_assert(fabs(kept - (double)count * size) < 0.25 * count * size);
+    my_assert(strstr(profile, "main;test_heap_profiler;prof_site_kept") != NULL);
+
+    fp = tmpfile();
+    my_assert(mem_prof_dump(fileno(fp), MEM_PROF_CUMULATIVE) == 0);
+    rewind(fp);
+    memset(profile, 0, 1 << 16);
+    fread(profile, 1, (1 << 16) - 1, fp);
+    fclose(fp);
+    my_assert(prof_bytes_for(profile, "prof_site_freed") > 0);
+
+    for (int i = 0; i < count; i++)
+        mem_free(blocks[i]);
+    mem_prof_stop();
+    mem_prof_reset();
+    mem_deinit();
+
+    free(profile);
+    free(blocks);
+    printf_green("[PASS].\n");
+}
+
+// Cost of an allocate/free pair with the profiler stopped and running
+void bench_heap_profiler()
+{
+    int rounds = 1000000;
+    struct timeval start_time, end_time;
+    double ns[2];
+
+    mem_init(4096);
+    for (int on = 0; on < 2; on++)
+    {
+        if (on)
+            mem_prof_start(512 * 1024);
+        gettimeofday(&start_time, NULL);
+        for (int i = 0; i < rounds; i++)
+            mem_free(mem_alloc(64));
+        gettimeofday(&end_time, NULL);
+        ns[on] = ((end_time.tv_sec - start_time.tv_sec) * 1e9 + (end_time.tv_usec - start_time.tv_usec) * 1e3) / rounds;
+    }
+    mem_prof_stop();
+    mem_prof_reset();
+    mem_deinit();
+
+    printf_yellow("  mem_alloc+mem_free of 64 bytes: %.1f ns with the profiler stopped, %.1f ns with 512 KiB sampling\n", ns[0], ns[1]);
+}
+
+/*
+ * Heap walker: after a known sequence of allocations and frees, the walk must report
+ * every block in address order with the right state, and together the blocks and
+ * their headers must cover the whole pool. The binary map must hold the same blocks.
+ */
+typedef struct
+{
+    int blocks;
+    int used;
+    size_t used_bytes;
+    char *last;
+    bool ordered;
+} walk_totals_t;
+
+void walk_count(void *block, size_t size, int state, void *ctx)
+{
+    walk_totals_t *totals = (walk_totals_t *)ctx;
+    totals->blocks++;
+    if (totals->last != NULL && (char *)block <= totals->last)
+        totals->ordered = false;
+    totals->last = (char *)block;
+    if (state == MEM_BLOCK_USED)
+    {
+        totals->used++;
+        totals->used_bytes += size;
+    }
+}
+
+void test_heap_walk()
+{
+    printf_yellow("  Testing mem_walk and mem_dump_map ---> ");
+    size_t pool = 8192;
+    void *blocks[10];
+
+    mem_init(pool);
+    for (int i = 0; i < 10; i++)
+        blocks[i] = mem_alloc(100 * (i + 1));
+    for (int i = 0; i < 10; i += 2)
+        mem_free(blocks[i]);
+
+    walk_totals_t totals = {.ordered = true};
+    my_assert(mem_walk(walk_count, &totals) == 0);
+    my_assert(totals.ordered);
+    my_assert(totals.used == 5);
+    my_assert(totals.used_bytes == 200 + 400 + 600 + 800 + 1000);
+    my_assert(totals.blocks == 11); // Ten blocks plus the untouched rest of the pool
+
+    FILE *fp = tmpfile();
+    my_assert(mem_dump_map(fileno(fp)) == 0);
+    rewind(fp);
+    mem_map_header_t header;
+    my_assert(fread(&header, sizeof(header), 1, fp) == 1);
+    my_assert(header.magic == MEM_MAP_MAGIC && header.pool_size == pool && header.block_count == 11);
+
+    uint64_t covered = 0;
+    mem_map_record_t record;
+    for (uint64_t i = 0; i < header.block_count && fread(&record, sizeof(record), 1, fp) == 1; i++)
+    {
+        my_assert(record.offset == covered);
+        covered += header.header_size + (record.size & ~MEM_MAP_USED);
+        my_assert(((record.size & MEM_MAP_USED) != 0) == (i % 2 == 1 && i < 10));
+    }
+    my_assert(covered == pool);
+    fclose(fp);
+
+    mem_deinit();
+    my_assert(mem_walk(walk_count, &totals) == -1);
+    printf_green("[PASS].\n");
+}
+
+/*
+ * Epoch-based reclamation: a block retired while a reader is inside a critical section
+ * must stay allocated until that reader has left, and must be freed afterwards.
+ */
+volatile int epoch_reader_state; // 1 = inside the critical section, 2 = asked to leave
+
+void *epoch_reader(void *arg)
+{
+    mem_epoch_enter();
+    epoch_reader_state = 1;
+    while (epoch_reader_state != 2)
+        sched_yield();
+    mem_epoch_exit();
+    return NULL;
+}
+
+void find_block_state(void *block, size_t size, int state, void *ctx)
+{
+    void **wanted = (void **)ctx;
+    if (block == wanted[0])
+        wanted[1] = (void *)(intptr_t)state;
+}
+
+void test_epoch_reclamation()
+{
+    printf_yellow("  Testing epoch-based reclamation ---> ");
+    mem_init(1 << 20);
+
+    pthread_t reader;
+    epoch_reader_state = 0;
+    pthread_create(&reader, NULL, epoch_reader, NULL);
+    while (epoch_reader_state != 1)
+        sched_yield();
+
+    void *block = mem_alloc(64);
+    mem_retire(block);
+    for (int i = 0; i < 1000; i++) // Enough retirements to attempt several epoch advances
+        mem_retire(mem_alloc(64));
+    my_assert(mem_epoch_pending() == 1001);
+
+    void *query[2] = {block, (void *)-1};
+    mem_walk(find_block_state, query);
+    my_assert(query[1] == (void *)MEM_BLOCK_USED); // The reader may still hold it
+
+    epoch_reader_state = 2;
+    pthread_join(reader, NULL);
+    mem_epoch_synchronize();
+    my_assert(mem_epoch_pending() == 0);
+
+    query[1] = (void *)-1;
+    mem_walk(find_block_state, query);
+    my_assert(query[1] == (void *)MEM_BLOCK_FREE);
+
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+/*
+ * Hazard pointers: a reader that stalls while protecting a block must pin only that
+ * block. The writer keeps allocating and retiring in a pool far too small to hold
+ * the garbage unless it is reclaimed, and must not fall far behind plain mem_free.
+ */
+#define HP_RETIRES 100000
+#define HP_MAX_SLOWDOWN 8.0 // Allowed cost over an unprotected free; first-fit walks past pending blocks
+
+void *volatile hp_shared;
+volatile int hp_reader_state; // 1 = holding the hazard, 2 = asked to let go
+
+void *hp_stalled_reader(void *arg)
+{
+    mem_hp_protect(0, (void *const *)&hp_shared);
+    hp_reader_state = 1;
+    while (hp_reader_state != 2)
+        sched_yield();
+    mem_hp_clear(0);
+    return NULL;
+}
+
+double hp_time_churn(int retire)
+{
+    struct timeval start_time, end_time;
+    gettimeofday(&start_time, NULL);
+    for (int i = 0; i < HP_RETIRES; i++)
+    {
+        void *block = mem_alloc(64);
+        my_assert(block != NULL);
+        if (retire)
+            mem_hp_retire(block);
+        else
+            mem_free(block);
+    }
+    gettimeofday(&end_time, NULL);
+    return ((end_time.tv_sec - start_time.tv_sec) * 1e9 + (end_time.tv_usec - start_time.tv_usec) * 1e3) / HP_RETIRES;
+}
+
+void test_hazard_pointers()
+{
+    printf_yellow("  Testing hazard pointers with a stalled reader ---> ");
+    mem_init(64 * 1024); // Room for about 900 blocks of 64 bytes
+
+    void *pinned = mem_alloc(64);
+    hp_shared = pinned;
+    pthread_t reader;
+    hp_reader_state = 0;
+    pthread_create(&reader, NULL, hp_stalled_reader, NULL);
+    while (hp_reader_state != 1)
+        sched_yield();
+
+    hp_shared = NULL; // Unlink, then retire while the reader still holds it
+    mem_hp_retire(pinned);
+    size_t worst = 0;
+    for (int i = 0; i < HP_RETIRES; i++)
+    {
+        void *block = mem_alloc(64);
+        my_assert(block != NULL); // Fails once garbage piles up in the pool
+        mem_hp_retire(block);
+        if (mem_hp_unreclaimed() > worst)
+            worst = mem_hp_unreclaimed();
+    }
+    my_assert(worst <= mem_hp_bound());
+
+    void *query[2] = {pinned, (void *)-1};
+    mem_walk(find_block_state, query);
+    my_assert(query[1] == (void *)MEM_BLOCK_USED);
+
+    hp_reader_state = 2;
+    pthread_join(reader, NULL);
+    mem_hp_scan();
+    my_assert(mem_hp_unreclaimed() == 0);
+    query[1] = (void *)-1;
+    mem_walk(find_block_state, query);
+    my_assert(query[1] == (void *)MEM_BLOCK_FREE);
+    printf_green("[PASS].\n");
+
+    printf_yellow("  Comparing retire against plain mem_free ---> ");
+    double free_ns = 1e30, retire_ns = 1e30;
+    for (int round = 0; round < 3; round++) // Best of three against scheduler noise
+    {
+        double ns = hp_time_churn(0);
+        free_ns = ns < free_ns ? ns : free_ns;
+        ns = hp_time_churn(1);
+        retire_ns = ns < retire_ns ? ns : retire_ns;
+    }
+    mem_hp_scan();
+    printf("%.1f ns vs %.1f ns per block (%.2fx), at most %zu of %d blocks unreclaimed (bound %zu) ",
+           retire_ns, free_ns, retire_ns / free_ns, worst, HP_RETIRES, mem_hp_bound());
+    my_assert(retire_ns <= free_ns * HP_MAX_SLOWDOWN);
+
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+/*
+ * File-backed pool: blocks, their contents and the root must survive mem_deinit and
+ * mem_init_file, including when the pool comes back at a different address. The
+ * blocks are chained through offsets so the chain survives the move as well.
+ */
+typedef struct
+{
+    size_t next; // Offset of the next record, 0 at the end
+    int value;
+} file_record_t;
+
+void test_file_pool()
+{
+    printf_yellow("  Testing the file-backed pool ---> ");
+    char path[] = "/tmp/mem_pool_XXXXXX";
+    int fd = mkstemp(path);
+    my_assert(fd >= 0);
+    close(fd);
+
+    my_assert(mem_init_file(path, 64 * 1024) == MEM_FILE_CREATED);
+    my_assert(mem_get_root() == NULL);
+    file_record_t *first = NULL, *last = NULL;
+    void *gaps[100];
+    for (int i = 0; i < 100; i++)
+    {
+        file_record_t *record = mem_alloc(sizeof(file_record_t));
+        record->next = 0;
+        record->value = i;
+        if (last != NULL)
+            last->next = mem_offset_of(record);
+        else
+            first = record;
+        last = record;
+        gaps[i] = mem_alloc(8);
+    }
+    for (int i = 0; i < 100; i++)
+        mem_free(gaps[i]); // Leave free blocks between the records
+    my_assert(mem_set_root(first) == 0);
+    void *old_base = (char *)first - sizeof(size_t);
+    mem_deinit();
+
+    // Reopened at the same address: raw pointers are still good
+    my_assert(mem_init_file(path, 0) == MEM_FILE_REOPENED);
+    my_assert(mem_get_root() == first);
+    mem_deinit();
+
+    // Occupy the old address so the pool has to move
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    void *blocker = mmap((char *)old_base - page, 128 * 1024, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    my_assert(blocker != MAP_FAILED);
+    my_assert(mem_init_file(path, 0) == MEM_FILE_MOVED);
+    file_record_t *record = mem_get_root();
+    my_assert(record != NULL && record != first);
+    int count = 0;
+    for (;; record = mem_at_offset(record->next))
+    {
+        my_assert(record->value == count++);
+        if (record->next == 0)
+            break;
+    }
+    my_assert(count == 100);
+
+    // The allocator metadata is valid at the new address: freed blocks are reused
+    walk_totals_t totals = {0};
+    my_assert(mem_walk(walk_count, &totals) == 0);
+    my_assert(totals.used == 100 && totals.blocks == 201);
+    void *reused = mem_alloc(8);
+    my_assert(mem_offset_of(reused) == mem_offset_of(mem_get_root()) + sizeof(file_record_t) + sizeof(size_t));
+    mem_deinit();
+    munmap(blocker, 128 * 1024);
+
+    // Anything that is not a pool file is refused, and anonymous pools have no root
+    fd = open(path, O_WRONLY | O_TRUNC);
+    my_assert(write(fd, "not a pool", 10) == 10);
+    close(fd);
+    my_assert(mem_init_file(path, 64 * 1024) == -1);
+    unlink(path);
+    mem_init(1024);
+    my_assert(mem_set_root(mem_alloc(8)) == -1 && mem_get_root() == NULL);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+/*
+ * Shared pool: a block allocated by one process is read and freed by another one,
+ * which attaches to the pool by name and finds the block through its offset.
+ */
+#define SHM_POOL_NAME "/mem_test_pool"
+
+void test_shared_pool()
+{
+    printf_yellow("  Testing the shared-memory pool across processes ---> ");
+    shm_unlink(SHM_POOL_NAME);
+    my_assert(mem_init_shared(SHM_POOL_NAME, 1 << 20) == MEM_FILE_CREATED);
+
+    char *message = mem_alloc(64);
+    strcpy(message, "hello from the parent");
+    size_t offset = mem_offset_of(message);
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        mem_deinit(); // Attach by name like an unrelated process would
+        if (mem_init_shared(SHM_POOL_NAME, 0) != MEM_FILE_REOPENED)
+            _exit(1);
+        char *seen = mem_at_offset(offset);
+        if (strcmp(seen, "hello from the parent") != 0)
+            _exit(2);
+        mem_free(seen);
+        char *reply = mem_alloc(32);
+        strcpy(reply, "reply");
+        _exit(mem_offset_of(reply) == offset ? 0 : 3); // First fit reuses the freed block
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    my_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    my_assert(strcmp(message, "reply") == 0);
+
+    // A process killed while it hammers the pool must not leave the lock stuck
+    pid = fork();
+    if (pid == 0)
+    {
+        for (;;)
+            mem_free(mem_alloc(128));
+    }
+    usleep(20000);
+    kill(pid, SIGKILL);
+    waitpid(pid, &status, 0);
+    void *after = mem_alloc(128);
+    my_assert(after != NULL);
+    mem_free(after);
+    mem_free(message);
+
+    mem_deinit();
+    my_assert(mem_init_shared(SHM_POOL_NAME, 0) == MEM_FILE_REOPENED);
+    mem_deinit();
+    shm_unlink(SHM_POOL_NAME);
+    printf_green("[PASS].\n");
+}
+
+/*
+ * Moving buffers between two processes: through the shared pool only an 8-byte offset
+ * crosses the pipe, against writing the whole buffer into the pipe and reading it back.
+ */
+#define IPC_TOTAL_BYTES ((size_t)512 << 20)
+
+// Reads one word per cache line, so the consumer touches the whole buffer cheaply
+static uint64_t ipc_checksum(const char *buffer, size_t size)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < size; i += 64)
+        sum += *(const uint64_t *)(buffer + i);
+    return sum;
+}
+
+static double ipc_transfer(size_t buffer_size, bool shared)
+{
+    size_t messages = IPC_TOTAL_BYTES / buffer_size;
+    int channel[2], done[2];
+    my_assert(pipe(channel) == 0 && pipe(done) == 0);
+    char *private_buffer = malloc(buffer_size);
+    struct timeval start_time, end_time;
+    gettimeofday(&start_time, NULL);
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        // Consumer: checksum every buffer, then report the total
+        uint64_t sum = 0;
+        for (size_t m = 0; m < messages; m++)
+        {
+            if (shared)
+            {
+                size_t offset;
+                if (read(channel[0], &offset, sizeof(offset)) != sizeof(offset))
+                    _exit(1);
+                char *buffer = mem_at_offset(offset);
+                sum += ipc_checksum(buffer, buffer_size);
+                mem_free(buffer);
+            }
+            else
+            {
+                for (size_t got = 0; got < buffer_size;)
+                {
+                    ssize_t n = read(channel[0], private_buffer + got, buffer_size - got);
+                    if (n <= 0)
+                        _exit(1);
+                    got += n;
+                }
+                sum += ipc_checksum(private_buffer, buffer_size);
+            }
+        }
+        my_assert(write(done[1], &sum, sizeof(sum)) == sizeof(sum));
+        _exit(0);
+    }
+
+    // Producer: fill a buffer and hand it over
+    uint64_t expected = 0;
+    for (size_t m = 0; m < messages; m++)
+    {
+        char *buffer = private_buffer;
+        if (shared)
+            while ((buffer = mem_alloc(buffer_size)) == NULL)
+                sched_yield(); // Pool full, wait for the consumer to free
+        memset(buffer, (int)(m & 0xff), buffer_size);
+        expected += ipc_checksum(buffer, 64) * (buffer_size / 64);
+        if (shared)
+        {
+            size_t offset = mem_offset_of(buffer);
+            my_assert(write(channel[1], &offset, sizeof(offset)) == sizeof(offset));
+        }
+        else
+        {
+            for (size_t sent = 0; sent < buffer_size;)
+            {
+                ssize_t n = write(channel[1], buffer + sent, buffer_size - sent);
+                my_assert(n > 0);
+                sent += n;
+            }
+        }
+    }
+
+    uint64_t sum = 0;
+    my_assert(read(done[0], &sum, sizeof(sum)) == sizeof(sum));
+    int status;
+    waitpid(pid, &status, 0);
+    gettimeofday(&end_time, NULL);
+    my_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0 && sum == expected);
+
+    close(channel[0]);
+    close(channel[1]);
+    close(done[0]);
+    close(done[1]);
+    free(private_buffer);
+    double seconds = (end_time.tv_sec - start_time.tv_sec) + (end_time.tv_usec - start_time.tv_usec) / 1e6;
+    return IPC_TOTAL_BYTES / seconds / (1 << 20);
+}
+
+void bench_shared_pool_ipc()
+{
+    for (size_t size = 4096; size <= (1 << 20); size *= 16)
+    {
+        // A fresh pool per size: freed blocks are never merged into larger ones
+        shm_unlink(SHM_POOL_NAME);
+        my_assert(mem_init_shared(SHM_POOL_NAME, 16 << 20) == MEM_FILE_CREATED);
+        double piped = ipc_transfer(size, false);
+        double shared = ipc_transfer(size, true);
+        printf_yellow("  buffer: %7zu bytes ---> pipe copy: %8.0f MB/s, shared pool: %8.0f MB/s (%.1fx)\n",
+                      size, piped, shared, shared / piped);
+        mem_deinit();
+        shm_unlink(SHM_POOL_NAME);
+    }
+}
+
+/*
+ * Dirty page decay: the whole pages of freed blocks must be returned to the kernel
+ * after the decay time, without touching live neighbours, and stay usable.
+ */
+void test_dirty_decay()
+{
+    printf_yellow("  Testing dirty page decay ---> ");
+    mem_init(8 << 20);
+    char *first = mem_alloc(64 * 1024);
+    char *live = mem_alloc(64);
+    char *second = mem_alloc(64 * 1024);
+    memset(first, 0xab, 64 * 1024);
+    memset(second, 0xab, 64 * 1024);
+    strcpy(live, "still here");
+    mem_free(first);
+    mem_free(second);
+    size_t dirty = mem_dirty_pages();
+    my_assert(dirty >= 2 * (64 * 1024 / sysconf(_SC_PAGESIZE) - 1));
+
+    my_assert(mem_decay_start(0, MEM_PURGE_DONTNEED) == -1);
+    my_assert(mem_decay_start(100, MEM_PURGE_DONTNEED) == 0);
+    usleep(300000); // Three decay periods
+    my_assert(mem_dirty_pages() == 0);
+    my_assert(mem_decay_purged_pages() == dirty);
+    my_assert(strcmp(live, "still here") == 0);
+
+    // Purged blocks are reused as usual and come back as zero pages
+    char *again = mem_alloc(64 * 1024);
+    my_assert(again == first);
+    my_assert(again[32 * 1024] == 0);
+    memset(again, 0xcd, 64 * 1024);
+    mem_decay_stop();
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+static size_t resident_kb()
+{
+    long pages = 0, resident = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp != NULL)
+    {
+        if (fscanf(fp, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(fp);
+    }
+    return resident * sysconf(_SC_PAGESIZE) / 1024;
+}
+
+/*
+ * Spike then idle: allocate and touch about 256 MB, free it all, sit idle while
+ * sampling RSS, then run the same spike again and time it. Only whole pages inside a
+ * free block can be purged and blocks are never merged, so the blocks span pages.
+ */
+#define SPIKE_BLOCKS 16384
+#define SPIKE_BLOCK_SIZE 16000
+
+static double spike(char **blocks)
+{
+    struct timeval start_time, end_time;
+    gettimeofday(&start_time, NULL);
+    for (int i = 0; i < SPIKE_BLOCKS; i++)
+    {
+        blocks[i] = mem_alloc(SPIKE_BLOCK_SIZE);
+        memset(blocks[i], i, SPIKE_BLOCK_SIZE);
+    }
+    gettimeofday(&end_time, NULL);
+    return ((end_time.tv_sec - start_time.tv_sec) * 1e9 + (end_time.tv_usec - start_time.tv_usec) * 1e3) / SPIKE_BLOCKS;
+}
+
+void bench_dirty_decay()
+{
+    char **blocks = malloc(SPIKE_BLOCKS * sizeof(char *));
+    for (int decay = 0; decay <= 1; decay++)
+    {
+        mem_init((size_t)SPIKE_BLOCKS * (SPIKE_BLOCK_SIZE + sizeof(size_t)) + (1 << 20));
+        if (decay)
+            mem_decay_start(1000, MEM_PURGE_DONTNEED);
+        size_t base = resident_kb();
+
+        double first_ns = spike(blocks);
+        size_t peak = resident_kb() - base;
+        for (int i = 0; i < SPIKE_BLOCKS; i++)
+            mem_free(blocks[i]);
+
+        printf_yellow("  decay %-4s ---> RSS after the spike: %7zu KB, idle:", decay ? "1 s:" : "off:", peak);
+        for (int tick = 1; tick <= 8; tick++)
+        {
+            usleep(250000);
+            printf(" %zu", resident_kb() - base);
+        }
+        double again_ns = spike(blocks);
+        printf(" KB\n             alloc + first write: %.0f ns per block on the spike, %.0f ns on the next one\n",
+               first_ns, again_ns);
+        mem_decay_stop();
+        mem_deinit();
+    }
+    free(blocks);
+}
+
+/*
+ * Pool locks: every lock kind must keep the concurrency workload correct. The benchmark
+ * times the same workload per lock kind and thread count.
+ */
+static const char *lock_names[] = {"pthread", "ticket", "mcs", "adaptive"};
+
+void test_lock_kinds()
+{
+    printf_yellow("  Testing every pool lock under concurrent allocations ---> ");
+    my_assert(mem_lock_select(42) == -1);
+    mem_init(1024);
+    my_assert(mem_lock_select(MEM_LOCK_TICKET) == -1); // Not while a pool is live
+    mem_deinit();
+
+    for (int kind = MEM_LOCK_PTHREAD; kind <= MEM_LOCK_ADAPTIVE; kind++)
+    {
+        my_assert(mem_lock_select(kind) == 0);
+        time_concurrency_workload((TestParams){.num_threads = 8, .num_blocks = 8192, .block_size = 64});
+    }
+    mem_lock_select(MEM_LOCK_PTHREAD);
+    printf_green("[PASS].\n");
+}
+
+void bench_lock_kinds()
+{
+    printf_yellow("  Concurrency workload (blocks: 65536, block size: 64), best of 3 in us:\n");
+    printf("  %8s", "threads");
+    for (int kind = MEM_LOCK_PTHREAD; kind <= MEM_LOCK_ADAPTIVE; kind++)
+        printf(" %10s", lock_names[kind]);
+    printf("\n");
+
+    long contended[MEM_LOCK_ADAPTIVE + 1] = {0}; // Summed over 8 threads and more
+    for (int threads = 1; threads <= 32; threads *= 2)
+    {
+        printf("  %8d", threads);
+        for (int kind = MEM_LOCK_PTHREAD; kind <= MEM_LOCK_ADAPTIVE; kind++)
+        {
+            long best = -1;
+            mem_lock_select(kind);
+            for (int round = 0; round < 3; round++)
+            {
+                long us = time_concurrency_workload((TestParams){.num_threads = threads, .num_blocks = 65536, .block_size = 64});
+                if (best < 0 || us < best)
+                    best = us;
+            }
+            printf(" %10ld", best);
+            if (threads >= 8)
+                contended[kind] += best;
+        }
+        printf("\n");
+    }
+    mem_lock_select(MEM_LOCK_PTHREAD);
+
+    int fastest = MEM_LOCK_PTHREAD;
+    for (int kind = MEM_LOCK_PTHREAD; kind <= MEM_LOCK_ADAPTIVE; kind++)
+        if (contended[kind] < contended[fastest])
+            fastest = kind;
+    printf_yellow("  Fastest with 8 threads or more on %ld CPUs: %s (%.1f%% ahead of pthread)\n",
+                  sysconf(_SC_NPROCESSORS_ONLN), lock_names[fastest],
+                  100.0 * (contended[MEM_LOCK_PTHREAD] - contended[fastest]) / contended[MEM_LOCK_PTHREAD]);
+}
+
+/*
+ * Lifetime hints: every class fills runs of its own and reuses only its own free
+ * blocks, splitting and merging them. MEM_HINT_AUTO learns the class of a call site.
+ */
+static __attribute__((noinline)) void *auto_scratch(size_t size)
+{
+    return mem_alloc_hint(size, MEM_HINT_AUTO);
+}
+
+static __attribute__((noinline)) void *auto_node(size_t size)
+{
+    return mem_alloc_hint(size, MEM_HINT_AUTO);
+}
+
+void test_lifetime_hints()
+{
+    printf_yellow("  Testing lifetime-hinted allocation ---> ");
+    mem_init(1 << 20);
+    char *a = mem_alloc_hint(100, MEM_HINT_SHORT); // Rounded up to 104
+    char *node = mem_alloc_hint(64, MEM_HINT_LONG);
+    char *b = mem_alloc_hint(100, MEM_HINT_SHORT);
+    char *perm = mem_alloc_hint(64, MEM_HINT_PERMANENT);
+    char *plain = mem_alloc(64);
+    my_assert(b == a + 104 + sizeof(size_t)); // Next to a, not after node
+    my_assert(node > b && (size_t)(node - a) >= 60 * 1024);
+    my_assert(perm > node && plain > perm);
+
+    // Freed neighbours of one class merge, and mem_alloc leaves them alone
+    strcpy(node, "kept");
+    mem_free(a);
+    mem_free(b);
+    char *c = mem_alloc_hint(200, MEM_HINT_SHORT);
+    my_assert(c == a);
+    mem_free(c);
+    char *p = mem_alloc(16);
+    my_assert(p != c);
+    my_assert(strcmp(node, "kept") == 0);
+
+    char *r = mem_alloc_hint(10, MEM_HINT_LONG);
+    strcpy(r, "resized");
+    r = mem_resize(r, 1000);
+    my_assert(r != NULL && strcmp(r, "resized") == 0);
+    mem_deinit();
+
+    // The regions are soft: once the pool is used up, any free block serves any request
+    mem_init(4096);
+    my_assert(mem_alloc_hint(1000, MEM_HINT_SHORT) != NULL);
+    my_assert(mem_alloc(2000) != NULL);
+    my_assert(mem_alloc_hint(500, MEM_HINT_LONG) != NULL);
+    mem_deinit();
+
+    // Scratch blocks die young, nodes never do; what is learned outlives the pool
+    mem_init(1 << 20);
+    for (int i = 0; i < 200; i++)
+    {
+        char *scratch = auto_scratch(56);
+        my_assert(auto_node(56) != NULL);
+        mem_free(scratch);
+    }
+    mem_deinit();
+    mem_init(1 << 20);
+    char *x = mem_alloc_hint(64, MEM_HINT_SHORT);
+    char *y = mem_alloc_hint(64, MEM_HINT_LONG);
+    my_assert(auto_scratch(56) == x + 64 + sizeof(size_t)); // 56 bytes plus the trailer word
+    my_assert(auto_node(56) == y + 64 + sizeof(size_t));
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+/*
+ * Mixed-lifetime soak: long-lived list nodes accumulate until they fill most of the
+ * pool while a window of short-lived scratch buffers of 256 bytes to 8 KB turns over
+ * around them. The scratch buffers are then freed and the largest block mem_alloc can
+ * still serve shows how many fragments the nodes pin.
+ */
+#define SOAK_POOL (4 << 20)
+#define SOAK_NODES 45000
+#define SOAK_NODE_SIZE 64
+#define SOAK_WINDOW 64
+
+static const char *soak_modes[] = {"mem_alloc", "explicit hints", "MEM_HINT_AUTO"};
+
+static void *soak_alloc(int mode, int scratch, size_t size)
+{
+    if (mode == 0)
+        return mem_alloc(size);
+    if (mode == 1)
+        return mem_alloc_hint(size, scratch ? MEM_HINT_SHORT : MEM_HINT_LONG);
+    return scratch ? auto_scratch(size) : auto_node(size);
+}
+
+void walk_free_bytes(void *block, size_t size, int state, void *ctx)
+{
+    if (state == MEM_BLOCK_FREE)
+        *(size_t *)ctx += size;
+    (void)block;
+}
+
+void bench_lifetime_soak()
+{
+    printf_yellow("  Soak: %d nodes of %d bytes, %d scratch buffers of 256 B to 8 KB live, %d MB pool\n",
+                  SOAK_NODES, SOAK_NODE_SIZE, SOAK_WINDOW, SOAK_POOL >> 20);
+    printf("  %15s %10s %10s %12s %14s %14s\n", "allocator", "ns/alloc", "failed", "free KB", "largest KB", "fragmentation");
+    void *window[SOAK_WINDOW];
+    for (int mode = 0; mode < 3; mode++)
+    {
+        mem_init(SOAK_POOL);
+        memset(window, 0, sizeof(window));
+        unsigned int seed = 42;
+        long failed = 0;
+        struct timeval start_time, end_time;
+        gettimeofday(&start_time, NULL);
+        for (int i = 0; i < SOAK_NODES; i++)
+        {
+            if (soak_alloc(mode, 0, SOAK_NODE_SIZE) == NULL)
+                failed++;
+            mem_free(window[i % SOAK_WINDOW]);
+            window[i % SOAK_WINDOW] = soak_alloc(mode, 1, 256 + rand_r(&seed) % (8192 - 256));
+            if (window[i % SOAK_WINDOW] == NULL)
+                failed++;
+        }
+        gettimeofday(&end_time, NULL);
+        for (int i = 0; i < SOAK_WINDOW; i++)
+            mem_free(window[i]);
+
+        size_t free_bytes = 0;
+        mem_walk(walk_free_bytes, &free_bytes);
+        // Going down from the free total, the first size served is the largest free extent
+        size_t largest = 0;
+        for (size_t size = free_bytes & ~(size_t)1023; size >= 1024; size -= 1024)
+        {
+            if (mem_alloc(size) != NULL)
+            {
+                largest = size;
+                break;
+            }
+        }
+        double ns = ((end_time.tv_sec - start_time.tv_sec) * 1e9 + (end_time.tv_usec - start_time.tv_usec) * 1e3) / (2.0 * SOAK_NODES);
+        printf("  %15s %10.0f %10ld %12zu %14zu %13.1f%%\n", soak_modes[mode], ns, failed, free_bytes / 1024, largest / 1024,
+               free_bytes ? 100.0 * (1.0 - (double)largest / free_bytes) : 0.0);
+        mem_deinit();
+    }
+}
+
+/*
+ * Handles: unpinned handle blocks slide over the holes freed between them, pinned ones
+ * and plain blocks stay put, and the space they leave returns to the untouched tail.
+ */
+void test_handles()
+{
+    printf_yellow("  Testing handles and mem_compact ---> ");
+    mem_init(64 * 1024);
+    mem_handle_t handles[60];
+    char *plain = NULL;
+    for (int i = 0; i < 60; i++)
+    {
+        if (i == 30)
+            plain = mem_alloc(100);
+        handles[i] = mem_handle_alloc(1000);
+        my_assert(handles[i] != 0);
+        memset(mem_handle_lock(handles[i]), i, 1000);
+        mem_handle_unlock(handles[i]);
+    }
+    strcpy(plain, "not relocatable");
+    my_assert(mem_handle_lock(0) == NULL);
+
+    for (int i = 1; i < 60; i += 2)
+        my_assert(mem_handle_free(handles[i]) == 0);
+    my_assert(mem_handle_free(handles[1]) == -1);
+    my_assert(mem_alloc(16000) == NULL); // Only holes of 1000 bytes and a short tail
+
+    char *pinned = mem_handle_lock(handles[0]);
+    char *last = mem_handle_lock(handles[58]);
+    mem_handle_unlock(handles[58]);
+    my_assert(mem_compact() > 0);
+    my_assert(mem_handle_lock(handles[0]) == pinned);
+    my_assert(mem_handle_free(handles[0]) == -1);
+    mem_handle_unlock(handles[0]);
+    mem_handle_unlock(handles[0]);
+    my_assert((char *)mem_handle_lock(handles[58]) < last);
+    mem_handle_unlock(handles[58]);
+
+    for (int i = 0; i < 60; i += 2)
+    {
+        char *block = mem_handle_lock(handles[i]);
+        for (int j = 0; j < 1000; j++)
+            my_assert(block[j] == (char)i);
+        mem_handle_unlock(handles[i]);
+    }
+    my_assert(strcmp(plain, "not relocatable") == 0);
+    my_assert(mem_alloc(16000) != NULL);
+    my_assert(mem_handle_free(handles[0]) == 0);
+    mem_deinit();
+    my_assert(mem_handle_lock(handles[2]) == NULL);
+    printf_green("[PASS].\n");
+}
+
+/*
+ * Long random churn over handle blocks of 64 bytes to 4 KB filling about 60% of the
+ * pool. Without compaction, freed blocks are reused whole and the pool fragments until
+ * most requests fail; with it, a failed request compacts the pool and tries again.
+ */
+#define CHURN_POOL (4 << 20)
+#define CHURN_SLOTS 1700
+#define CHURN_OPS 200000
+
+void bench_compaction()
+{
+    printf_yellow("  Churn: %d random replacements of %d handle blocks of 64 B to 4 KB in a %d MB pool\n",
+                  CHURN_OPS, CHURN_SLOTS, CHURN_POOL >> 20);
+    printf("  %12s %10s %12s %14s %12s\n", "compaction", "success", "compactions", "compact ms", "total ms");
+    mem_handle_t *slots = malloc(CHURN_SLOTS * sizeof(mem_handle_t));
+    for (int compact = 0; compact <= 1; compact++)
+    {
+        mem_init(CHURN_POOL);
+        memset(slots, 0, CHURN_SLOTS * sizeof(mem_handle_t));
+        unsigned int seed = 7;
+        long succeeded = 0, compactions = 0;
+        double compact_ms = 0;
+        struct timeval start_time, end_time, compact_start, compact_end;
+        gettimeofday(&start_time, NULL);
+        for (int op = 0; op < CHURN_OPS; op++)
+        {
+            int slot = rand_r(&seed) % CHURN_SLOTS;
+            size_t size = 64 + rand_r(&seed) % (4096 - 64);
+            if (slots[slot] != 0)
+                mem_handle_free(slots[slot]);
+            slots[slot] = mem_handle_alloc(size);
+            if (slots[slot] == 0 && compact)
+            {
+                gettimeofday(&compact_start, NULL);
+                mem_compact();
+                gettimeofday(&compact_end, NULL);
+                compact_ms += (compact_end.tv_sec - compact_start.tv_sec) * 1e3 + (compact_end.tv_usec - compact_start.tv_usec) / 1e3;
+                compactions++;
+                slots[slot] = mem_handle_alloc(size);
+            }
+            if (slots[slot] != 0)
+                succeeded++;
+        }
+        gettimeofday(&end_time, NULL);
+        printf("  %12s %9.1f%% %12ld %14.1f %12.1f\n", compact ? "on failure" : "off", 100.0 * succeeded / CHURN_OPS, compactions,
+               compact_ms, (end_time.tv_sec - start_time.tv_sec) * 1e3 + (end_time.tv_usec - start_time.tv_usec) / 1e3);
+        mem_deinit();
+    }
+    free(slots);
+}
+
+/*
+ * Bitmap runs: slots come out lowest address first with every scan, freed slots are
+ * found again, bulk allocation crosses bitmap words, and bad pointers are refused.
+ */
+void test_bitmap_runs()
+{
+    printf_yellow("  Testing bitmap slot runs (%s) ---> ", mem_run_scan_name());
+    mem_init(64 * 1024);
+    for (int kind = MEM_RUN_SCAN_SCALAR; kind <= MEM_RUN_SCAN_AVX2; kind++)
+    {
+        if (mem_run_select_scan(kind) != 0)
+            continue;
+        mem_run_t *run = mem_run_create(24, 300);
+        my_assert(run != NULL && mem_run_available(run) == 300);
+        char *slots[300];
+        for (int i = 0; i < 300; i++)
+        {
+            slots[i] = mem_run_alloc(run);
+            my_assert(slots[i] == slots[0] + i * 24);
+        }
+        my_assert(mem_run_alloc(run) == NULL);
+
+        my_assert(mem_run_free(run, slots[5] + 1) == -1);
+        my_assert(mem_run_free(run, slots[0] - 24) == -1);
+        my_assert(mem_run_free(run, slots[299] + 24) == -1);
+        my_assert(mem_run_free(run, slots[250]) == 0);
+        my_assert(mem_run_free(run, slots[250]) == -1);
+        my_assert(mem_run_free(run, slots[70]) == 0);
+        my_assert(mem_run_alloc(run) == slots[70]);
+        my_assert(mem_run_alloc(run) == slots[250]);
+
+        for (int i = 10; i < 200; i++)
+            my_assert(mem_run_free(run, slots[i]) == 0);
+        void *bulk[300];
+        my_assert(mem_run_alloc_bulk(run, bulk, 150) == 150);
+        for (int i = 0; i < 150; i++)
+            my_assert(bulk[i] == slots[10 + i]);
+        my_assert(mem_run_alloc_bulk(run, bulk, 300) == 40);
+        my_assert(bulk[39] == slots[199] && mem_run_available(run) == 0);
+        mem_run_destroy(run);
+    }
+    my_assert(mem_run_select_scan(99) == -1);
+    mem_run_select_scan(MEM_RUN_SCAN_AUTO);
+    my_assert(mem_run_create(0, 10) == NULL);
+    my_assert(mem_run_create(1 << 20, 1) == NULL); // Larger than the pool
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+/*
+ * The free-list variant the runs are compared with: free slots are chained through
+ * their first word, so allocation and free are a pointer swap.
+ */
+typedef struct
+{
+    void *head;
+} free_list_t;
+
+static void free_list_init(free_list_t *list, char *data, size_t slot_size, size_t slots)
+{
+    list->head = NULL;
+    for (size_t i = slots; i-- > 0;)
+    {
+        *(void **)(data + i * slot_size) = list->head;
+        list->head = data + i * slot_size;
+    }
+}
+
+static void *free_list_alloc(free_list_t *list)
+{
+    void *slot = list->head;
+    if (slot != NULL)
+        list->head = *(void **)slot;
+    return slot;
+}
+
+static void free_list_free(free_list_t *list, void *slot)
+{
+    *(void **)slot = list->head;
+    list->head = slot;
+}
+
+/*
+ * Steady state at a fixed occupancy: every operation frees a random live slot and
+ * allocates one. The free list is O(1) whatever the occupancy; the bitmap pays for its
+ * scan from the lowest free word but keeps the slots free of metadata.
+ */
+#define RUN_SLOTS 65536
+#define RUN_SLOT_SIZE 64
+#define RUN_OPS 2000000
+#define RUN_BULK 64
+
+static double run_elapsed_ns(struct timespec *start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
+
+// Returns nanoseconds per free and allocate pair; kind 0 is the free list
+static double run_churn(int kind, double occupancy, void **live)
+{
+    size_t count = (size_t)(RUN_SLOTS * occupancy);
+    unsigned int seed = 11;
+    free_list_t list;
+    mem_run_t *run = NULL;
+    char *data = NULL;
+
+    mem_init(8 << 20);
+    if (kind == 0)
+    {
+        data = mem_alloc(RUN_SLOTS * RUN_SLOT_SIZE);
+        free_list_init(&list, data, RUN_SLOT_SIZE, RUN_SLOTS);
+    }
+    else
+    {
+        mem_run_select_scan(kind);
+        run = mem_run_create(RUN_SLOT_SIZE, RUN_SLOTS);
+    }
+
+    // Fill completely, then free at random down to the occupancy so the holes are scattered
+    for (size_t i = 0; i < RUN_SLOTS; i++)
+        live[i] = kind == 0 ? free_list_alloc(&list) : mem_run_alloc(run);
+    for (size_t i = RUN_SLOTS; i > count; i--)
+    {
+        size_t victim = rand_r(&seed) % i;
+        kind == 0 ? free_list_free(&list, live[victim]) : (void)mem_run_free(run, live[victim]);
+        live[victim] = live[i - 1];
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int op = 0; op < RUN_OPS; op++)
+    {
+        size_t victim = rand_r(&seed) % count;
+        if (kind == 0)
+        {
+            free_list_free(&list, live[victim]);
+            live[victim] = free_list_alloc(&list);
+        }
+        else
+        {
+            mem_run_free(run, live[victim]);
+            live[victim] = mem_run_alloc(run);
+        }
+    }
+    double ns = run_elapsed_ns(&start) / RUN_OPS;
+    mem_deinit();
+    return ns;
+}
+
+void bench_bitmap_runs()
+{
+    static const double occupancies[] = {0.5, 0.9, 0.99, 0.999};
+    static const char *kinds[] = {"free list", "scalar", "tzcnt", "sse4.1", "avx2"};
+    void **live = malloc(RUN_SLOTS * sizeof(void *));
+
+    printf_yellow("  Churn: %d random free+alloc pairs over %d slots of %d B, ns per pair\n", RUN_OPS, RUN_SLOTS, RUN_SLOT_SIZE);
+    printf("  %10s", "occupancy");
+    for (int kind = 0; kind <= MEM_RUN_SCAN_AVX2; kind++)
+        printf(" %10s", kinds[kind]);
+    printf("\n");
+    for (size_t o = 0; o < sizeof(occupancies) / sizeof(occupancies[0]); o++)
+    {
+        printf("  %9.1f%%", occupancies[o] * 100);
+        for (int kind = 0; kind <= MEM_RUN_SCAN_AVX2; kind++)
+        {
+            if (kind != 0 && mem_run_select_scan(kind) != 0)
+                printf(" %10s", "-");
+            else
+                printf(" %10.1f", run_churn(kind, occupancies[o], live));
+        }
+        printf("\n");
+    }
+
+    // Bulk: refill a run with every other slot free, one slot or RUN_BULK slots per call
+    mem_run_select_scan(MEM_RUN_SCAN_AUTO);
+    double ns[2] = {0, 0};
+    for (int round = 0; round < 20; round++)
+    {
+        for (int bulk = 0; bulk <= 1; bulk++)
+        {
+            mem_init(8 << 20);
+            mem_run_t *run = mem_run_create(RUN_SLOT_SIZE, RUN_SLOTS);
+            for (size_t i = 0; i < RUN_SLOTS; i++)
+                live[i] = mem_run_alloc(run);
+            for (size_t i = 0; i < RUN_SLOTS; i += 2)
+                mem_run_free(run, live[i]);
+
+            struct timespec start;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (size_t taken = 0; taken < RUN_SLOTS / 2; taken += RUN_BULK)
+            {
+                if (bulk)
+                    mem_run_alloc_bulk(run, live + taken, RUN_BULK);
+                else
+                    for (int i = 0; i < RUN_BULK; i++)
+                        live[taken + i] = mem_run_alloc(run);
+            }
+            ns[bulk] += run_elapsed_ns(&start);
+            my_assert(mem_run_available(run) == 0);
+            mem_deinit();
+        }
+    }
+    printf("  Refilling %d scattered slots (%s): single %.1f ns per slot, bulk of %d %.1f ns per slot\n", RUN_SLOTS / 2,
+           mem_run_scan_name(), ns[0] / 20 / (RUN_SLOTS / 2), RUN_BULK, ns[1] / 20 / (RUN_SLOTS / 2));
+    free(live);
+}
+
+/*
+ * Indexed layout: the same sequence of word-sized requests lands on the same offsets
+ * as with inline headers, through frees, hinted blocks, handles and compaction.
+ */
+static void layout_replay(int layout, size_t *offsets, int count)
+{
+    my_assert(mem_layout_select(layout) == 0);
+    mem_init(256 * 1024);
+    my_assert(mem_layout_select(MEM_LAYOUT_INLINE) == -1);
+    void *blocks[64] = {0};
+    mem_handle_t handles[16] = {0};
+    unsigned int seed = 3;
+    for (int i = 0; i < count; i++)
+    {
+        int slot = rand_r(&seed) % 64;
+        if (blocks[slot] != NULL)
+            mem_free(blocks[slot]);
+        blocks[slot] = i % 7 == 0 ? mem_alloc_hint(8 * (1 + rand_r(&seed) % 64), MEM_HINT_SHORT) : mem_alloc(8 * (1 + rand_r(&seed) % 256));
+        offsets[i] = blocks[slot] != NULL ? mem_offset_of(blocks[slot]) : SIZE_MAX;
+
+        int handle = rand_r(&seed) % 16;
+        if (handles[handle] != 0)
+            mem_handle_free(handles[handle]);
+        handles[handle] = mem_handle_alloc(8 * (1 + rand_r(&seed) % 128));
+        if (i % 500 == 499)
+            mem_compact();
+    }
+    mem_deinit();
+}
+
+void test_indexed_layout()
+{
+    printf_yellow("  Testing the indexed layout against inline headers ---> ");
+    enum { REPLAY = 4000 };
+    static size_t inline_offsets[REPLAY], indexed_offsets[REPLAY];
+    layout_replay(MEM_LAYOUT_INLINE, inline_offsets, REPLAY);
+    layout_replay(MEM_LAYOUT_INDEXED, indexed_offsets, REPLAY);
+    my_assert(memcmp(inline_offsets, indexed_offsets, sizeof(inline_offsets)) == 0);
+
+    // Odd sizes are rounded up to whole words
+    mem_layout_select(MEM_LAYOUT_INDEXED);
+    mem_init(4096);
+    char *a = mem_alloc(13), *b = mem_alloc(1);
+    my_assert(b - a == 16 + sizeof(size_t));
+    mem_free(a);
+    my_assert(mem_alloc(17) == b + 8 + sizeof(size_t));
+    my_assert(mem_alloc(16) == a);
+    my_assert(mem_alloc(4096) == NULL);
+    mem_deinit();
+    my_assert(mem_layout_select(7) == -1);
+    mem_layout_select(MEM_LAYOUT_INLINE);
+    printf_green("[PASS].\n");
+}
+
+/*
+ * Allocation in a pool full of small live blocks with scattered holes too small for
+ * the request, so first fit has to get past all of them to reach the tail. Inline
+ * headers make it read one cache line per block; the index reads 64 words per line.
+ * perf counters are often not available, so only time is reported, along with the
+ * existing concurrency workload.
+ */
+#define SCAN_BLOCKS 100000
+#define SCAN_OPS 2000
+
+void bench_indexed_layout()
+{
+    static const char *layouts[] = {"inline", "indexed"};
+    void **blocks = malloc(SCAN_BLOCKS * sizeof(void *));
+
+    printf_yellow("  %d live blocks of 56 B with every 8th freed; %d allocations of 64 B, then the concurrency workload\n",
+                  SCAN_BLOCKS, SCAN_OPS);
+    printf("  %10s %16s %16s\n", "layout", "us per alloc", "workload us");
+    for (int layout = MEM_LAYOUT_INLINE; layout <= MEM_LAYOUT_INDEXED; layout++)
+    {
+        mem_layout_select(layout);
+        mem_init(16 << 20);
+        for (int i = 0; i < SCAN_BLOCKS; i++)
+            blocks[i] = mem_alloc(56);
+        for (int i = 0; i < SCAN_BLOCKS; i += 8)
+            mem_free(blocks[i]);
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int op = 0; op < SCAN_OPS; op++)
+            my_assert(mem_alloc(64) != NULL);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        mem_deinit();
+        double us = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / 1e3 / SCAN_OPS;
+
+        TestParams params = {.num_threads = 4, .num_blocks = (int)pow(2, 14), .block_size = 128};
+        long best = -1;
+        for (int i = 0; i < 5; i++)
+        {
+            long elapsed = time_concurrency_workload(params);
+            if (best < 0 || elapsed < best)
+                best = elapsed;
+        }
+        printf("  %10s %16.2f %16ld\n", layouts[layout], us, best);
+    }
+    mem_layout_select(MEM_LAYOUT_INLINE);
+    free(blocks);
+}
+
+// The mapping without tables: walks the classes until one is large enough
+static __attribute__((noinline)) size_t size_class_by_loop(size_t size)
+{
+    size_t size_class = 0;
+    for (size_t class_size = 8; class_size < size;)
+    {
+        size_class++;
+        class_size += size_class < 16 ? 8 : ((size_t)1 << (63 - __builtin_clzll(class_size))) / 4;
+    }
+    return size_class;
+}
+
+/*
+ * Size classes: every size maps to the smallest class that holds it, through the
+ * table for small sizes and the formula past it, inline and out of line alike.
+ */
+void test_size_classes()
+{
+    printf_yellow("  Testing size class lookup ---> ");
+    my_assert(mem_size_class(1) == 0 && mem_size_class_size(0) == 8);
+    my_assert(mem_size_class_size(mem_size_class(MEM_SIZE_CLASS_SMALL_MAX)) == MEM_SIZE_CLASS_SMALL_MAX);
+    my_assert(mem_size_class(MEM_SIZE_CLASS_SMALL_MAX + 1) == MEM_SIZE_CLASS_SMALL);
+    for (size_t size = 1; size <= (1 << 22); size++)
+    {
+        size_t size_class = mem_size_class(size);
+        my_assert(size_class == mem_size_class_inline(size));
+        my_assert(size <= 70000 ? size_class == size_class_by_loop(size) : 1);
+        my_assert(mem_size_class_size(size_class) >= size);
+        my_assert(size_class == 0 || mem_size_class_size(size_class - 1) < size);
+        my_assert(mem_size_class_size_inline(size_class) == mem_size_class_size(size_class));
+    }
+    my_assert(mem_size_class_size(mem_size_class((size_t)1 << 40)) == (size_t)1 << 40);
+    printf_green("[PASS].\n");
+}
+
+#define CLASS_LOOKUPS (1 << 22)
+#define CLASS_ALLOC_BATCH 1000
+#define CLASS_ALLOC_ROUNDS 2000
+
+static double class_elapsed_ns(struct timespec *start, long count)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return ((end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec)) / count;
+}
+
+void bench_size_classes()
+{
+    static const size_t ranges[] = {MEM_SIZE_CLASS_SMALL_MAX, 64 * 1024};
+    size_t *sizes = malloc(CLASS_LOOKUPS * sizeof(size_t));
+    volatile size_t sink = 0;
+
+    printf_yellow("  Lookup of %d random sizes, ns per lookup\n", CLASS_LOOKUPS);
+    printf("  %12s %10s %12s %10s\n", "sizes", "loop", "out of line", "inline");
+    for (int r = 0; r < 2; r++)
+    {
+        unsigned int seed = 5;
+        for (int i = 0; i < CLASS_LOOKUPS; i++)
+            sizes[i] = 1 + rand_r(&seed) % ranges[r];
+        double ns[3];
+        for (int variant = 0; variant < 3; variant++)
+        {
+            size_t sum = 0;
+            struct timespec start;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (int i = 0; i < CLASS_LOOKUPS; i++)
+                sum += variant == 0 ? size_class_by_loop(sizes[i]) : variant == 1 ? mem_size_class(sizes[i]) : mem_size_class_inline(sizes[i]);
+            ns[variant] = class_elapsed_ns(&start, CLASS_LOOKUPS);
+            sink += sum;
+        }
+        printf("  %5d..%-6zu %10.2f %12.2f %10.2f\n", 1, ranges[r], ns[0], ns[1], ns[2]);
+    }
+
+    // End to end: small allocations of their exact size, or rounded up to their class
+    printf_yellow("  mem_alloc and mem_free of random sizes up to 128 B in batches of %d, ns per pair\n", CLASS_ALLOC_BATCH);
+    void *blocks[CLASS_ALLOC_BATCH];
+    for (int rounded = 0; rounded <= 1; rounded++)
+    {
+        unsigned int seed = 9;
+        for (int i = 0; i < CLASS_ALLOC_BATCH; i++)
+            sizes[i] = 1 + rand_r(&seed) % 128;
+        mem_init(1 << 20);
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int round = 0; round < CLASS_ALLOC_ROUNDS; round++)
+        {
+            for (int i = 0; i < CLASS_ALLOC_BATCH; i++)
+                blocks[i] = mem_alloc(rounded ? mem_size_class_size_inline(mem_size_class_inline(sizes[i])) : sizes[i]);
+            for (int i = CLASS_ALLOC_BATCH; i-- > 0;)
+                mem_free(blocks[i]);
+        }
+        printf("  %16s %8.1f\n", rounded ? "class-rounded" : "exact size", class_elapsed_ns(&start, (long)CLASS_ALLOC_ROUNDS * CLASS_ALLOC_BATCH));
+        mem_deinit();
+    }
+    free(sizes);
+}
+
+/*
+ * Reset and checkpoints: after mem_reset the pool fills up exactly like a fresh one
+ * despite the stale headers left in it; mem_restore brings back the blocks of the
+ * checkpoint with their contents and drops everything allocated since.
+ */
+static int fill_count(size_t size)
+{
+    int count = 0;
+    while (mem_alloc(size) != NULL)
+        count++;
+    return count;
+}
+
+void test_reset_checkpoint()
+{
+    printf_yellow("  Testing mem_reset, mem_checkpoint and mem_restore ---> ");
+    for (int layout = MEM_LAYOUT_INLINE; layout <= MEM_LAYOUT_INDEXED; layout++)
+    {
+        mem_layout_select(layout);
+        mem_init(64 * 1024);
+        int fresh = fill_count(24);
+        mem_reset();
+        char *first = mem_alloc(1000);
+        for (int i = 0; i < 30; i++)
+            memset(mem_alloc(8 + i * 40), 0x5a, 8 + i * 40);
+        mem_free(first);
+        mem_handle_t handle = mem_handle_alloc(64);
+        mem_reset();
+        my_assert(mem_handle_lock(handle) == NULL);
+        walk_totals_t totals = {0};
+        mem_walk(walk_count, &totals);
+        my_assert(totals.blocks == 1 && totals.used == 0);
+        my_assert(mem_alloc(24) == first);
+        my_assert(fill_count(24) == fresh - 1);
+
+        mem_reset();
+        char *a = mem_alloc(200), *b = mem_alloc(304), *f = mem_alloc(104);
+        memset(a, 'a', 200);
+        memset(b, 'b', 304);
+        mem_free(f);
+        mem_checkpoint_t *checkpoint = mem_checkpoint();
+        my_assert(checkpoint != NULL);
+        for (int round = 0; round < 2; round++)
+        {
+            mem_free(a);
+            my_assert(mem_alloc(150) == a);
+            my_assert(mem_alloc(104) == f);
+            my_assert(mem_alloc(5000) != NULL);
+            my_assert(mem_alloc_hint(64, MEM_HINT_SHORT) != NULL);
+            my_assert(mem_restore(checkpoint) == 0);
+
+            totals = (walk_totals_t){0};
+            mem_walk(walk_count, &totals);
+            my_assert(totals.blocks == 4 && totals.used == 2 && totals.used_bytes == 504);
+            my_assert(b[0] == 'b' && b[303] == 'b');
+        }
+        my_assert(mem_alloc(100) == f);
+        my_assert(mem_alloc(400) == f + 104 + sizeof(size_t));
+        mem_free(a);
+        mem_deinit();
+        mem_init(64 * 1024);
+        my_assert(mem_restore(checkpoint) == -1);
+        mem_checkpoint_free(checkpoint);
+        mem_deinit();
+    }
+    mem_layout_select(MEM_LAYOUT_INLINE);
+    printf_green("[PASS].\n");
+}
+
+/*
+ * Per-job cost of getting a clean pool: a job builds 200 long-lived blocks, then
+ * allocates and writes 2000 blocks of 64 B to 512 B. A fresh pool per job pays for
+ * the mapping and for faulting its pages in again; mem_reset keeps them; restoring a
+ * checkpoint taken after the long-lived blocks also skips rebuilding them.
+ */
+#define JOB_POOL (16 << 20)
+#define JOB_COUNT 2000
+#define JOB_SETUP_BLOCKS 200
+#define JOB_BLOCKS 2000
+
+static void job_setup()
+{
+    for (int i = 0; i < JOB_SETUP_BLOCKS; i++)
+        memset(mem_alloc(256), i, 256);
+}
+
+static void job_work(unsigned int *seed)
+{
+    for (int i = 0; i < JOB_BLOCKS; i++)
+    {
+        size_t size = 64 + rand_r(seed) % 449;
+        memset(mem_alloc(size), i, size);
+    }
+}
+
+void bench_reset_checkpoint()
+{
+    static const char *strategies[] = {"mem_init/mem_deinit", "mem_reset", "mem_restore"};
+    printf_yellow("  %d jobs of %d setup and %d work allocations in a %d MB pool\n", JOB_COUNT, JOB_SETUP_BLOCKS, JOB_BLOCKS,
+                  JOB_POOL >> 20);
+    printf("  %20s %16s %16s\n", "between jobs", "setup us/job", "total us/job");
+    for (int strategy = 0; strategy < 3; strategy++)
+    {
+        unsigned int seed = 13;
+        double setup_ns = 0;
+        struct timespec start, setup_start, setup_end;
+        mem_checkpoint_t *checkpoint = NULL;
+        if (strategy != 0)
+            mem_init(JOB_POOL);
+        if (strategy == 2)
+        {
+            job_setup();
+            checkpoint = mem_checkpoint();
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int job = 0; job < JOB_COUNT; job++)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &setup_start);
+            if (strategy == 0)
+                mem_init(JOB_POOL);
+            else if (strategy == 1)
+                mem_reset();
+            else
+                mem_restore(checkpoint);
+            if (strategy != 2)
+                job_setup();
+            clock_gettime(CLOCK_MONOTONIC, &setup_end);
+            setup_ns += (setup_end.tv_sec - setup_start.tv_sec) * 1e9 + (setup_end.tv_nsec - setup_start.tv_nsec);
+
+            job_work(&seed);
+            if (strategy == 0)
+            {
+                clock_gettime(CLOCK_MONOTONIC, &setup_start);
+                mem_deinit();
+                clock_gettime(CLOCK_MONOTONIC, &setup_end);
+                setup_ns += (setup_end.tv_sec - setup_start.tv_sec) * 1e9 + (setup_end.tv_nsec - setup_start.tv_nsec);
+            }
+        }
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double total_ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+        printf("  %20s %16.1f %16.1f\n", strategies[strategy], setup_ns / 1e3 / JOB_COUNT, total_ns / 1e3 / JOB_COUNT);
+        mem_checkpoint_free(checkpoint);
+        if (strategy != 0)
+            mem_deinit();
+    }
+}
+
+/*
+ * I/O buffers: page-aligned, handed out until none is left, kept alive by slices
+ * after they are put back, and filled and drained with readv and writev.
+ */
+void test_io_buffers()
+{
+    printf_yellow("  Testing page-aligned I/O buffers and slices ---> ");
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    mem_init(1 << 20);
+    mem_iobuf_pool_t *pool = mem_iobuf_pool_create(5000, 8);
+    my_assert(pool != NULL && mem_iobuf_size(pool) == 2 * page_size);
+
+    void *bufs[8];
+    my_assert(mem_iobuf_get_many(pool, bufs, 10) == 8);
+    my_assert(mem_iobuf_get(pool) == NULL);
+    for (int i = 0; i < 8; i++)
+    {
+        my_assert(((uintptr_t)bufs[i] & (page_size - 1)) == 0);
+        memset(bufs[i], 'a' + i, mem_iobuf_size(pool));
+    }
+
+    // Round trip through a file: writev of partial buffers, readv into fresh ones
+    char path[] = "/tmp/mem_iobuf_XXXXXX";
+    int fd = mkstemp(path);
+    my_assert(fd >= 0);
+    size_t lengths[8] = {8192, 8192, 100, 8192, 0, 8192, 8192, 8192};
+    my_assert(mem_iobuf_writev(fd, bufs, lengths, 8) == 7 * 8192 - 8092);
+    for (int i = 0; i < 8; i++)
+        my_assert(mem_iobuf_put(pool, bufs[i]) == 0);
+    my_assert(mem_iobuf_put(pool, bufs[0]) == -1);
+
+    void *in[4];
+    my_assert(mem_iobuf_get_many(pool, in, 4) == 4);
+    lseek(fd, 0, SEEK_SET);
+    my_assert(mem_iobuf_readv(pool, fd, in, 4) == 4 * 8192);
+    my_assert(((char *)in[2])[99] == 'c' && ((char *)in[2])[100] == 'd' && ((char *)in[3])[8191] == 'f');
+    my_assert(mem_iobuf_readv(pool, fd, in, 4) == 7 * 8192 - 8092 - 4 * 8192);
+    my_assert(((char *)in[0])[99] == 'f' && ((char *)in[0])[100] == 'g' && ((char *)in[1])[100] == 'h');
+    close(fd);
+
+    // With O_DIRECT the read that reaches the end of the file, which is not a multiple of
+    // the block size, is short and cannot be resumed at the unaligned offset it leaves
+    fd = open(path, O_RDONLY | O_DIRECT);
+    if (fd >= 0)
+    {
+        my_assert(mem_iobuf_readv(pool, fd, in, 4) == 4 * 8192);
+        my_assert(mem_iobuf_readv(pool, fd, in, 4) == 7 * 8192 - 8092 - 4 * 8192);
+        my_assert(((char *)in[1])[100] == 'h');
+        close(fd);
+    }
+    unlink(path);
+
+    // A slice keeps its buffer out of circulation after the buffer is put back
+    mem_slice_t slice = mem_slice(pool, (char *)in[1] + 10, 20);
+    my_assert(slice.data == (char *)in[1] + 10 && slice.length == 20);
+    my_assert(mem_slice(pool, (char *)in[1] + 8190, 20).data == NULL); // Runs past the buffer
+    for (int i = 0; i < 4; i++)
+        mem_iobuf_put(pool, in[i]);
+    void *again[8];
+    my_assert(mem_iobuf_get_many(pool, again, 8) == 7);
+    for (int i = 0; i < 7; i++)
+        my_assert(again[i] != in[1]);
+    my_assert(slice.data[0] == 'g');
+    mem_slice_release(&slice);
+    my_assert(slice.data == NULL && mem_iobuf_get(pool) == in[1]);
+    my_assert(mem_iobuf_ref(pool, (char *)bufs[0] - 1) == -1);
+
+    mem_iobuf_pool_destroy(pool);
+    my_assert(mem_iobuf_pool_create(1 << 20, 4) == NULL); // Larger than the pool
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+/*
+ * File ingestion: read a file of text records and count and checksum them. The copy
+ * path reads into a malloc'd bounce buffer and copies each chunk into pool memory;
+ * the zero-copy path reads with readv straight into pool buffers and parses them in
+ * place, with and without O_DIRECT. The file is read once first, so buffered reads
+ * come from the page cache.
+ */
+#define INGEST_FILE_SIZE ((size_t)256 << 20)
+#define INGEST_CHUNK ((size_t)1 << 20)
+#define INGEST_BUF_SIZE ((size_t)256 << 10)
+
+static size_t ingest_parse(const char *data, size_t length, size_t *checksum)
+{
+    size_t records = 0;
+    const char *end = data + length;
+    for (const char *line = data; line < end;)
+    {
+        const char *newline = memchr(line, '\n', end - line);
+        if (newline == NULL)
+            break;
+        *checksum += (unsigned char)line[0];
+        records++;
+        line = newline + 1;
+    }
+    return records;
+}
+
+static double ingest_copy(const char *path, size_t *records, size_t *checksum)
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int fd = open(path, O_RDONLY);
+    char *bounce = malloc(INGEST_CHUNK);
+    ssize_t got;
+    while ((got = read(fd, bounce, INGEST_CHUNK)) > 0)
+    {
+        char *chunk = mem_alloc(got);
+        memcpy(chunk, bounce, got);
+        *records += ingest_parse(chunk, got, checksum);
+        mem_free(chunk);
+    }
+    free(bounce);
+    close(fd);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static double ingest_zero_copy(const char *path, int flags, size_t *records, size_t *checksum)
+{
+    enum { BUFS = INGEST_CHUNK / INGEST_BUF_SIZE };
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int fd = open(path, O_RDONLY | flags);
+    if (fd < 0)
+        return -1;
+    mem_iobuf_pool_t *pool = mem_iobuf_pool_create(INGEST_BUF_SIZE, 2 * BUFS);
+    void *bufs[BUFS];
+    ssize_t got;
+    do
+    {
+        mem_iobuf_get_many(pool, bufs, BUFS);
+        got = mem_iobuf_readv(pool, fd, bufs, BUFS);
+        for (int i = 0; i < BUFS; i++)
+        {
+            ssize_t length = got - (ssize_t)(i * INGEST_BUF_SIZE);
+            if (length > 0)
+                *records += ingest_parse(bufs[i], length < (ssize_t)INGEST_BUF_SIZE ? length : INGEST_BUF_SIZE, checksum);
+            mem_iobuf_put(pool, bufs[i]);
+        }
+    } while (got == (ssize_t)INGEST_CHUNK);
+    mem_iobuf_pool_destroy(pool);
+    close(fd);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return got < 0 ? -1 : (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+void bench_io_buffers()
+{
+    // Records never cross a chunk boundary, so every path sees the same ones
+    char path[] = "/tmp/mem_ingest_XXXXXX";
+    int fd = mkstemp(path);
+    char *chunk = malloc(INGEST_CHUNK);
+    unsigned int seed = 17;
+    for (size_t written = 0; written < INGEST_FILE_SIZE; written += INGEST_CHUNK)
+    {
+        size_t used = 0;
+        while (used + 200 < INGEST_CHUNK)
+        {
+            size_t length = 20 + rand_r(&seed) % 180;
+            for (size_t i = 0; i < length; i++)
+                chunk[used + i] = 'a' + rand_r(&seed) % 26;
+            chunk[used + length] = '\n';
+            used += length + 1;
+        }
+        memset(chunk + used, '\n', INGEST_CHUNK - used);
+        my_assert(write(fd, chunk, INGEST_CHUNK) == (ssize_t)INGEST_CHUNK);
+    }
+    free(chunk);
+    close(fd);
+
+    printf_yellow("  Ingesting a %zu MB file of text records, best of 3\n", INGEST_FILE_SIZE >> 20);
+    printf("  %24s %10s %12s\n", "path", "MB/s", "records");
+    static const char *paths[] = {"read + copy into pool", "readv into pool buffers", "same, O_DIRECT"};
+    mem_init(64 << 20);
+    size_t expected = 0;
+    for (int variant = 0; variant < 3; variant++)
+    {
+        double best = -1;
+        size_t records = 0, checksum = 0;
+        for (int run = 0; run < 3; run++)
+        {
+            records = checksum = 0;
+            double seconds = variant == 0 ? ingest_copy(path, &records, &checksum)
+                                          : ingest_zero_copy(path, variant == 2 ? O_DIRECT : 0, &records, &checksum);
+            if (seconds >= 0 && (best < 0 || seconds < best))
+                best = seconds;
+        }
+        if (best < 0)
+        {
+            printf("  %24s %10s\n", paths[variant], "n/a");
+            continue;
+        }
+        if (variant == 0)
+            expected = records;
+        my_assert(records == expected);
+        printf("  %24s %10.0f %12zu\n", paths[variant], (INGEST_FILE_SIZE >> 20) / best, records);
+    }
+    mem_deinit();
+    unlink(path);
+}
+
+/*
+ * Ring allocator: the tail only moves once the oldest block is freed, skipping blocks
+ * freed out of order, and a block that does not fit at the end wraps to the start.
+ */
+void test_ring_allocator()
+{
+    printf_yellow("  Testing the ring allocator ---> ");
+    mem_init(64 * 1024);
+    mem_ring_t *ring = mem_ring_create(1024);
+    my_assert(ring != NULL);
+    my_assert(mem_ring_alloc(ring, 0) == NULL && mem_ring_alloc(ring, 1024) == NULL);
+
+    char *a = mem_ring_alloc(ring, 100), *b = mem_ring_alloc(ring, 200), *c = mem_ring_alloc(ring, 8);
+    my_assert(b == a + 112 && c == b + 208 && mem_ring_used(ring) == 336);
+    mem_ring_free(ring, b);
+    my_assert(mem_ring_used(ring) == 336); // b is only marked
+    mem_ring_free(ring, a);
+    my_assert(mem_ring_used(ring) == 16);
+    mem_ring_free(ring, c);
+    my_assert(mem_ring_used(ring) == 0);
+
+    // 336 bytes are behind the tail now; fill up to the end, then wrap
+    char *blocks[5];
+    for (int i = 0; i < 5; i++)
+        blocks[i] = mem_ring_alloc(ring, 120);
+    my_assert(blocks[4] == a + 336 + 4 * 128);
+    char *wrapped = mem_ring_alloc(ring, 200);
+    my_assert(wrapped == a); // The 48 bytes at the end became padding
+    my_assert(mem_ring_used(ring) == 5 * 128 + 48 + 208);
+    my_assert(mem_ring_alloc(ring, 200) == NULL);
+    for (int i = 4; i >= 2; i--)
+        mem_ring_free(ring, blocks[i]);
+    mem_ring_free(ring, blocks[0]);
+    my_assert(mem_ring_used(ring) == 4 * 128 + 48 + 208);
+    mem_ring_free(ring, blocks[1]);
+    my_assert(mem_ring_used(ring) == 208); // The tail moved past the padding too
+    my_assert(mem_ring_alloc(ring, 200) == wrapped + 208);
+    mem_ring_free(ring, wrapped);
+    my_assert(mem_ring_used(ring) == 208);
+
+    mem_ring_destroy(ring);
+    my_assert(mem_ring_create(1 << 20) == NULL);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+/*
+ * One producer allocates messages of 32 B to 255 B and passes them through a queue
+ * to a consumer that checks and frees them, in order or with each freed at a random
+ * place in a window of the last 16.
+ */
+#define RING_MESSAGES 2000000
+#define RING_QUEUE 1024 // Power of two
+#define RING_WINDOW 16
+
+typedef struct
+{
+    void *slots[RING_QUEUE];
+    size_t head __attribute__((aligned(64)));
+    size_t tail __attribute__((aligned(64)));
+    mem_ring_t *ring; // NULL for mem_alloc
+    int shuffle;
+} ring_bench_t;
+
+static void ring_bench_free(ring_bench_t *bench, void *block)
+{
+    if (bench->ring != NULL)
+        mem_ring_free(bench->ring, block);
+    else
+        mem_free(block);
+}
+
+static void *ring_bench_consumer(void *arg)
+{
+    ring_bench_t *bench = arg;
+    void *window[RING_WINDOW];
+    int held = 0;
+    unsigned int seed = 21;
+    for (size_t taken = 0; taken < RING_MESSAGES; taken++)
+    {
+        while (__atomic_load_n(&bench->head, __ATOMIC_ACQUIRE) == bench->tail)
+            sched_yield();
+        unsigned char *message = bench->slots[bench->tail % RING_QUEUE];
+        __atomic_store_n(&bench->tail, bench->tail + 1, __ATOMIC_RELEASE);
+        my_assert(message[0] == message[message[1] - 1]);
+
+        if (!bench->shuffle)
+        {
+            ring_bench_free(bench, message);
+            continue;
+        }
+        window[held++] = message;
+        if (held == RING_WINDOW)
+        {
+            int victim = rand_r(&seed) % RING_WINDOW;
+            ring_bench_free(bench, window[victim]);
+            window[victim] = window[--held];
+        }
+    }
+    while (held > 0)
+        ring_bench_free(bench, window[--held]);
+    return NULL;
+}
+
+static double ring_bench_run(ring_bench_t *bench)
+{
+    pthread_t consumer;
+    unsigned int seed = 19;
+    struct timespec start, end;
+    bench->head = bench->tail = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_create(&consumer, NULL, ring_bench_consumer, bench);
+    for (size_t sent = 0; sent < RING_MESSAGES; sent++)
+    {
+        size_t size = 32 + rand_r(&seed) % 224;
+        unsigned char *message;
+        while ((message = bench->ring != NULL ? mem_ring_alloc(bench->ring, size) : mem_alloc(size)) == NULL)
+            sched_yield(); // Full until the consumer catches up
+        message[0] = message[size - 1] = (unsigned char)sent;
+        message[1] = (unsigned char)size;
+        while (sent - __atomic_load_n(&bench->tail, __ATOMIC_ACQUIRE) == RING_QUEUE)
+            sched_yield();
+        bench->slots[sent % RING_QUEUE] = message;
+        __atomic_store_n(&bench->head, sent + 1, __ATOMIC_RELEASE);
+    }
+    pthread_join(consumer, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return RING_MESSAGES / ((end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9) / 1e6;
+}
+
+void bench_ring_allocator()
+{
+    static ring_bench_t bench;
+    printf_yellow("  Producer/consumer: %d messages of 32 B to 255 B, millions of messages per second\n", RING_MESSAGES);
+    printf("  %22s %12s %12s\n", "allocator", "in order", "window of 16");
+    for (int use_ring = 0; use_ring <= 1; use_ring++)
+    {
+        double rates[2];
+        for (int shuffle = 0; shuffle <= 1; shuffle++)
+        {
+            mem_init(64 << 20);
+            bench.ring = use_ring ? mem_ring_create(1 << 20) : NULL;
+            bench.shuffle = shuffle;
+            rates[shuffle] = ring_bench_run(&bench);
+            if (use_ring)
+                my_assert(mem_ring_used(bench.ring) == 0);
+            mem_deinit();
+        }
+        printf("  %22s %12.2f %12.2f\n", use_ring ? "mem_ring_alloc" : "mem_alloc", rates[0], rates[1]);
+    }
+}
+
+/*
+ * Arenas: blocks of every size class come back distinct and reusable, frees from
+ * other threads return blocks to their own arena, and deinit hands every chunk back.
+ */
+typedef struct
+{
+    void **blocks;
+    size_t count;
+} arena_free_args_t;
+
+static void *arena_free_thread(void *arg)
+{
+    arena_free_args_t *args = arg;
+    for (size_t i = 0; i < args->count; i++)
+        mem_arena_free(args->blocks[i]);
+    return NULL;
+}
+
+void test_arenas()
+{
+    printf_yellow("  Testing arenas ---> ");
+    static void *blocks[4096];
+    mem_init(16 << 20);
+
+    for (int mode = MEM_ARENA_PER_THREAD; mode <= MEM_ARENA_PER_CPU; mode++)
+    {
+        my_assert(mem_arena_init(mode) == 0);
+        my_assert(mem_arena_count() >= 1 && mem_arena_count() <= 64);
+        if (mode == MEM_ARENA_PER_CPU)
+            my_assert(mem_arena_count() <= (size_t)get_nprocs_conf());
+        my_assert(mem_arena_alloc(0) == NULL);
+
+        // Every size up to the small limit and a few beyond it
+        for (size_t i = 0; i < 4096; i++)
+        {
+            size_t size = 1 + i % 1100;
+            unsigned char *block = mem_arena_alloc(size);
+            my_assert(block != NULL && ((uintptr_t)block & 7) == 0);
+            memset(block, (int)(i & 0xff), size);
+            blocks[i] = block;
+        }
+        for (size_t i = 0; i < 4096; i++)
+        {
+            unsigned char *block = blocks[i];
+            size_t size = 1 + i % 1100;
+            my_assert(block[0] == (i & 0xff) && block[size - 1] == (i & 0xff));
+        }
+        my_assert(mem_arena_footprint() > 0);
+
+        // A freed block is the next one handed out for its class
+        void *block = blocks[100];
+        mem_arena_free(block);
+        my_assert(mem_arena_alloc(100) == block);
+
+        // Freed from another thread, the blocks still go back to this arena
+        size_t footprint = mem_arena_footprint();
+        arena_free_args_t args = {blocks, 4096};
+        pthread_t thread;
+        pthread_create(&thread, NULL, arena_free_thread, &args);
+        pthread_join(thread, NULL);
+        for (size_t i = 0; i < 4096; i++)
+        {
+            blocks[i] = mem_arena_alloc(1 + i % 1100);
+            my_assert(blocks[i] != NULL);
+        }
+        my_assert(mem_arena_footprint() == footprint);
+        for (size_t i = 0; i < 4096; i++)
+            mem_arena_free(blocks[i]);
+
+        mem_arena_deinit();
+        my_assert(mem_arena_footprint() == 0);
+        walk_totals_t totals = {0};
+        mem_walk(walk_count, &totals);
+        my_assert(totals.used == 0);
+    }
+    my_assert(mem_arena_init(2) == -1);
+
+    // Arenas go away with their pool: mem_deinit and mem_reset leave them empty, and the
+    // next allocations take chunks from the new pool, which mem_arena_deinit returns
+    for (int reset = 0; reset <= 1; reset++)
+    {
+        my_assert(mem_arena_init(MEM_ARENA_PER_THREAD) == 0);
+        for (size_t i = 0; i < 64; i++)
+            my_assert(mem_arena_alloc(1 + i) != NULL && mem_arena_alloc(2000) != NULL);
+        my_assert(mem_arena_footprint() > 0);
+        if (reset)
+        {
+            mem_reset();
+        }
+        else
+        {
+            mem_deinit();
+            my_assert(mem_arena_footprint() == 0);
+            mem_init(16 << 20);
+        }
+        my_assert(mem_arena_footprint() == 0);
+        for (size_t i = 0; i < 64; i++)
+        {
+            unsigned char *block = mem_arena_alloc(1 + i);
+            my_assert(block != NULL);
+            memset(block, 0xa5, 1 + i);
+        }
+        walk_totals_t totals = {0};
+        mem_walk(walk_count, &totals);
+        my_assert(totals.used > 0);
+        mem_arena_deinit();
+        totals = (walk_totals_t){0};
+        mem_walk(walk_count, &totals);
+        my_assert(totals.used == 0);
+    }
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+/*
+ * Threads far outnumbering the CPUs each keep 64 blocks of 16 B to 512 B alive and
+ * replace one at random per operation, in per-thread and in per-CPU arenas.
+ */
+#define ARENA_BENCH_OPS 200000
+#define ARENA_BENCH_LIVE 64
+
+static void *arena_bench_thread(void *arg)
+{
+    unsigned int seed = (unsigned int)(uintptr_t)arg;
+    void *live[ARENA_BENCH_LIVE] = {NULL};
+    for (size_t op = 0; op < ARENA_BENCH_OPS; op++)
+    {
+        size_t slot = rand_r(&seed) % ARENA_BENCH_LIVE;
+        size_t size = 16 + rand_r(&seed) % 497;
+        mem_arena_free(live[slot]);
+        live[slot] = mem_arena_alloc(size);
+        my_assert(live[slot] != NULL);
+        memset(live[slot], (int)op, size);
+    }
+    for (size_t slot = 0; slot < ARENA_BENCH_LIVE; slot++)
+        mem_arena_free(live[slot]);
+    return NULL;
+}
+
+void bench_arenas()
+{
+    int cpus = get_nprocs();
+    printf_yellow("  4 and 16 threads per CPU, %d CPUs online, %d operations per thread\n", cpus, ARENA_BENCH_OPS);
+    printf("  %10s %10s %8s %14s %14s\n", "threads", "mode", "arenas", "Mops/s", "footprint KB");
+    for (int factor = 4; factor <= 16; factor *= 4)
+    {
+        int threads = factor * cpus;
+        for (int mode = MEM_ARENA_PER_THREAD; mode <= MEM_ARENA_PER_CPU; mode++)
+        {
+            pthread_t ids[threads];
+            struct timespec start, end;
+            mem_init(64 << 20);
+            mem_arena_init(mode);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (int t = 0; t < threads; t++)
+                pthread_create(&ids[t], NULL, arena_bench_thread, (void *)(uintptr_t)(t + 1));
+            for (int t = 0; t < threads; t++)
+                pthread_join(ids[t], NULL);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+            size_t used = mode == MEM_ARENA_PER_THREAD && (size_t)threads < mem_arena_count() ? (size_t)threads : mem_arena_count();
+            printf("  %10d %10s %8zu %14.2f %14zu\n", threads, mode == MEM_ARENA_PER_CPU ? "per-CPU" : "per-thread", used,
+                   (double)threads * ARENA_BENCH_OPS / seconds / 1e6, mem_arena_footprint() / 1024);
+            mem_arena_deinit();
+            mem_deinit();
+        }
+    }
+}
+
+/*
+ * Deferred frees: another thread's frees stay invisible until its batch fills, it
+ * flushes or it exits, the freeing thread reuses its own blocks at once, and blocks
+ * collected before mem_reset are dropped instead of released into the new layout.
+ */
+static pthread_barrier_t defer_barrier;
+static void *defer_blocks[8];
+
+static int defer_used_blocks(void)
+{
+    walk_totals_t totals = {0};
+    mem_walk(walk_count, &totals);
+    return totals.used;
+}
+
+static void *defer_free_thread(void *arg)
+{
+    (void)arg;
+    for (int i = 0; i < 3; i++)
+        mem_free(defer_blocks[i]);
+    pthread_barrier_wait(&defer_barrier); // Main sees all four in use
+    pthread_barrier_wait(&defer_barrier);
+    mem_flush();
+    pthread_barrier_wait(&defer_barrier); // Main sees one
+    pthread_barrier_wait(&defer_barrier);
+    mem_free(defer_blocks[3]);
+    return NULL; // Released on exit
+}
+
+static void *defer_fill_thread(void *arg)
+{
+    (void)arg;
+    for (int i = 0; i < 4; i++)
+        mem_free(defer_blocks[i]);
+    pthread_barrier_wait(&defer_barrier); // The fourth free filled the batch
+    pthread_barrier_wait(&defer_barrier);
+    mem_free(defer_blocks[4]);
+    pthread_barrier_wait(&defer_barrier); // Main resets the pool
+    pthread_barrier_wait(&defer_barrier);
+    mem_flush();
+    return NULL;
+}
+
+void test_deferred_free()
+{
+    printf_yellow("  Testing deferred frees ---> ");
+    pthread_t thread;
+    pthread_barrier_init(&defer_barrier, NULL, 2);
+    my_assert(mem_free_batch(MEM_FREE_BATCH_MAX + 1) == -1);
+    my_assert(mem_free_batch(4) == 0);
+    mem_init(1 << 20);
+
+    for (int i = 0; i < 4; i++)
+        defer_blocks[i] = mem_alloc(64);
+    pthread_create(&thread, NULL, defer_free_thread, NULL);
+    pthread_barrier_wait(&defer_barrier);
+    my_assert(defer_used_blocks() == 4);
+    pthread_barrier_wait(&defer_barrier);
+    pthread_barrier_wait(&defer_barrier);
+    my_assert(defer_used_blocks() == 1);
+    pthread_barrier_wait(&defer_barrier);
+    pthread_join(thread, NULL);
+    my_assert(defer_used_blocks() == 0);
+
+    // The freeing thread gets its own block back on its next allocation
+    void *block = mem_alloc(64);
+    mem_free(block);
+    my_assert(mem_alloc(64) == block);
+    mem_free(block);
+    mem_flush();
+    my_assert(defer_used_blocks() == 0);
+
+    mem_reset();
+    for (int i = 0; i < 5; i++)
+        defer_blocks[i] = mem_alloc(64);
+    pthread_create(&thread, NULL, defer_fill_thread, NULL);
+    pthread_barrier_wait(&defer_barrier);
+    my_assert(defer_used_blocks() == 1);
+    pthread_barrier_wait(&defer_barrier);
+    pthread_barrier_wait(&defer_barrier);
+    mem_reset();
+    char *fresh = mem_alloc(1000); // Covers the block the thread still holds back
+    pthread_barrier_wait(&defer_barrier);
+    pthread_join(thread, NULL);
+    my_assert(defer_used_blocks() == 1);
+    mem_free(fresh);
+
+    mem_deinit();
+    mem_free_batch(0);
+    pthread_barrier_destroy(&defer_barrier);
+    printf_green("[PASS].\n");
+}
+
+/*
+ * Latency histograms: every operation lands in the size class of its block, threads
+ * that exit keep their samples, and the percentiles are ordered. Only meaningful in a
+ * build with make LATENCY_HIST=1.
+ */
+static void *latency_thread(void *arg)
+{
+    (void)arg;
+    for (int i = 0; i < 1000; i++)
+        mem_free(mem_alloc(5000));
+    return NULL;
+}
+
+void test_latency_histograms()
+{
+    printf_yellow("  Testing latency histograms ---> ");
+    mem_latency_stats_t stats;
+    if (!mem_latency_enabled())
+    {
+        my_assert(mem_latency_stats(MEM_LATENCY_ALLOC, MEM_LATENCY_ALL_CLASSES, &stats) == -1);
+        printf_green("not built in, rebuild with make LATENCY_HIST=1 [PASS].\n");
+        return;
+    }
+
+    mem_init(1 << 20);
+    mem_latency_reset();
+    void *blocks[100];
+    for (int round = 0; round < 100; round++)
+    {
+        for (int i = 0; i < 100; i++)
+            blocks[i] = mem_alloc(64);
+        for (int i = 0; i < 100; i++)
+            mem_free(blocks[i]);
+    }
+    my_assert(mem_latency_stats(MEM_LATENCY_ALLOC, mem_size_class(64), &stats) == 0);
+    my_assert(stats.count == 10000);
+    my_assert(stats.p50 <= stats.p99 && stats.p99 <= stats.p999 && stats.p999 <= stats.max);
+    my_assert(mem_latency_stats(MEM_LATENCY_FREE, mem_size_class(64), &stats) == 0 && stats.count == 10000);
+    my_assert(mem_latency_stats(MEM_LATENCY_ALLOC, mem_size_class(65), &stats) == 0 && stats.count == 0);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, latency_thread, NULL);
+    pthread_join(thread, NULL);
+    my_assert(mem_latency_stats(MEM_LATENCY_ALLOC, mem_size_class(5000), &stats) == 0 && stats.count == 1000);
+    my_assert(mem_latency_stats(MEM_LATENCY_ALLOC, MEM_LATENCY_ALL_CLASSES, &stats) == 0 && stats.count == 11000);
+
+    char *block = mem_alloc(10);
+    for (int i = 0; i < 100; i++)
+        block = mem_resize(block, 10 + i);
+    my_assert(mem_latency_stats(MEM_LATENCY_RESIZE, MEM_LATENCY_ALL_CLASSES, &stats) == 0 && stats.count == 100);
+    my_assert(mem_latency_stats(3, 0, &stats) == -1);
+
+    int null_fd = open("/dev/null", O_WRONLY);
+    my_assert(mem_latency_dump(null_fd) == 0);
+    close(null_fd);
+    mem_latency_reset();
+    my_assert(mem_latency_stats(MEM_LATENCY_ALLOC, MEM_LATENCY_ALL_CLASSES, &stats) == 0 && stats.count == 0);
+    mem_free(mem_alloc(64)); // The first record after a reset starts from empty histograms
+    my_assert(mem_latency_stats(MEM_LATENCY_ALLOC, MEM_LATENCY_ALL_CLASSES, &stats) == 0 && stats.count == 1);
+    my_assert(mem_latency_stats(MEM_LATENCY_FREE, mem_size_class(64), &stats) == 0 && stats.count == 1);
+    mem_free(block);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+// Prints the tail latencies of the concurrency workload, which its average hides
+void bench_latency_histograms()
+{
+    if (!mem_latency_enabled())
+        return;
+    TestParams params = {.num_threads = 4, .num_blocks = (int)pow(2, 14), .block_size = 128};
+    mem_latency_reset();
+    long micros = time_concurrency_workload(params);
+    printf_yellow("  Concurrency workload (threads: %d, blocks: %d, block size: %zu): %ld us, %.1f ns per operation on average\n",
+                  params.num_threads, params.num_blocks, params.block_size, micros, micros * 1e3 / (2.0 * params.num_blocks));
+    fflush(stdout);
+    mem_latency_dump(STDOUT_FILENO);
+}
+
+/*
+ * Live metrics: a reader of the segment sees the operations and the pool usage of
+ * the last refresh, contention under concurrent threads, and the segment goes away
+ * with mem_stat_unpublish.
+ */
+static void stat_read_fresh(const mem_stat_segment_t *segment, mem_stat_counters_t *counters)
+{
+    mem_stat_counters_t first;
+    mem_stat_read(segment, &first);
+    do
+    {
+        usleep(1000);
+        mem_stat_read(segment, counters);
+    } while (counters->sample_ns == first.sample_ns); // A refresh that started after the call
+}
+
+void test_live_metrics()
+{
+    printf_yellow("  Testing live metrics ---> ");
+    mem_stat_counters_t counters;
+    void *blocks[100];
+
+    my_assert(mem_stat_publish("/mmstat_test", 0) == -1);
+    mem_init(1 << 20);
+    my_assert(mem_stat_publish("/mmstat_test", 5) == 0);
+    my_assert(mem_stat_publish("/mmstat_test", 5) == -1);
+
+    int fd = shm_open("/mmstat_test", O_RDONLY, 0);
+    my_assert(fd >= 0);
+    mem_stat_segment_t *segment = mmap(NULL, sizeof(mem_stat_segment_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    my_assert(segment != MAP_FAILED && segment->magic == MEM_STAT_MAGIC && segment->pid == (uint64_t)getpid());
+
+    for (int i = 0; i < 100; i++)
+        blocks[i] = mem_alloc(1000);
+    my_assert(mem_alloc(1 << 21) == NULL);
+    for (int i = 0; i < 100; i += 2)
+        mem_free(blocks[i]);
+    stat_read_fresh(segment, &counters);
+    my_assert(counters.pool_size == 1 << 20);
+    my_assert(counters.allocs == 101 && counters.failed_allocs == 1 && counters.frees == 50);
+    my_assert(counters.used_blocks == 50 && counters.used_bytes == 50 * 1000);
+    my_assert(counters.free_blocks == 51 && counters.used_bytes + counters.free_bytes + 101 * sizeof(size_t) == 1 << 20);
+    my_assert(counters.largest_free == (1 << 20) - 100 * 1008 - 8);
+    my_assert(counters.lock_acquisitions >= 151 && counters.lock_contended <= counters.lock_acquisitions);
+
+    run_concurrency_test((TestParams){.num_threads = 8, .num_blocks = 1 << 12, .block_size = 64});
+    stat_read_fresh(segment, &counters);
+    my_assert(counters.pool_size == 0);
+    my_assert(counters.allocs == 101 + (1 << 12) && counters.frees == 50 + (1 << 12));
+
+    munmap(segment, sizeof(mem_stat_segment_t));
+    mem_stat_unpublish();
+    my_assert(shm_open("/mmstat_test", O_RDONLY, 0) < 0);
+    printf_green("  ... [PASS].\n");
+}
+
+void bench_live_metrics()
+{
+    TestParams params = {.num_threads = 4, .num_blocks = (int)pow(2, 14), .block_size = 128};
+    long best_off = -1, best_on = -1;
+
+    printf_yellow("  Timing the concurrency workload (threads: %d, blocks: %d, block size: %zu) ---> ", params.num_threads, params.num_blocks, params.block_size);
+    for (int i = 0; i < 5; i++)
+    {
+        long off = time_concurrency_workload(params);
+        mem_stat_publish("/mmstat_bench", 1000);
+        long on = time_concurrency_workload(params);
+        mem_stat_unpublish();
+        if (best_off < 0 || off < best_off)
+            best_off = off;
+        if (best_on < 0 || on < best_on)
+            best_on = on;
+    }
+    printf_yellow("publishing: %ld us off, %ld us on, overhead %.2f%%\n", best_off, best_on, 100.0 * (best_on - best_off) / best_off);
+}
+
+/*
+ * Small objects: requests up to MEM_SMALL_MAX come from pages of their size class and
+ * carry no header, are recycled per page, resize and batch-free like pool blocks, and
+ * fall back to the pool once the region is full.
+ */
+static int small_used_blocks(void)
+{
+    walk_totals_t totals = {0};
+    mem_walk(walk_count, &totals);
+    return (int)totals.used;
+}
+
+void test_small_objects()
+{
+    printf_yellow("  Testing small objects ---> ");
+    static unsigned char *objects[4096];
+
+    my_assert(mem_small_select(1 << 20) == 0);
+    mem_init(4 << 20);
+    my_assert(mem_small_select(0) == -1);
+    my_assert(mem_small_footprint() == 0);
+
+    // Every small size, each aligned to a word and none of them in the pool
+    for (size_t i = 0; i < 4096; i++)
+    {
+        size_t size = 1 + i % MEM_SMALL_MAX;
+        objects[i] = mem_alloc(size);
+        my_assert(objects[i] != NULL && ((uintptr_t)objects[i] & 7) == 0);
+        memset(objects[i], (int)(i & 0xff), size);
+    }
+    my_assert(small_used_blocks() == 0);
+    for (size_t i = 0; i < 4096; i++)
+    {
+        size_t size = 1 + i % MEM_SMALL_MAX;
+        my_assert(objects[i][0] == (i & 0xff) && objects[i][size - 1] == (i & 0xff));
+    }
+    size_t footprint = mem_small_footprint();
+    my_assert(footprint > 0 && footprint % MEM_SMALL_PAGE == 0);
+
+    // A freed object is the next one handed out for its class
+    unsigned char *object = objects[100];
+    mem_free(object);
+    my_assert(mem_alloc(100 % MEM_SMALL_MAX + 1) == object);
+
+    // Larger requests are pool blocks; resizing moves data between the two
+    void *large = mem_alloc(MEM_SMALL_MAX + 1);
+    my_assert(large != NULL && small_used_blocks() == 1);
+    mem_free(large);
+    unsigned char *grown = mem_resize(objects[15], 1000);
+    my_assert(grown != NULL && grown[0] == 15 && grown[15] == 15);
+    unsigned char *shrunk = mem_resize(grown, 16);
+    my_assert(shrunk != NULL && shrunk[0] == 15 && shrunk[15] == 15);
+    objects[15] = shrunk;
+    my_assert(small_used_blocks() == 0);
+
+    // Pages go back once empty, through deferred frees as well
+    my_assert(mem_free_batch(16) == 0);
+    for (size_t i = 0; i < 4096; i++)
+        mem_free(objects[i]);
+    mem_flush();
+    my_assert(mem_free_batch(0) == 0);
+    my_assert(mem_small_footprint() == 0);
+    for (size_t i = 0; i < 4096; i++)
+        objects[i] = mem_alloc(1 + i % MEM_SMALL_MAX);
+    my_assert(mem_small_footprint() == footprint);
+    mem_reset();
+    my_assert(mem_small_footprint() == 0);
+    mem_deinit();
+
+    // Once the two pages of a tiny region are full, the pool takes over
+    my_assert(mem_small_select(2 * MEM_SMALL_PAGE) == 0);
+    mem_init(1 << 20);
+    for (size_t i = 0; i < 1024; i++)
+    {
+        objects[i] = mem_alloc(16);
+        my_assert(objects[i] != NULL);
+    }
+    my_assert(mem_small_footprint() == 2 * MEM_SMALL_PAGE);
+    int pooled = small_used_blocks();
+    my_assert(pooled > 0 && pooled < 1024 - 2 * (MEM_SMALL_PAGE / 16 - 4));
+    for (size_t i = 0; i < 1024; i++)
+        mem_free(objects[i]);
+    my_assert(mem_small_footprint() == 0 && small_used_blocks() == 0);
+    mem_deinit();
+
+    // Switched off again, every request has a header
+    my_assert(mem_small_select(0) == 0);
+    mem_init(1 << 20);
+    object = mem_alloc(16);
+    my_assert(small_used_blocks() == 1 && mem_small_footprint() == 0);
+    mem_free(object);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+/*
+ * Bytes per object and traversal speed of a list of tiny nodes, with headers and from
+ * small-object pages. Nodes are linked in allocation order, then in a shuffled order.
+ */
+#define SMALL_BENCH_NODES (1 << 20)
+#define SMALL_BENCH_PASSES 10
+
+typedef struct small_node
+{
+    struct small_node *next;
+    uint64_t value;  // Left out for 8-byte nodes
+} small_node_t;
+
+void bench_small_objects()
+{
+    static small_node_t *nodes[SMALL_BENCH_NODES];
+    printf_yellow("  %d nodes, %d traversals\n", SMALL_BENCH_NODES, SMALL_BENCH_PASSES);
+    printf("  %6s %8s %10s %18s %18s\n", "node", "layout", "B/object", "Mnodes/s in order", "Mnodes/s shuffled");
+    for (size_t size = 8; size <= 16; size += 8)
+    {
+        for (int small = 0; small <= 1; small++)
+        {
+            mem_small_select(small ? 64 << 20 : 0);
+            mem_init(64 << 20);
+            for (size_t i = 0; i < SMALL_BENCH_NODES; i++)
+            {
+                nodes[i] = mem_alloc(size);
+                my_assert(nodes[i] != NULL);
+                if (size == 16)
+                    nodes[i]->value = i;
+            }
+            walk_totals_t totals = {0};
+            mem_walk(walk_count, &totals);
+            double bytes = small ? (double)mem_small_footprint() : (double)(totals.used_bytes + totals.used * sizeof(size_t));
+
+            double rate[2];
+            unsigned int seed = 1;
+            for (int shuffled = 0; shuffled <= 1; shuffled++)
+            {
+                if (shuffled)
+                {
+                    for (size_t i = SMALL_BENCH_NODES - 1; i > 0; i--)
+                    {
+                        size_t j = rand_r(&seed) % (i + 1);
+                        small_node_t *swap = nodes[i];
+                        nodes[i] = nodes[j];
+                        nodes[j] = swap;
+                    }
+                }
+                for (size_t i = 0; i + 1 < SMALL_BENCH_NODES; i++)
+                    nodes[i]->next = nodes[i + 1];
+                nodes[SMALL_BENCH_NODES - 1]->next = NULL;
+
+                struct timespec start, end;
+                volatile uint64_t sink = 0;
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                for (int pass = 0; pass < SMALL_BENCH_PASSES; pass++)
+                {
+                    uint64_t sum = 0;
+                    for (small_node_t *node = nodes[0]; node != NULL; node = node->next)
+                        sum += size == 16 ? node->value : 1;
+                    sink += sum;
+                }
+                clock_gettime(CLOCK_MONOTONIC, &end);
+                (void)sink;
+                double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+                rate[shuffled] = (double)SMALL_BENCH_NODES * SMALL_BENCH_PASSES / seconds / 1e6;
+            }
+            printf("  %4zu B %8s %10.2f %18.1f %18.1f\n", size, small ? "pages" : "headers", bytes / SMALL_BENCH_NODES,
+                   rate[0], rate[1]);
+            mem_deinit();
+        }
+    }
+    mem_small_select(0);
+}
+
+/*
+ * Usable sizes and capacity-aware resizing: slack is reused without a copy, blocks
+ * grow in place into free space behind them, and mem_resize_ex grows geometrically
+ * when it has to move.
+ */
+void test_usable_size()
+{
+    printf_yellow("  Testing usable sizes and mem_resize_ex ---> ");
+    mem_init(1 << 20);
+    my_assert(mem_usable_size(NULL) == 0);
+
+    // A freed block keeps its extent, so a smaller request gets all of it
+    void *large = mem_alloc(1000);
+    my_assert(mem_alloc(8) != NULL);  // Keeps the freed block from growing into the tail
+    mem_free(large);
+    char *block = mem_alloc(600);
+    my_assert(block == large && mem_usable_size(block) == 1000);
+    my_assert(mem_resize(block, 900) == block);
+    my_assert(mem_resize_ex(block, 1000, 4000) == block);
+
+    // The last block grows into the untouched tail
+    char *last = mem_alloc(100);
+    memset(last, 0x5A, 100);
+    my_assert(mem_resize(last, 5000) == last && mem_usable_size(last) == 5000);
+    char *grown = mem_resize_ex(last, 5001, 5001);
+    my_assert(grown == last && mem_usable_size(grown) >= 7500);
+    sanityCheck(100, grown, 0x5A);
+
+    // Free blocks right behind are taken in, and what is left of them stays free
+    char *first = mem_alloc(64);
+    char *second = mem_alloc(4096);
+    char *third = mem_alloc(64);
+    memset(first, 0x11, 64);
+    mem_free(second);
+    my_assert(mem_resize_ex(first, 65, 128) == first);
+    my_assert(mem_usable_size(first) >= 128 && mem_usable_size(first) < 4096);
+    sanityCheck(64, first, 0x11);
+    walk_totals_t totals = {0};
+    mem_walk(walk_count, &totals);
+    my_assert(totals.used == 5);
+    char *reuse = mem_alloc(1000);
+    my_assert(reuse > first && reuse < third);
+
+    // Blocked by a block in use, it moves and keeps its contents
+    memset(third, 0x22, 64);
+    char *moved = mem_resize_ex(third, 65, 65);
+    my_assert(moved != NULL && mem_usable_size(moved) >= 96);
+    sanityCheck(64, moved, 0x22);
+    my_assert(mem_resize_ex(NULL, 10, 20) != NULL);
+
+    // Failing leaves the block alone
+    my_assert(mem_resize_ex(moved, 2 << 20, 2 << 20) == NULL);
+    sanityCheck(64, moved, 0x22);
+    mem_deinit();
+
+    // Indexed pools round to words and keep their bitmap in step
+    my_assert(mem_layout_select(MEM_LAYOUT_INDEXED) == 0);
+    mem_init(1 << 20);
+    first = mem_alloc(20);
+    second = mem_alloc(4096);
+    third = mem_alloc(20);
+    mem_free(second);
+    my_assert(mem_resize(first, 100) == first && mem_usable_size(first) == 104);
+    reuse = mem_alloc(1000);
+    my_assert(reuse > first && reuse < third);
+    my_assert(mem_resize_ex(third, 3000, 3000) == third);
+    my_assert((char *)mem_alloc(100) > third + 3000);
+    mem_deinit();
+    my_assert(mem_layout_select(MEM_LAYOUT_INLINE) == 0);
+    printf_green("[PASS].\n");
+}
+
+/*
+ * Appends one 8-byte element at a time. Resizing to exactly the new size copied the
+ * whole buffer on every call before blocks could grow in place; that is reproduced
+ * with mem_alloc, memcpy and mem_free at a thousandth of the length. A blocker allocated
+ * behind the buffer after every move keeps it from growing in place.
+ */
+#define APPEND_ELEMENTS 10000000
+#define APPEND_COPYING_ELEMENTS 10000  // Every copy leaves a hole too small for the next one
+
+static void bench_append(const char *name, int mode, size_t elements)
+{
+    struct timespec start, end;
+    size_t moves = 0, copied = 0;
+    uint64_t *vector = NULL;
+
+    mem_init((size_t)1 << 30);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t n = 1; n <= elements; n++)
+    {
+        uint64_t *next;
+        size_t before = mem_usable_size(vector);
+        if (mode == 0)
+        {
+            next = mem_alloc(n * sizeof(uint64_t));
+            if (vector != NULL)
+                memcpy(next, vector, (n - 1) * sizeof(uint64_t));
+            mem_free(vector);
+        }
+        else if (mode == 1)
+            next = mem_resize(vector, n * sizeof(uint64_t));
+        else
+            next = mem_resize_ex(vector, n * sizeof(uint64_t), n * sizeof(uint64_t));
+        my_assert(next != NULL);
+        if (next != vector)
+        {
+            moves += vector != NULL;
+            copied += before;
+            // Holes below the buffer are filled first, the last blocker lands behind it
+            while (mode == 3 && (uint64_t *)mem_alloc(64) < next)
+                ;
+        }
+        vector = next;
+        vector[n - 1] = n;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    my_assert(vector[elements / 2] == elements / 2 + 1);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("  %-28s %10zu %10.1f %10zu %12.1f\n", name, elements, seconds * 1e9 / elements, moves, copied / 1048576.0);
+    mem_deinit();
+}
+
+void bench_append_growth()
+{
+    printf_yellow("  Appending 8-byte elements one at a time\n");
+    printf("  %-28s %10s %10s %10s %12s\n", "resize call", "elements", "ns/append", "moves", "MB copied");
+    bench_append("copy on every call", 0, APPEND_COPYING_ELEMENTS);
+    bench_append("mem_resize", 1, APPEND_ELEMENTS);
+    bench_append("mem_resize_ex", 2, APPEND_ELEMENTS);
+    bench_append("mem_resize_ex, blocked", 3, APPEND_ELEMENTS);
+}
+
 int main(int argc, char *argv[])
 {
 #ifdef VERSION
@@ -902,7 +3760,30 @@ int main(int argc, char *argv[])
         printf("  0. tests various functions with a base number of threads\n");
         printf("  1. tests various functions across variious configurations (number of threads, memory sizes,  iterations)\n");
         printf("  2. stress tests various functions with various configurations. This may take some time (especially if simulate_work flag is set to true.\n");
-	printf("  3. test_looking_for_out_of_bounds, needs LD_PRELOAD=./libmymalloc.so .\n\n");	
+	printf("  3. test_looking_for_out_of_bounds, needs LD_PRELOAD=./libmymalloc.so .\n");
+        printf("  4. tests sampled guard-page allocations and measures their overhead on the concurrency test.\n");
+        printf("  5. tests the sampling heap profiler and measures its cost.\n");
+        printf("  6. tests the heap walker and the binary pool map (render it with ./mem_map_tool).\n");
+        printf("  7. tests epoch-based reclamation.\n");
+        printf("  8. tests hazard-pointer reclamation with a stalled reader.\n");
+        printf("  9. tests the file-backed persistent pool.\n");
+        printf("  10. tests the shared-memory pool and compares it with copying through a pipe.\n");
+        printf("  11. tests dirty page decay and reports RSS over a spike followed by idle time.\n");
+        printf("  12. tests the pool lock kinds and compares them across thread counts.\n");
+        printf("  13. tests lifetime-hinted allocation and measures fragmentation after a mixed-lifetime soak.\n");
+        printf("  14. tests relocatable handles and compares allocation success after churn with and without mem_compact.\n");
+        printf("  15. tests bitmap slot runs and compares them with a free list at several occupancy levels.\n");
+        printf("  16. tests the indexed pool layout and compares allocation scans with inline headers.\n");
+        printf("  17. tests size class lookup and measures its cost.\n");
+        printf("  18. tests mem_reset and checkpoints and compares the per-job cost of a clean pool.\n");
+        printf("  19. tests page-aligned I/O buffers and compares file ingestion with the copy path.\n");
+        printf("  20. tests the ring allocator and compares it with mem_alloc between a producer and a consumer.\n");
+        printf("  21. tests arenas and compares per-thread with per-CPU arenas under oversubscribed threads.\n");
+        printf("  22. tests deferred frees.\n");
+        printf("  23. tests latency histograms and prints the tail latencies of the concurrency workload (make LATENCY_HIST=1).\n");
+        printf("  24. tests live metrics published for mmstat and times their overhead.\n");
+        printf("  25. tests header-free small objects and compares their density and traversal speed.\n");
+        printf("  26. tests usable sizes and mem_resize_ex and times an append-one-element loop.\n\n");
         return 1;
     }
 
@@ -985,6 +3866,139 @@ int main(int argc, char *argv[])
       test_looking_for_out_of_bounds();
       break;
 
+    case 4:
+        printf("\n*** Testing sampled guard-page allocations: ***\n");
+        test_guard_sampling();
+        bench_guard_overhead(MEM_GUARD_PRODUCTION_RATE);
+        break;
+
+    case 5:
+        printf("\n*** Testing the sampling heap profiler: ***\n");
+        test_heap_profiler();
+        bench_heap_profiler();
+        break;
+
+    case 6:
+        printf("\n*** Testing the heap walker: ***\n");
+        test_heap_walk();
+        break;
+
+    case 7:
+        printf("\n*** Testing epoch-based reclamation: ***\n");
+        test_epoch_reclamation();
+        break;
+
+    case 8:
+        printf("\n*** Testing hazard-pointer reclamation: ***\n");
+        test_hazard_pointers();
+        break;
+
+    case 9:
+        printf("\n*** Testing the file-backed pool: ***\n");
+        test_file_pool();
+        break;
+
+    case 10:
+        printf("\n*** Testing the shared-memory pool: ***\n");
+        test_shared_pool();
+        bench_shared_pool_ipc();
+        break;
+
+    case 11:
+        printf("\n*** Testing dirty page decay: ***\n");
+        test_dirty_decay();
+        bench_dirty_decay();
+        break;
+
+    case 12:
+        printf("\n*** Testing the pool locks: ***\n");
+        test_lock_kinds();
+        bench_lock_kinds();
+        break;
+
+    case 13:
+        printf("\n*** Testing lifetime-hinted allocation: ***\n");
+        test_lifetime_hints();
+        bench_lifetime_soak();
+        break;
+
+    case 14:
+        printf("\n*** Testing handles and compaction: ***\n");
+        test_handles();
+        bench_compaction();
+        break;
+
+    case 15:
+        printf("\n*** Testing bitmap slot runs: ***\n");
+        test_bitmap_runs();
+        bench_bitmap_runs();
+        break;
+
+    case 16:
+        printf("\n*** Testing the indexed pool layout: ***\n");
+        test_indexed_layout();
+        bench_indexed_layout();
+        break;
+
+    case 17:
+        printf("\n*** Testing size classes: ***\n");
+        test_size_classes();
+        bench_size_classes();
+        break;
+
+    case 18:
+        printf("\n*** Testing pool reset and checkpoints: ***\n");
+        test_reset_checkpoint();
+        bench_reset_checkpoint();
+        break;
+
+    case 19:
+        printf("\n*** Testing I/O buffers: ***\n");
+        test_io_buffers();
+        bench_io_buffers();
+        break;
+
+    case 20:
+        printf("\n*** Testing the ring allocator: ***\n");
+        test_ring_allocator();
+        bench_ring_allocator();
+        break;
+
+    case 21:
+        printf("\n*** Testing arenas: ***\n");
+        test_arenas();
+        bench_arenas();
+        break;
+
+    case 22:
+        printf("\n*** Testing deferred frees: ***\n");
+        test_deferred_free();
+        break;
+
+    case 23:
+        printf("\n*** Testing latency histograms: ***\n");
+        test_latency_histograms();
+        bench_latency_histograms();
+        break;
+
+    case 24:
+        printf("\n*** Testing live metrics: ***\n");
+        test_live_metrics();
+        bench_live_metrics();
+        break;
+
+    case 25:
+        printf("\n*** Testing small objects: ***\n");
+        test_small_objects();
+        bench_small_objects();
+        break;
+
+    case 26:
+        printf("\n*** Testing usable sizes and capacity-aware resizing: ***\n");
+        test_usable_size();
+        bench_append_growth();
+        break;
+
     default:
         printf("Invalid test function\n");
         break;